@@ -0,0 +1,121 @@
+// Measures IR emission throughput of outbuf against the fprintf calls it replaced, both
+// writing the same lines into memory.
+#include "../src/scc.h"
+
+#include <time.h>
+
+#define LINES 2000000
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The fragments the emitter used to write one at a time, as a typical mix of instructions
+static void emit_fprintf(FILE *out, size_t n) {
+    switch (n % 4) {
+    case 0:
+        fprintf(out, "    ");
+        fprintf(out, "%%");
+        fprintf(out, "temp_%zu", n);
+        fprintf(out, " =");
+        fprintf(out, "w ");
+        fprintf(out, "add ");
+        fprintf(out, "%%");
+        fprintf(out, "temp_%zu", n - 1);
+        fprintf(out, ", ");
+        fprintf(out, "%%");
+        fprintf(out, "ident_%zu_", n % 7);
+        fprintf(out, "%s", "counter");
+        fprintf(out, "\n");
+        break;
+    case 1:
+        fprintf(out, "    ");
+        fprintf(out, "%%");
+        fprintf(out, "temp_%zu", n);
+        fprintf(out, " =");
+        fprintf(out, "copy %d\n", (int)(n * 31) - 1000);
+        break;
+    case 2:
+        fprintf(out, "    jnz ");
+        fprintf(out, "%%");
+        fprintf(out, "temp_%zu", n - 1);
+        fprintf(out, ", @label_%zu, @label_%zu\n", n, n + 1);
+        break;
+    case 3:
+        fprintf(out, "@label_%zu\n", n);
+        fprintf(out, "    jmp @label_%zu\n", n + 1);
+        break;
+    }
+}
+
+static void emit_outbuf(outbuf_t *out, size_t n) {
+    switch (n % 4) {
+    case 0:
+        outbuf_lit(out, "    %temp_");
+        outbuf_u64(out, n);
+        outbuf_lit(out, " =w add %temp_");
+        outbuf_u64(out, n - 1);
+        outbuf_lit(out, ", %ident_");
+        outbuf_u64(out, n % 7);
+        outbuf_char(out, '_');
+        outbuf_str(out, "counter");
+        outbuf_char(out, '\n');
+        break;
+    case 1:
+        outbuf_lit(out, "    %temp_");
+        outbuf_u64(out, n);
+        outbuf_lit(out, " =copy ");
+        outbuf_i64(out, (int)(n * 31) - 1000);
+        outbuf_char(out, '\n');
+        break;
+    case 2:
+        outbuf_lit(out, "    jnz %temp_");
+        outbuf_u64(out, n - 1);
+        outbuf_lit(out, ", @label_");
+        outbuf_u64(out, n);
+        outbuf_lit(out, ", @label_");
+        outbuf_u64(out, n + 1);
+        outbuf_char(out, '\n');
+        break;
+    case 3:
+        outbuf_lit(out, "@label_");
+        outbuf_u64(out, n);
+        outbuf_lit(out, "\n    jmp @label_");
+        outbuf_u64(out, n + 1);
+        outbuf_char(out, '\n');
+        break;
+    }
+}
+
+int main(void) {
+    char *text = NULL;
+    size_t text_size = 0;
+    FILE *file = open_memstream(&text, &text_size);
+    assert(file != NULL);
+
+    double start = now();
+    for (size_t n = 1; n <= LINES; n++) {
+        emit_fprintf(file, n);
+    }
+    fclose(file);
+    double fprintf_elapsed = now() - start;
+
+    outbuf_t out = { 0 };
+    start = now();
+    for (size_t n = 1; n <= LINES; n++) {
+        emit_outbuf(&out, n);
+    }
+    double outbuf_elapsed = now() - start;
+
+    assert(out.length == text_size && memcmp(out.bytes, text, text_size) == 0);
+
+    printf("emit (%.1f MB):\n", text_size / 1e6);
+    printf("    %-12s %8.1f MB/s\n", "fprintf", text_size / fprintf_elapsed / 1e6);
+    printf("    %-12s %8.1f MB/s\n", "outbuf", text_size / outbuf_elapsed / 1e6);
+
+    free(text);
+    outbuf_free(&out);
+    return 0;
+}
@@ -0,0 +1,82 @@
+// Measures keyword/identifier classification throughput of keyword_lookup
+// against the strcmp chain it replaced.
+#include "../src/scc.h"
+
+#include <time.h>
+
+#define ITERATIONS 2000000
+
+static const char *keywords[] = {
+    "int", "float", "void", "return", "break", "continue", "char",
+    "long", "if", "else", "while", "for", "unsigned",
+};
+
+static const char *identifiers[] = {
+    "i", "x", "len", "count", "printf", "ft_putchar", "current", "next",
+    "result", "index", "buffer", "iterations", "rule110", "intlit", "forward", "unsigned_value",
+};
+
+static token_type_t strcmp_chain(sv_t sv) {
+    char buffer[32];
+    sv_to_cstr(sv, buffer, sizeof(buffer));
+    if (strcmp(buffer, "int") == 0) return TOKEN_INT;
+    if (strcmp(buffer, "float") == 0) return TOKEN_FLOAT;
+    if (strcmp(buffer, "void") == 0) return TOKEN_VOID;
+    if (strcmp(buffer, "return") == 0) return TOKEN_RETURN;
+    if (strcmp(buffer, "break") == 0) return TOKEN_BREAK;
+    if (strcmp(buffer, "continue") == 0) return TOKEN_CONTINUE;
+    if (strcmp(buffer, "char") == 0) return TOKEN_CHAR;
+    if (strcmp(buffer, "long") == 0) return TOKEN_LONG;
+    if (strcmp(buffer, "if") == 0) return TOKEN_IF;
+    if (strcmp(buffer, "else") == 0) return TOKEN_ELSE;
+    if (strcmp(buffer, "while") == 0) return TOKEN_WHILE;
+    if (strcmp(buffer, "for") == 0) return TOKEN_FOR;
+    if (strcmp(buffer, "unsigned") == 0) return TOKEN_UNSIGNED;
+    return TOKEN_IDENTIFIER;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *label, token_type_t (*classify)(sv_t), const char **words, size_t word_count) {
+    sv_t svs[word_count];
+    for (size_t i = 0; i < word_count; i++) {
+        svs[i] = sv_from_cstr(words[i]);
+    }
+
+    volatile size_t sink = 0;
+    double start = now();
+    for (size_t n = 0; n < ITERATIONS; n++) {
+        for (size_t i = 0; i < word_count; i++) {
+            sink += classify(svs[i]);
+        }
+    }
+    double elapsed = now() - start;
+
+    double tokens = (double)ITERATIONS * word_count;
+    printf("    %-12s %8.1f Mtokens/s\n", label, tokens / elapsed / 1e6);
+}
+
+int main(void) {
+    size_t keyword_count = sizeof(keywords) / sizeof(keywords[0]);
+    size_t identifier_count = sizeof(identifiers) / sizeof(identifiers[0]);
+
+    for (size_t i = 0; i < keyword_count; i++) {
+        sv_t sv = sv_from_cstr(keywords[i]);
+        assert(keyword_lookup(sv) == strcmp_chain(sv));
+    }
+    for (size_t i = 0; i < identifier_count; i++) {
+        assert(keyword_lookup(sv_from_cstr(identifiers[i])) == TOKEN_IDENTIFIER);
+    }
+
+    printf("keywords:\n");
+    run("strcmp chain", strcmp_chain, keywords, keyword_count);
+    run("lookup", keyword_lookup, keywords, keyword_count);
+    printf("identifiers:\n");
+    run("strcmp chain", strcmp_chain, identifiers, identifier_count);
+    run("lookup", keyword_lookup, identifiers, identifier_count);
+    return 0;
+}
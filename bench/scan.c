@@ -0,0 +1,97 @@
+// Measures the character-class scanners used by the lexer for every available ISA.
+#include "../src/scc.h"
+
+#include <time.h>
+
+#define BUFFER_SIZE (1 << 20)
+#define ITERATIONS 200
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fills buffer with runs of the given alphabet, broken up by a terminator every run_length bytes
+static void fill_runs(char *buffer, const char *alphabet, size_t run_length, char terminator) {
+    size_t alphabet_length = strlen(alphabet);
+    for (size_t i = 0; i < BUFFER_SIZE; i++) {
+        buffer[i] = (i % (run_length + 1) == run_length) ? terminator : alphabet[(i * 7) % alphabet_length];
+    }
+}
+
+static size_t scan_string_body_dquote(const char *s, size_t n) {
+    return scan_string_body(s, n, '"');
+}
+
+static size_t consume_all(size_t (*scan)(const char *, size_t), const char *buffer) {
+    size_t runs = 0;
+    size_t i = 0;
+    while (i < BUFFER_SIZE) {
+        i += scan(buffer + i, BUFFER_SIZE - i) + 1;
+        runs++;
+    }
+    return runs;
+}
+
+static void run(const char *label, size_t (*scan)(const char *, size_t), const char *buffer) {
+    volatile size_t sink = 0;
+    double start = now();
+    for (size_t n = 0; n < ITERATIONS; n++) {
+        sink += consume_all(scan, buffer);
+    }
+    double elapsed = now() - start;
+    printf("    %-12s %8.2f GB/s\n", label, (double)BUFFER_SIZE * ITERATIONS / elapsed / 1e9);
+}
+
+// Cross-check every ISA against the scalar scanners on random bytes
+static void verify(scan_isa_t isa) {
+    char buffer[256];
+    unsigned seed = 1;
+    for (size_t round = 0; round < 20000; round++) {
+        for (size_t i = 0; i < sizeof(buffer); i++) {
+            seed = seed * 1103515245 + 12345;
+            unsigned r = (seed >> 16) & 0xff;
+            // Bias towards long matching runs so the vector loops are exercised
+            buffer[i] = (r < 200) ? " \t\nab_Z09\"\\"[r % 11] : (char)r;
+        }
+        size_t offset = round % 64;
+        size_t length = sizeof(buffer) - offset;
+
+        scan_select_isa(SCAN_ISA_SCALAR);
+        size_t expected[4] = {
+            scan_whitespace(buffer + offset, length),
+            scan_identifier(buffer + offset, length),
+            scan_digits(buffer + offset, length),
+            scan_string_body(buffer + offset, length, '"'),
+        };
+        scan_select_isa(isa);
+        assert(scan_whitespace(buffer + offset, length) == expected[0]);
+        assert(scan_identifier(buffer + offset, length) == expected[1]);
+        assert(scan_digits(buffer + offset, length) == expected[2]);
+        assert(scan_string_body(buffer + offset, length, '"') == expected[3]);
+    }
+}
+
+int main(void) {
+    static char whitespace[BUFFER_SIZE];
+    static char identifiers[BUFFER_SIZE];
+    static char digits[BUFFER_SIZE];
+    static char strings[BUFFER_SIZE];
+    fill_runs(whitespace, " \t\n    ", 24, 'x');
+    fill_runs(identifiers, "abcdefghijklmnopqrstuvwxyz_ABCXYZ0123456789", 20, ' ');
+    fill_runs(digits, "0123456789", 12, ';');
+    fill_runs(strings, "Hello, world! %d %s ", 40, '"');
+
+    scan_isa_t best = scan_detect_isa();
+    for (scan_isa_t isa = SCAN_ISA_SCALAR; isa <= best; isa++) {
+        verify(isa);
+        scan_select_isa(isa);
+        printf("%s:\n", scan_isa_name(isa));
+        run("whitespace", scan_whitespace, whitespace);
+        run("identifiers", scan_identifier, identifiers);
+        run("digits", scan_digits, digits);
+        run("strings", scan_string_body_dquote, strings);
+    }
+    return 0;
+}
@@ -1,102 +1,7 @@
 #include "scc.h"
 
-static type_t int_type = {
-	.kind = TYPE_INT,
-};
-static type_t unsigned_int_type = {
-	.kind = TYPE_UNSIGNED_INT,
-};
-static type_t long_type = {
-	.kind = TYPE_LONG,
-};
-static type_t unsigned_long_type = {
-	.kind = TYPE_UNSIGNED_LONG,
-};
-static type_t void_type = {
-	.kind = TYPE_VOID,
-};
-static type_t char_type = {
-	.kind = TYPE_CHAR,
-};
-static type_t unsigned_char_type = {
-	.kind = TYPE_UNSIGNED_CHAR,
-};
-
-static size_t type_size(type_t type) {
-	switch (type.kind) {
-		case TYPE_FUNC:
-		case TYPE_PTR:
-		case TYPE_LONG:
-		case TYPE_UNSIGNED_LONG:
-			return 8;
-		case TYPE_INT:
-		case TYPE_UNSIGNED_INT:
-			return 4;
-		case TYPE_CHAR:
-		case TYPE_UNSIGNED_CHAR:
-		case TYPE_VOID:
-			return 1;
-		case TYPE_ARRAY:
-			assert(false && "Size of array types should be explicitly handled since they might decay to pointers");
-			break;
-		default:
-			unreachable();
-	}
-}
-
-static bool type_is_primitive(type_t type) {
-	switch (type.kind) {
-		case TYPE_INT:
-		case TYPE_UNSIGNED_INT:
-		case TYPE_LONG:
-		case TYPE_UNSIGNED_LONG:
-		case TYPE_CHAR:
-		case TYPE_UNSIGNED_CHAR:
-		case TYPE_VOID:
-		case TYPE_ARRAY:
-		case TYPE_FUNC:
-		case TYPE_PTR:
-			return true;
-		default:
-			return false;
-	}
-}
-
-static bool type_is_intlike(type_t type) {
-	switch (type.kind) {
-	case TYPE_INT:
-	case TYPE_UNSIGNED_INT:
-	case TYPE_LONG:
-	case TYPE_UNSIGNED_LONG:
-	case TYPE_CHAR:
-	case TYPE_UNSIGNED_CHAR:
-		return true;
-	default:
-		return false;
-	}
-}
-
-static type_t type_ptr_to(type_t base_type) {
-	type_t pointer_type = {
-		.kind = TYPE_PTR,
-		.as.pointer.inner = heapify(type_t, &base_type),
-	};
-	return pointer_type;
-}
-
-static type_t type_deref(type_t pointer_type) {
-	switch (pointer_type.kind) {
-	case TYPE_PTR:
-		return *pointer_type.as.pointer.inner;
-	case TYPE_ARRAY:
-		return *pointer_type.as.array.inner;
-	default:
-		assert(false && "Can only deref pointer or array types");
-	}
-}
-
-static void type_print(type_t type) {
-	switch (type.kind) {
+static void type_print(const type_t *type) {
+	switch (type->kind) {
 	case TYPE_VARARGS:
 		fprintf(stderr, "...");
 		break;
@@ -122,1772 +27,903 @@ static void type_print(type_t type) {
 		fprintf(stderr, "unsigned char");
 		break;
 	case TYPE_FUNC: {
-		type_print(*type.as.func.return_type);
+		type_print(type->as.func.return_type);
 		fprintf(stderr, " (*)(");
-		for (size_t i = 0; i < type.as.func.parameter_types.length; i++) {
-			type_t *param_type = list_at(&type.as.func.parameter_types, type_t, i);
-			type_print(*param_type);
-			if (i < type.as.func.parameter_types.length - 1) {
+		for (size_t i = 0; i < type->as.func.parameter_count; i++) {
+			type_print(type->as.func.parameter_types[i]);
+			if (i < type->as.func.parameter_count - 1) {
 				fprintf(stderr, ", ");
 			}
 		}
 		fprintf(stderr, ")");
 	} break;
 	case TYPE_PTR:
-		type_print(*type.as.pointer.inner);
+		type_print(type->as.pointer.inner);
 		fprintf(stderr, "*");
 		break;
 	case TYPE_ARRAY:
-		type_print(*type.as.array.inner);
-		fprintf(stderr, "[");
-		if (!node_ref_is_null(type.as.array.size_expr_ref)) {
-			node_print(type.as.array.size_expr_ref);
-		}
-		fprintf(stderr, "]");
+		type_print(type->as.array.inner);
+		fprintf(stderr, "[]");
 		break;
 	}
 }
 
-static type_t type_array_of(type_t inner, node_ref_t size_expr_ref) {
-	type_t array_type = {
-		.kind = TYPE_ARRAY,
-		.as.array.inner = heapify(type_t, &inner),
-		.as.array.size_expr_ref = size_expr_ref,
-	};
-	return array_type;
-}
-
-static type_t type_from_var_decl(node_t *var_decl, bool is_param);
+static const type_t *type_from_var_decl(node_t *var_decl, bool is_param);
 
-static type_t type_from_node(node_t *node) {
-	switch (node->type) {
+static const type_t *type_from_node(node_ref_t node_ref) {
+	node_t node = node_ref_get(node_ref);
+	switch (node.type) {
 	case NODE_INT:
-		return node->as.type.is_signed
+		return node.as.type.is_signed
 			? int_type
 			: unsigned_int_type;
 	case NODE_LONG:
-		return node->as.type.is_signed
+		return node.as.type.is_signed
 			? long_type
 			: unsigned_long_type;
 	case NODE_VOID:
 		return void_type;
-	case NODE_PTR_TYPE: {
-		type_t base_type = type_from_node(node_ref_get(node->as.ptr_type.base_type_ref));
-		return type_ptr_to(base_type);
-	}
+	case NODE_PTR_TYPE:
+		return type_ptr_to(type_from_node(node.as.ptr_type.base_type_ref));
 	case NODE_CHAR: {
-		return node->as.type.is_signed
+		return node.as.type.is_signed
 			? char_type
 			: unsigned_char_type;
 	}
 	case NODE_FUNCTION_SIGNATURE: {
-		type_t return_type = type_from_node(node_ref_get(node->as.function_signature.return_type_ref));
-		list_t parameter_types = { .element_size = sizeof(type_t) };
-		for (size_t i = 0; i < node->as.function_signature.parameters.length; i++) {
-			node_ref_t *param_ref = list_at(&node->as.function_signature.parameters, node_ref_t, i);
-			node_t *param_node = node_ref_get(*param_ref);
-			type_t param_type;
-			if (param_node->as.var_decl.is_varargs) {
-				param_type.kind = TYPE_VARARGS;
-			} else {
-				param_type = type_from_var_decl(param_node, true);
-			}
-			list_push(&parameter_types, &param_type);
+		const type_t *return_type = type_from_node(node.as.function_signature.return_type_ref);
+		size_t parameter_count = node.as.function_signature.parameters.length;
+		const type_t *parameter_types[parameter_count + 1];
+		for (size_t i = 0; i < parameter_count; i++) {
+			node_t param_node = node_ref_get(node_list_at(node.as.function_signature.parameters, i));
+			parameter_types[i] = type_from_var_decl(&param_node, true);
 		}
-		type_t function_type = {
-			.kind = TYPE_FUNC,
-			.as.func = {
-				.return_type = heapify(type_t, &return_type),
-				.parameter_types = parameter_types,
-			},
-		};
-		return function_type;
+		return type_func(return_type, parameter_types, parameter_count);
 	}
 	default:
 		todo("Unhandled type conversion from node to type");
 	}
 }
 
-static type_t type_from_var_decl(node_t *var_decl, bool is_param) {
+static const type_t *type_from_var_decl(node_t *var_decl, bool is_param) {
 	assert(var_decl->type == NODE_VAR_DECL);
 
 	// TODO: We can handle array types here as well
 	if (var_decl->as.var_decl.is_varargs) {
-		return (type_t) {
-			.kind = TYPE_VARARGS
-		};
+		return varargs_type;
 	}
 	if (var_decl->as.var_decl.is_array && is_param) {
-		return type_ptr_to(type_from_node(node_ref_get(var_decl->as.var_decl.type_ref)));
-	}
-
-	return type_from_node(node_ref_get(var_decl->as.var_decl.type_ref));
-}
-
-typedef enum {
-	QBE_VAR_IDENTIFIER,
-	QBE_VAR_DATA,
-	QBE_VAR_TEMP,
-	QBE_VAR_PARAM,
-	QBE_VAR_FUNC,
-} qbe_var_type_t;
-
-typedef enum {
-	QBE_VALUE_VARARGS,
-	QBE_VALUE_VOID,
-	QBE_VALUE_WORD,
-	QBE_VALUE_UNSIGNED_WORD,
-	QBE_VALUE_SIGNED_BYTE,
-	QBE_VALUE_UNSIGNED_BYTE,
-	QBE_VALUE_LONG,
-	QBE_VALUE_UNSIGNED_LONG,
-	QBE_VALUE_SINGLE,
-} qbe_value_type_t;
-
-typedef struct {
-	bool global;
-	qbe_var_type_t var_type;
-	qbe_value_type_t value_type;
-	union {
-		struct {
-			char *name;
-			size_t scope_depth;
-		} identifier;
-		char *data;
-		char *param;
-		char *func;
-		size_t temp;
-	} as;
-} qbe_var_t;
-
-qbe_var_t ctx_null_var = {
-	.value_type = QBE_VALUE_VOID,
-};
-
-static qbe_value_type_t qbe_type_from_type(type_t type) {
-	switch (type.kind) {
-	case TYPE_VARARGS:
-		return QBE_VALUE_VARARGS;
-	case TYPE_INT:
-		return QBE_VALUE_WORD;
-	case TYPE_UNSIGNED_INT:
-		return QBE_VALUE_UNSIGNED_WORD;
-	case TYPE_LONG:
-		return QBE_VALUE_LONG;
-	case TYPE_UNSIGNED_LONG:
-		return QBE_VALUE_UNSIGNED_LONG;
-	case TYPE_CHAR:
-		return QBE_VALUE_SIGNED_BYTE;
-	case TYPE_UNSIGNED_CHAR:
-		return QBE_VALUE_UNSIGNED_BYTE;
-	case TYPE_VOID:
-		return QBE_VALUE_VOID;
-	case TYPE_FUNC:
-	case TYPE_ARRAY:
-	case TYPE_PTR:
-		return QBE_VALUE_LONG;
-	default:
-		todo("Unhandled type conversion from type to qbe type");
+		return type_ptr_to(type_from_node(var_decl->as.var_decl.type_ref));
 	}
-}
 
-static qbe_value_type_t qbe_basetype_from_type(type_t type) {
-	switch (type.kind) {
-	case TYPE_CHAR:
-	case TYPE_INT:
-		return QBE_VALUE_WORD;
-	case TYPE_UNSIGNED_CHAR:
-	case TYPE_UNSIGNED_INT:
-		return QBE_VALUE_UNSIGNED_WORD;
-	case TYPE_FUNC:
-	case TYPE_PTR:
-	case TYPE_ARRAY:
-		return QBE_VALUE_UNSIGNED_LONG;
-	case TYPE_LONG:
-		return QBE_VALUE_LONG;
-	case TYPE_UNSIGNED_LONG:
-		return QBE_VALUE_UNSIGNED_LONG;
-	case TYPE_VOID:
-		return QBE_VALUE_VOID;
-	default:
-		todo("Unhandled type conversion from type to qbe type");
-	}
-}
-
-// TODO: DEPRECATED?
-static size_t qbe_type_size(qbe_value_type_t value_type) {
-	switch (value_type) {
-		case QBE_VALUE_VOID:
-			return 0;
-		case QBE_VALUE_UNSIGNED_WORD:
-		case QBE_VALUE_WORD:
-			return 4;
-		case QBE_VALUE_UNSIGNED_BYTE:
-		case QBE_VALUE_SIGNED_BYTE:
-			return 1;
-		case QBE_VALUE_SINGLE:
-			return 4;
-		case QBE_VALUE_UNSIGNED_LONG:
-		case QBE_VALUE_LONG:
-			return 8;
-		default:
-			unreachable();
-	}
+	return type_from_node(var_decl->as.var_decl.type_ref);
 }
 
+// Every symbol in scope lives in one open addressing table keyed by name. A slot points at the
+// innermost symbol with that name and each entry remembers the symbol it shadows. The entries list
+// doubles as an undo log, leaving a scope pops the symbols it declared and restores what they shadowed.
+// Symbols themselves are never removed, they stay in the analysis for the passes that follow.
 typedef struct {
-	size_t label_num;
-} qbe_label_t;
-
-typedef struct {
-	unsigned char *data;
-	size_t size;
-} readonly_value_t;
+	name_t name;
+	symbol_id_t symbol;  // innermost symbol with this name, SYMBOL_NONE if none is in scope
+} symbol_slot_t;
 
 typedef struct {
-	qbe_label_t continue_label;
-	qbe_label_t break_label;
-} loop_t;
+	symbol_id_t symbol;
+	symbol_id_t shadowed;  // symbol this one shadows, or SYMBOL_NONE
+} symbol_entry_t;
 
 typedef struct {
-	FILE *out_file;
-	qbe_var_t result_var;
-	type_t result_type;
-	type_t function_return_type;
-	size_t next_label;
-	size_t next_temp;
-	list_t readonly_values;
-	list_t loop_stack;
-} codegen_ctx_t;
-
-static qbe_var_t ctx_new_temp(codegen_ctx_t *ctx, qbe_value_type_t value_type) {
-	qbe_var_t temp_var = {
-		.global = false,
-		.var_type = QBE_VAR_TEMP,
-		.value_type = value_type,
-		.as.temp = ctx->next_temp++,
+	list_t *symbols;       // symbol_t, owned by the analysis
+	list_t entries;        // symbol_entry_t, in declaration order
+	list_t scope_starts;   // size_t, length of entries when each open scope was entered
+	symbol_slot_t *slots;  // NAME_NONE marks an empty slot, names are never removed
+	size_t slot_count;     // always a power of two
+	size_t name_count;
+} symbol_table_t;
+
+static symbol_table_t symbol_table_new(list_t *symbols) {
+	return (symbol_table_t) {
+		.symbols = symbols,
+		.entries = { .element_size = sizeof(symbol_entry_t) },
+		.scope_starts = { .element_size = sizeof(size_t) },
 	};
-	return temp_var;
 }
 
-static qbe_var_t ctx_add_data(codegen_ctx_t *ctx, const void *data, size_t data_size) {
-	readonly_value_t readonly_value = {
-		.data = malloc(data_size),
-		.size = data_size,
-	};
-	memcpy(readonly_value.data, data, data_size);
-	list_push(&ctx->readonly_values, &readonly_value);
-
-	qbe_var_t data_var = {
-		.var_type = QBE_VAR_DATA,
-		.value_type = QBE_VALUE_LONG,
-		.as.data = malloc(32),
-	};
-	sprintf(data_var.as.data, PRIVATE_PREFIX"data_%zu", ctx->readonly_values.length - 1);
-	return data_var;
+static void symbol_table_free(symbol_table_t *symbols) {
+	list_clear(&symbols->entries);
+	list_clear(&symbols->scope_starts);
+	free(symbols->slots);
+	*symbols = symbol_table_new(symbols->symbols);
 }
 
-static qbe_label_t ctx_new_label(codegen_ctx_t *ctx) {
-	qbe_label_t label = {
-		.label_num = ctx->next_label++,
-	};
-	return label;
+static symbol_t *symbol_get(symbol_table_t *symbols, symbol_id_t symbol) {
+	return list_at(symbols->symbols, symbol_t, symbol);
 }
 
-static void qbe_write_type(codegen_ctx_t *ctx, qbe_value_type_t value_type) {
-	switch (value_type) {
-		case QBE_VALUE_VOID:
-		break;
-		case QBE_VALUE_VARARGS:
-			fprintf(ctx->out_file, "...");
-			break;
-		case QBE_VALUE_UNSIGNED_WORD:
-		case QBE_VALUE_WORD:
-			fprintf(ctx->out_file, "w ");
-			break;
-		case QBE_VALUE_UNSIGNED_LONG:
-		case QBE_VALUE_LONG:
-			fprintf(ctx->out_file, "l ");
-			break;
-		case QBE_VALUE_SINGLE:
-			fprintf(ctx->out_file, "s ");
-			break;
-		case QBE_VALUE_SIGNED_BYTE:
-			fprintf(ctx->out_file, "sb ");
-			break;
-		case QBE_VALUE_UNSIGNED_BYTE:
-			fprintf(ctx->out_file, "ub ");
-			break;
-		default:
-			unreachable();
-	}
+static size_t symbol_slot_start(symbol_table_t *symbols, name_t name) {
+	// Names are dense ids, spread them with a multiplicative hash
+	return (name * 2654435761u) & (symbols->slot_count - 1);
 }
 
-static void qbe_write_var(codegen_ctx_t *ctx, qbe_var_t var) {
-	if (var.global || var.var_type == QBE_VAR_DATA || var.var_type == QBE_VAR_FUNC) {
-		fprintf(ctx->out_file, "$");
-	} else {
-		fprintf(ctx->out_file, "%%");
-	}
-
-	switch (var.var_type) {
-		case QBE_VAR_IDENTIFIER:
-			if (!var.global) {
-				fprintf(ctx->out_file, "ident_%zu_", var.as.identifier.scope_depth);
-			}
-			fprintf(ctx->out_file, "%s", var.as.identifier.name);
-			break;
-		case QBE_VAR_TEMP:
-			assert(!var.global);
-			fprintf(ctx->out_file, "temp_%zu", var.as.temp);
-			break;
-		case QBE_VAR_PARAM:
-			assert(!var.global);
-			fprintf(ctx->out_file, "param_%s", var.as.param);
-			break;
-		case QBE_VAR_FUNC:
-			fprintf(ctx->out_file, "%s", var.as.func);
-			break;
-		case QBE_VAR_DATA:
-			fprintf(ctx->out_file, "%s", var.as.data);
-			break;
+// Slot holding name, or the empty slot it would be inserted into
+static symbol_slot_t *find_slot(symbol_table_t *symbols, name_t name) {
+	size_t slot = symbol_slot_start(symbols, name);
+	while (symbols->slots[slot].name != NAME_NONE && symbols->slots[slot].name != name) {
+		slot = (slot + 1) & (symbols->slot_count - 1);
 	}
+	return &symbols->slots[slot];
 }
 
-// TODO: Maybe just create a qbe_write_XXX_instr function for each instruction
-static void qbe_write_store_instr(codegen_ctx_t *ctx, qbe_value_type_t value_type) {
-	fprintf(ctx->out_file, "store");
-	switch (value_type) {
-		case QBE_VALUE_UNSIGNED_WORD:
-		case QBE_VALUE_WORD:
-			fprintf(ctx->out_file, "w ");
-			break;
-		case QBE_VALUE_UNSIGNED_LONG:
-		case QBE_VALUE_LONG:
-			fprintf(ctx->out_file, "l ");
-			break;
-		case QBE_VALUE_SINGLE:
-			fprintf(ctx->out_file, "s ");
-			break;
-		case QBE_VALUE_UNSIGNED_BYTE:
-		case QBE_VALUE_SIGNED_BYTE:
-			fprintf(ctx->out_file, "b ");
-			break;
-		default:
-			unreachable();
-	}
-}
+static void grow_slots(symbol_table_t *symbols) {
+	symbol_table_t grown = *symbols;
+	grown.slot_count = symbols->slot_count == 0 ? 64 : symbols->slot_count * 2;
+	grown.slots = calloc(grown.slot_count, sizeof(symbol_slot_t));
+	assert(grown.slots != NULL);
 
-static void qbe_write_ext_instr(codegen_ctx_t *ctx, type_t from_type) {
-	fprintf(ctx->out_file, "ext");
-
-	assert(type_is_primitive(from_type) && "Can only extend primitive types");
-	assert(qbe_type_size(qbe_type_from_type(from_type)) != 8 && "Cannot extend further than long");
-
-	switch (from_type.kind) {
-		case TYPE_VARARGS:
-		case TYPE_VOID:
-		case TYPE_FUNC:
-		case TYPE_LONG:
-		case TYPE_UNSIGNED_LONG:
-		case TYPE_ARRAY:
-		case TYPE_PTR:
-			unreachable();
-		case TYPE_CHAR:
-			fprintf(ctx->out_file, "sb ");
-			break;
-		case TYPE_UNSIGNED_CHAR:
-			fprintf(ctx->out_file, "ub ");
-			break;
-		case TYPE_INT:
-			fprintf(ctx->out_file, "sw ");
-			break;
-		case TYPE_UNSIGNED_INT:
-			fprintf(ctx->out_file, "uw ");
-			break;
+	for (size_t i = 0; i < symbols->slot_count; i++) {
+		if (symbols->slots[i].name != NAME_NONE) {
+			*find_slot(&grown, symbols->slots[i].name) = symbols->slots[i];
+		}
 	}
-}
 
-qbe_var_t qbe_var_from_symbol(symbol_t *symbol) {
-	qbe_var_t var = {
-		.global = symbol->global,
-		.var_type = QBE_VAR_IDENTIFIER,
-		.value_type = qbe_type_from_type(symbol->type),
-		.as.identifier = {
-			.name = symbol->name->as.identifier,
-			.scope_depth = symbol->scope_depth,
-		},
-	};
-	return var;
+	free(symbols->slots);
+	*symbols = grown;
 }
 
-static symbol_t *find_symbol(list_t symbol_map, sv_t name) {
-	for (size_t i = 0; i < symbol_map.length; i++) {
-		symbol_t *symbol = list_at(&symbol_map, symbol_t, i);
-		if (sv_eq(sv_from_cstr(symbol->name->as.identifier), name)) {
-			return symbol;
-		}
+static symbol_id_t find_symbol(symbol_table_t *symbols, name_t name) {
+	if (symbols->slot_count == 0) {
+		return SYMBOL_NONE;
 	}
-	return NULL;
+	return find_slot(symbols, name)->symbol;
 }
 
-static symbol_t *find_symbol_recursive(list_t *symbol_maps, sv_t name) {
-	for (ssize_t i = symbol_maps->length - 1; i >= 0; i--) {
-		list_t *symbol_map = list_at(symbol_maps, list_t, i);
-		symbol_t *symbol = find_symbol(*symbol_map, name);
-		if (symbol != NULL) {
-			return symbol;
-		}
-	}
-	return NULL;
+static void push_scope(symbol_table_t *symbols) {
+	size_t start = symbols->entries.length;
+	list_push(&symbols->scope_starts, &start);
 }
 
-static void push_map(list_t *symbol_maps) {
-	list_t symbol_map = { .element_size = sizeof(symbol_t) };
-	list_push(symbol_maps, &symbol_map);
-}
+static void pop_scope(symbol_table_t *symbols) {
+	assert(symbols->scope_starts.length > 0);
 
-static void pop_map(list_t *symbol_maps) {
-	assert(symbol_maps->length > 0);
+	size_t start = *list_at(&symbols->scope_starts, size_t, symbols->scope_starts.length - 1);
+	list_pop(&symbols->scope_starts);
 
-	list_t *symbol_map = list_at(symbol_maps, list_t, symbol_maps->length - 1);
-	list_clear(symbol_map);
-	symbol_maps->length--;
+	while (symbols->entries.length > start) {
+		symbol_entry_t *entry = list_at(&symbols->entries, symbol_entry_t, symbols->entries.length - 1);
+		find_slot(symbols, symbol_get(symbols, entry->symbol)->name)->symbol = entry->shadowed;
+		list_pop(&symbols->entries);
+	}
 }
 
-static void add_symbol(list_t *symbol_maps, symbol_t symbol) {
+static symbol_id_t add_symbol(symbol_table_t *symbols, symbol_t symbol) {
 	assert(symbol.scope_depth == 0 && "Scope depth should not be set manually.");
-	symbol.scope_depth = symbol_maps->length - 1;
-
-	assert(symbol_maps->length > 0);
-	list_t *current_map = list_at(symbol_maps, list_t, symbol_maps->length - 1);
+	assert(symbols->scope_starts.length > 0);
+	symbol.scope_depth = symbols->scope_starts.length - 1;
 
-	symbol_t *existing_symbol = find_symbol(*current_map, sv_from_cstr(symbol.name->as.identifier));
-	if (existing_symbol != NULL && existing_symbol->scope_depth >= symbol.scope_depth) {
-		report_error(symbol.name->source_loc, "Redefinition of '%s'", symbol.name->as.identifier);
+	// Keep the load factor below 1/2
+	if ((symbols->name_count + 1) * 2 > symbols->slot_count) {
+		grow_slots(symbols);
 	}
 
-	list_push(current_map, &symbol);
-}
-
-bool is_global_map(list_t *symbol_maps) {
-	return symbol_maps->length == 1;
-}
-
-static bool type_eq(type_t a, type_t b) {
-	if (a.kind != b.kind) {
-		return false;
-	}
-	if (a.kind == TYPE_ARRAY) {
-		// TODO: Should we check sizes here? Not sure since arrays decay to pointers
-		if (!type_eq(*a.as.array.inner, *b.as.array.inner)) {
-			return false;
-		}
+	symbol_slot_t *slot = find_slot(symbols, symbol.name);
+	if (slot->name == NAME_NONE) {
+		slot->name = symbol.name;
+		symbols->name_count++;
 	}
-	if (a.kind == TYPE_PTR) {
-		if (!type_eq(*a.as.pointer.inner, *b.as.pointer.inner)) {
-			return false;
-		}
-	}
-	if (a.kind == TYPE_FUNC) {
-		if (a.as.func.parameter_types.length != b.as.func.parameter_types.length) {
-			return false;
-		}
-		for (size_t i = 0; i < a.as.func.parameter_types.length; i++) {
-			type_t *a_param_type = list_at(&a.as.func.parameter_types, type_t, i);
-			type_t *b_param_type = list_at(&b.as.func.parameter_types, type_t, i);
-			if (!type_eq(*a_param_type, *b_param_type)) {
-				return false;
-			}
-		}
-		if (!type_eq(*a.as.func.return_type, *b.as.func.return_type)) {
-			return false;
+
+	if (slot->symbol != SYMBOL_NONE) {
+		symbol_t *existing_symbol = symbol_get(symbols, slot->symbol);
+		if (existing_symbol->scope_depth >= symbol.scope_depth) {
+			report_error(symbol.source_loc, "Redefinition of '%s'", name_cstr(symbol.name));
 		}
 	}
-	return true;
-}
 
-static qbe_value_type_t qbe_flip_signedness(qbe_value_type_t type) {
-	switch (type) {
-		case QBE_VALUE_WORD:
-			return QBE_VALUE_UNSIGNED_WORD;
-		case QBE_VALUE_UNSIGNED_WORD:
-			return QBE_VALUE_WORD;
-		case QBE_VALUE_SIGNED_BYTE:
-			return QBE_VALUE_UNSIGNED_BYTE;
-		case QBE_VALUE_UNSIGNED_BYTE:
-			return QBE_VALUE_SIGNED_BYTE;
-		case QBE_VALUE_LONG:
-			return QBE_VALUE_UNSIGNED_LONG;
-		case QBE_VALUE_UNSIGNED_LONG:
-			return QBE_VALUE_LONG;
-		default:
-			return type;
-	}
+	assert(symbols->symbols->length <= UINT32_MAX);
+	symbol_id_t id = (symbol_id_t)symbols->symbols->length;
+	list_push(symbols->symbols, &symbol);
+
+	symbol_entry_t entry = {
+		.symbol = id,
+		.shadowed = slot->symbol,
+	};
+	list_push(&symbols->entries, &entry);
+	slot->symbol = id;
+	return id;
 }
 
-static bool qbe_needs_cast_instruction(qbe_value_type_t from, qbe_value_type_t to) {
-	if (from == to) {
-		return false;
-	}
+static bool is_global_scope(symbol_table_t *symbols) {
+	return symbols->scope_starts.length == 1;
+}
 
-	// If types only differ in signedness, no instruction is needed
-	if (qbe_flip_signedness(from) == to) {
-		return false;
-	}
+typedef struct {
+	analysis_t *analysis;
+	symbol_table_t symbols;
+	const type_t *function_return_type;
+} analyze_ctx_t;
 
-	return true;
+static node_info_t *ctx_info(analyze_ctx_t *ctx, node_ref_t node_ref) {
+	assert(node_ref.index < ctx->analysis->info_count);
+	return &ctx->analysis->infos[node_ref.index];
 }
 
-static bool promote_value(codegen_ctx_t *ctx, qbe_var_t *var, type_t *var_type, type_t to_type) {
-	assert(type_is_primitive(*var_type) && type_is_primitive(to_type));
-
-	qbe_value_type_t from_qbe_type = qbe_basetype_from_type(*var_type);
-	qbe_value_type_t to_qbe_type = qbe_basetype_from_type(to_type);
+static const type_t *ctx_type(analyze_ctx_t *ctx, node_ref_t node_ref) {
+	return ctx_info(ctx, node_ref)->type;
+}
 
-	if (!qbe_needs_cast_instruction(from_qbe_type, to_qbe_type)) {
-		// No instructions needed to promote
-		*var_type = to_type;
-		return true;
+// Reports message unless node_ref designates an object, which is all codegen can take the
+// address of. Arrays and functions can't be stored to, so is_modified rejects them as well.
+static void expect_lvalue(analyze_ctx_t *ctx, node_ref_t node_ref, bool is_modified, const char *message) {
+	node_t node = node_ref_get(node_ref);
+	switch (node.type) {
+		case NODE_IDENTIFIER:
+		case NODE_DEREF:
+		case NODE_INDEX:
+			break;
+		default:
+			report_error(node.source_loc, "%s", message);
 	}
 
-	qbe_var_t result_var = ctx_new_temp(ctx, qbe_type_from_type(to_type));
-	fprintf(ctx->out_file, "    ");
-	qbe_write_var(ctx, result_var);
-	fprintf(ctx->out_file, " =");
-	qbe_write_type(ctx, qbe_basetype_from_type(to_type));
-	qbe_write_ext_instr(ctx, *var_type);
-	qbe_write_var(ctx, *var);
-	fprintf(ctx->out_file, "\n");
-
-	*var = result_var;
-	*var_type = to_type;
-	return true;
+	type_kind_t kind = ctx_type(ctx, node_ref)->kind;
+	if (is_modified && (kind == TYPE_ARRAY || kind == TYPE_FUNC)) {
+		report_error(node.source_loc, "Cannot modify an array or function");
+	}
 }
 
-static bool mult_by_ptr_size(codegen_ctx_t *ctx, qbe_var_t *var, type_t ptr_type) {
-	assert(ptr_type.kind == TYPE_PTR);
-
-	type_t base_type = *ptr_type.as.pointer.inner;
-
-	if (base_type.kind == TYPE_ARRAY) {
-		todo("How do we handle arrays here?");
+// Records the implicit conversion of the value of node_ref to to_type
+static bool implicit_cast(analyze_ctx_t *ctx, node_ref_t node_ref, const type_t *to_type) {
+	node_info_t *info = ctx_info(ctx, node_ref);
+	if (!type_is_primitive(info->type) || !type_is_primitive(to_type)) {
+		return false;
 	}
-	size_t elem_size = type_size(base_type);
-
-	qbe_var_t result_var = ctx_new_temp(ctx, qbe_type_from_type(ptr_type));
-	fprintf(ctx->out_file, "    ");
-	qbe_write_var(ctx, result_var);
-	fprintf(ctx->out_file, " =");
-	qbe_write_type(ctx, qbe_basetype_from_type(ptr_type));
-	fprintf(ctx->out_file, "mul ");
-	qbe_write_var(ctx, *var);
-	fprintf(ctx->out_file, ", %zu\n", elem_size);
-
-	*var = result_var;
+	info->converted_type = to_type;
 	return true;
 }
 
-// Promote right operand to pointer size so it can be added to a pointer of type left_type
-static bool promote_pointer(codegen_ctx_t *ctx, type_t left_type, qbe_var_t *right_var, type_t *right_type) {
-	assert(left_type.kind == TYPE_PTR);
-
-	// Promote right to pointer size
-	if (!promote_value(ctx, right_var, right_type, unsigned_long_type)) {
-		return false;
-	}
+// Offsets added to a pointer are widened to pointer size and scaled by the element size
+static void scale_pointer_offset(const type_t *pointer_type, node_info_t *offset) {
+	assert(pointer_type->kind == TYPE_PTR);
 
-	// Multiply right by pointer element size
-	if (!mult_by_ptr_size(ctx, right_var, left_type)) {
-		return false;
+	const type_t *base_type = pointer_type->as.pointer.inner;
+	if (base_type->kind == TYPE_ARRAY) {
+		todo("How do we handle arrays here?");
 	}
-
-	return true;
+	offset->converted_type = unsigned_long_type;
+	offset->scale = type_size(base_type);
 }
 
-static bool promote_vars(codegen_ctx_t *ctx, qbe_var_t *left_var, type_t *left_type, qbe_var_t *right_var, type_t *right_type) {
-	assert(type_is_primitive(*left_type) && type_is_primitive(*right_type));
+// Usual arithmetic conversions for the operands of a binary operation
+static void promote_operands(analyze_ctx_t *ctx, node_t *node) {
+	node_info_t *left = ctx_info(ctx, node->as.binop.left_ref);
+	node_info_t *right = ctx_info(ctx, node->as.binop.right_ref);
+	assert(type_is_primitive(left->type) && type_is_primitive(right->type));
 
-	if (left_type->kind == TYPE_ARRAY || right_type->kind == TYPE_ARRAY) {
+	if (left->type->kind == TYPE_ARRAY || right->type->kind == TYPE_ARRAY) {
 		todo("Handle array decay to pointers");
 	}
 
 	// Pointer arithmetic
-	if (left_type->kind == TYPE_PTR && right_type->kind != TYPE_PTR) {
-		return promote_pointer(ctx, *left_type, right_var, right_type);
+	if (left->type->kind == TYPE_PTR && right->type->kind != TYPE_PTR) {
+		scale_pointer_offset(left->type, right);
+		return;
 	}
-	if (right_type->kind == TYPE_PTR && left_type->kind != TYPE_PTR) {
-		return promote_pointer(ctx, *right_type, left_var, left_type);
+	if (right->type->kind == TYPE_PTR && left->type->kind != TYPE_PTR) {
+		scale_pointer_offset(right->type, left);
+		return;
 	}
 
 	// Promote to at least int
-	if (type_size(*left_type) < type_size(int_type)) {
-		if (!promote_value(ctx, left_var, left_type, int_type)) {
-			return false;
-		}
+	const type_t *left_type = left->type;
+	const type_t *right_type = right->type;
+	if (type_size(left_type) < type_size(int_type)) {
+		left_type = int_type;
 	}
-	if (type_size(*right_type) < type_size(int_type)) {
-		if (!promote_value(ctx, right_var, right_type, int_type)) {
-			return false;
-		}
+	if (type_size(right_type) < type_size(int_type)) {
+		right_type = int_type;
 	}
 
 	// Promote to the larger type if they differ
-	if (type_size(*left_type) > type_size(*right_type)) {
-		if (!promote_value(ctx, right_var, right_type, *left_type)) {
-			return false;
-		}
-	} else if (type_size(*right_type) > type_size(*left_type)) {
-		if (!promote_value(ctx, left_var, left_type, *right_type)) {
-			return false;
-		}
-	}
-
-	return true;
-}
-
-static size_t num_required_args(type_t func_type) {
-	for (size_t i = 0; i < func_type.as.func.parameter_types.length; i++) {
-		type_t *type = list_at(&func_type.as.func.parameter_types, type_t, i);
-		if (type->kind == TYPE_VARARGS) {
-			return i;
-		}
-	}
-	return func_type.as.func.parameter_types.length;
-}
-
-static bool decay_array(codegen_ctx_t *ctx, qbe_var_t *var, type_t *var_type, type_t to_type) {
-	(void)ctx;
-
-	// Array -> pointer
-	if (var_type->kind == TYPE_ARRAY && to_type.kind == TYPE_PTR) {
-		// TODO: Is the sentence below correct? int[][] is allowed to decay into int** no?
-		// Only allowed if they inner types are the same
-		if (!type_eq(type_deref(*var_type), type_deref(to_type))) {
-			return false;
-		}
-		var->value_type = qbe_type_from_type(to_type);
-		*var_type = to_type;
-		return true;
+	if (type_size(left_type) > type_size(right_type)) {
+		right_type = left_type;
+	} else if (type_size(right_type) > type_size(left_type)) {
+		left_type = right_type;
 	}
 
-	return false;
+	left->converted_type = left_type;
+	right->converted_type = right_type;
 }
 
-static bool demote_value(codegen_ctx_t *ctx, qbe_var_t *var, type_t *var_type, type_t to_type) {
-	(void)ctx;
-	(void)var;
-
-	assert(type_is_primitive(*var_type) && type_is_primitive(to_type));
-
-	qbe_value_type_t from_qbe_type = qbe_basetype_from_type(*var_type);
-	qbe_value_type_t to_qbe_type = qbe_basetype_from_type(to_type);
-
-	if (!qbe_needs_cast_instruction(from_qbe_type, to_qbe_type)) {
-		// No instructions needed to demote
-		*var_type = to_type;
-		return true;
+// Value of a constant operand as its parent uses it, after the implicit conversion
+static bool operand_constant(analyze_ctx_t *ctx, node_ref_t node_ref, int64_t *value) {
+	node_info_t *info = ctx_info(ctx, node_ref);
+	if (!info->is_constant || info->scale != 0 || !type_is_intlike(info->converted_type)) {
+		return false;
 	}
-
-	// LEFTOFF: Implement
-	unreachable();
-
-	// // Truncate value
-	// qbe_var_t result_var = ctx_new_temp(ctx, qbe_type_from_type(to_type));
-	// fprintf(ctx->out_file, "    ");
-	// qbe_write_var(ctx, result_var);
-	// fprintf(ctx->out_file, " =");
-	// qbe_write_type(ctx, to_qbe_type);
-	// fprintf(ctx->out_file, " trunc ");
-	// qbe_write_var(ctx, *var);
-	// fprintf(ctx->out_file, "\n");
-
-	// *var = result_var;
-	// *var_type = to_type;
-	// return true;
+	*value = type_wrap(info->converted_type, info->constant);
+	return true;
 }
 
-static bool implicit_cast(codegen_ctx_t *ctx, qbe_var_t *var, type_t *var_type, type_t to_type) {
-	// Array decay
-	if (decay_array(ctx, var, var_type, to_type)) {
-		return true;
+// Integer constant expressions are evaluated with the operands already converted to the type of
+// the operation, arithmetic is done on 64 bits and wrapped back to the result type afterwards.
+// Division by zero is left for runtime.
+static void fold_constant(analyze_ctx_t *ctx, node_ref_t node_ref, const node_t *node) {
+	node_info_t *info = ctx_info(ctx, node_ref);
+	if (!type_is_intlike(info->type)) {
+		return;
 	}
 
-	// Promotion
-	if (promote_value(ctx, var, var_type, to_type)) {
-		return true;
-	}
+	int64_t value, left, right;
+	switch (node->type) {
+		case NODE_INTLIT:
+			value = node->as.intlit;
+			break;
+		case NODE_CHARLIT:
+			value = node->as.charlit;
+			break;
+		case NODE_CAST:
+			if (!operand_constant(ctx, node->as.cast.expr_ref, &value)) {
+				return;
+			}
+			break;
+		case NODE_NEGATE:
+			if (!operand_constant(ctx, node->as.negate.expr_ref, &value)) {
+				return;
+			}
+			value = (int64_t)(0 - (uint64_t)value);
+			break;
+		case NODE_ADD:
+		case NODE_SUB:
+		case NODE_MULT:
+		case NODE_DIV:
+		case NODE_EQEQ:
+		case NODE_NEQ:
+		case NODE_GT:
+		case NODE_LT:
+		case NODE_LTE:
+		case NODE_ANDAND: {
+			if (!operand_constant(ctx, node->as.binop.left_ref, &left) || !operand_constant(ctx, node->as.binop.right_ref, &right)) {
+				return;
+			}
 
-	// Demotion
-	if (demote_value(ctx, var, var_type, to_type)) {
-		return true;
+			// Unsigned values are zero extended, so they compare and divide correctly as uint64_t
+			bool is_signed = type_is_signed(ctx_info(ctx, node->as.binop.left_ref)->converted_type);
+			switch (node->type) {
+				case NODE_ADD:
+					value = (int64_t)((uint64_t)left + (uint64_t)right);
+					break;
+				case NODE_SUB:
+					value = (int64_t)((uint64_t)left - (uint64_t)right);
+					break;
+				case NODE_MULT:
+					value = (int64_t)((uint64_t)left * (uint64_t)right);
+					break;
+				case NODE_DIV:
+					if (right == 0) {
+						return;
+					}
+					if (!is_signed) {
+						value = (int64_t)((uint64_t)left / (uint64_t)right);
+					} else if (right == -1) {
+						value = (int64_t)(0 - (uint64_t)left);
+					} else {
+						value = left / right;
+					}
+					break;
+				case NODE_EQEQ:
+					value = left == right;
+					break;
+				case NODE_NEQ:
+					value = left != right;
+					break;
+				case NODE_GT:
+					value = is_signed ? left > right : (uint64_t)left > (uint64_t)right;
+					break;
+				case NODE_LT:
+					value = is_signed ? left < right : (uint64_t)left < (uint64_t)right;
+					break;
+				case NODE_LTE:
+					value = is_signed ? left <= right : (uint64_t)left <= (uint64_t)right;
+					break;
+				case NODE_ANDAND:
+					value = left != 0 && right != 0;
+					break;
+				default:
+					unreachable();
+			}
+		} break;
+		default:
+			return;
 	}
 
-	return false;
+	info->constant = type_wrap(info->type, value);
+	info->is_constant = true;
 }
 
-// TODO: Refactor so this takes a pointer to qbe_var_t and type_t and modifies them in place instead of through ctx
-bool analyze_node(codegen_ctx_t *ctx, list_t *symbol_maps, node_ref_t node_ref, bool emit_lvalue, size_t scope_depth) {
-	node_t *node = node_ref_get(node_ref);
+static bool analyze_node(analyze_ctx_t *ctx, node_ref_t node_ref, size_t scope_depth) {
+	node_t node = node_ref_get(node_ref);
+	symbol_table_t *symbols = &ctx->symbols;
 	bool is_in_function_body = scope_depth > 0;
+	const type_t *type = void_type;
 
-	switch (node->type) {
+	switch (node.type) {
 		case NODE_BLOCK:
 			if (is_in_function_body) {
-				push_map(symbol_maps);
+				push_scope(symbols);
 			}
-			for (size_t i = 0; i < node->as.block.length; i++) {
-				node_ref_t *child_ref = list_at(&node->as.block, node_ref_t, i);
-				if (!analyze_node(ctx, symbol_maps, *child_ref, false, scope_depth + 1)) {
+			for (size_t i = 0; i < node.as.block.length; i++) {
+				node_ref_t child_ref = node_list_at(node.as.block, i);
+				if (!analyze_node(ctx, child_ref, scope_depth + 1)) {
 					return false;
 				}
 			}
 			if (is_in_function_body) {
-				pop_map(symbol_maps);
+				pop_scope(symbols);
 			}
-			return true;
+			break;
 		case NODE_VAR_DECL: {
-			type_t type = type_from_var_decl(node, false);
-			if (node->as.var_decl.is_array) {
-				if (node_ref_is_null(node->as.var_decl.array_size_expr_ref)) {
-					report_error(node->source_loc, "Array size must be specified for arrays declared on the stack");
+			type = type_from_var_decl(&node, false);
+			if (node.as.var_decl.is_array) {
+				if (node_ref_is_null(node.as.var_decl.array_size_expr_ref)) {
+					report_error(node.source_loc, "Array size must be specified for arrays declared on the stack");
 				}
-				type = type_array_of(type, node->as.var_decl.array_size_expr_ref);
+				type = type_array_of(type);
 			}
-			add_symbol(symbol_maps, (symbol_t) {
-				.name = node->as.var_decl.name,
+			ctx_info(ctx, node_ref)->symbol = add_symbol(symbols, (symbol_t) {
+				.name = node.as.var_decl.name,
+				.source_loc = node.as.var_decl.name_loc,
 				.type = type,
-				.global = is_global_map(symbol_maps),
+				.global = is_global_scope(symbols),
 			});
 
-			// TODO: Maybe have add_symbol return a ref_t to the symbol and then use qbe_var_from_symbol here instead
-			qbe_var_t var = (qbe_var_t) {
-				.global = is_global_map(symbol_maps),
-				.var_type = QBE_VAR_IDENTIFIER,
-				.value_type = qbe_type_from_type(type),
-				.as.identifier = {
-					.name = node->as.var_decl.name->as.identifier,
-					.scope_depth = scope_depth,
-				}
-			};
-
-			// Allocate stack space
-			qbe_var_t array_size_var;
-			if (type.kind == TYPE_ARRAY) {
-				if (!analyze_node(ctx, symbol_maps, node->as.var_decl.array_size_expr_ref, false, scope_depth)) {
+			if (type->kind == TYPE_ARRAY) {
+				if (!analyze_node(ctx, node.as.var_decl.array_size_expr_ref, scope_depth)) {
 					return false;
 				}
-				qbe_var_t elem_count_var = ctx->result_var;
-				type_t elem_count_type = ctx->result_type;
-				if (!promote_value(ctx, &elem_count_var, &elem_count_type, long_type)) {
+				if (!implicit_cast(ctx, node.as.var_decl.array_size_expr_ref, long_type)) {
 					return false;
 				}
 
-				// Multiply elem count by element size
-				qbe_var_t elem_size_var = ctx_new_temp(ctx, QBE_VALUE_LONG);
-				size_t elem_size = type_size(type_deref(type));
-				fprintf(ctx->out_file, "    ");
-				qbe_write_var(ctx, elem_size_var);
-				fprintf(ctx->out_file, " =l copy %zu\n", elem_size);
-
-				array_size_var = ctx_new_temp(ctx, QBE_VALUE_LONG);
-				fprintf(ctx->out_file, "    ");
-				qbe_write_var(ctx, array_size_var);
-				fprintf(ctx->out_file, " =l mul ");
-				qbe_write_var(ctx, elem_count_var);
-				fprintf(ctx->out_file, ", ");
-				qbe_write_var(ctx, elem_size_var);
-				fprintf(ctx->out_file, "\n");
-			}
-
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, var);
-
-			fprintf(ctx->out_file, " =l alloc4 ");
-			if (type.kind == TYPE_ARRAY) {
-				qbe_write_var(ctx, array_size_var);
-			} else {
-				fprintf(ctx->out_file, "%zu", type_size(type));
+				int64_t elem_count;
+				if (operand_constant(ctx, node.as.var_decl.array_size_expr_ref, &elem_count) && elem_count < 0) {
+					report_error(node_ref_get(node.as.var_decl.array_size_expr_ref).source_loc, "Array size must not be negative");
+				}
 			}
-			fprintf(ctx->out_file, "\n");
 
-			if (!node_ref_is_null(node->as.var_decl.init_expr_ref)) {
+			if (!node_ref_is_null(node.as.var_decl.init_expr_ref)) {
 				// TODO: Analyze init expression type compatibility
 
-				if (!analyze_node(ctx, symbol_maps, node->as.var_decl.init_expr_ref, false, scope_depth)) {
+				if (!analyze_node(ctx, node.as.var_decl.init_expr_ref, scope_depth)) {
 					return false;
 				}
-
-				// Promote/cast if needed
-				if (!implicit_cast(ctx, &ctx->result_var, &ctx->result_type, type)) {
+				if (!implicit_cast(ctx, node.as.var_decl.init_expr_ref, type)) {
 					return false;
 				}
-
-				fprintf(ctx->out_file, "    ");
-				qbe_write_store_instr(ctx, qbe_type_from_type(type));
-				qbe_write_var(ctx, ctx->result_var);
-				fprintf(ctx->out_file, ", ");
-				qbe_write_var(ctx, var);
-				fprintf(ctx->out_file, "\n");
 			}
 		} break;
-		case NODE_ASSIGNMENT: {
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.left_ref, true, scope_depth)) {
+		case NODE_ASSIGNMENT:
+			if (!analyze_node(ctx, node.as.binop.left_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t left_var = ctx->result_var;
-			type_t left_type = ctx->result_type;
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.right_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.binop.right_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t right_var = ctx->result_var;
-
-			fprintf(ctx->out_file, "    ");
-			qbe_write_store_instr(ctx, qbe_type_from_type(left_type));
-			qbe_write_var(ctx, right_var);
-			fprintf(ctx->out_file, ", ");
-			qbe_write_var(ctx, left_var);
-			fprintf(ctx->out_file, "\n");
-		} break;
+			expect_lvalue(ctx, node.as.binop.left_ref, true, "Cannot assign to an expression that is not an lvalue");
+			type = ctx_type(ctx, node.as.binop.left_ref);
+			break;
 		case NODE_ADD:
 		case NODE_SUB:
 		case NODE_MULT:
-		case NODE_DIV: {
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.left_ref, false, scope_depth)) {
-				return false;
-			}
-			qbe_var_t left_var = ctx->result_var;
-			type_t left_type = ctx->result_type;
-
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.right_ref, false, scope_depth)) {
+		case NODE_DIV:
+			if (!analyze_node(ctx, node.as.binop.left_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t right_var = ctx->result_var;
-			type_t right_type = ctx->result_type;
-
-			if (!promote_vars(ctx, &left_var, &left_type, &right_var, &right_type)) {
+			if (!analyze_node(ctx, node.as.binop.right_ref, scope_depth)) {
 				return false;
 			}
+			promote_operands(ctx, &node);
 
 			// TODO: Ensure stuff like pointer + pointer is not allowed here
 			// Also, for pointer + int, ensure result type is pointer
-
-			qbe_var_t result_var = ctx_new_temp(ctx, qbe_type_from_type(left_type));
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, result_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, qbe_type_from_type(left_type));
-			switch (node->type) {
-				case NODE_ADD:
-					fprintf(ctx->out_file, "add ");
-					break;
-				case NODE_SUB:
-					fprintf(ctx->out_file, "sub ");
-					break;
-				case NODE_MULT:
-					fprintf(ctx->out_file, "mul ");
-					break;
-				case NODE_DIV:
-					fprintf(ctx->out_file, "div ");
-					break;
-				default:
-					unreachable();
-			}
-			qbe_write_var(ctx, left_var);
-			fprintf(ctx->out_file, ", ");
-			qbe_write_var(ctx, right_var);
-			fprintf(ctx->out_file, "\n");
-
-			ctx->result_var = result_var;
-			ctx->result_type = left_type;
-		} break;
+			type = ctx_info(ctx, node.as.binop.left_ref)->converted_type;
+			break;
 		case NODE_INTLIT:
-			ctx->result_var = ctx_new_temp(ctx, QBE_VALUE_WORD);
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, ctx->result_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, QBE_VALUE_WORD);
-			fprintf(ctx->out_file, "copy %d\n", node->as.intlit.as.intlit);
-			ctx->result_type = int_type;
-			return true;
+			type = int_type;
+			break;
 		case NODE_IDENTIFIER: {
-			symbol_t *symbol = find_symbol_recursive(symbol_maps, sv_from_cstr(node->as.identifier.as.identifier));
-			if (!symbol) {
-				report_error(node->source_loc, "Undeclared identifier: '%s'", node->as.identifier.as.identifier);
-			}
-
-			type_t type = symbol->type;
-
-			// Always emit pointer for functions, never implicitly dereference them
-			if (type.kind == TYPE_FUNC) {
-				emit_lvalue = true;
-			}
-
-			// For local arrays, if you reference them, you should get a pointer to the first element.
-			if (type.kind == TYPE_ARRAY) {
-				emit_lvalue = true;
-			}
-
-			qbe_var_t var = qbe_var_from_symbol(symbol);
-
-			if (emit_lvalue) {
-				// Just return the address
-				ctx->result_var = var;
-				ctx->result_type = type;
-			} else {
-				// Deref
-				qbe_var_t temp = ctx_new_temp(ctx, qbe_type_from_type(type));
-				fprintf(ctx->out_file, "    ");
-				qbe_write_var(ctx, temp);
-				fprintf(ctx->out_file, " =");
-				qbe_write_type(ctx, qbe_basetype_from_type(type));
-				fprintf(ctx->out_file, "load");
-				qbe_write_type(ctx, qbe_type_from_type(type));
-				qbe_write_var(ctx, var);
-				fprintf(ctx->out_file, "\n");
-
-				ctx->result_var = temp;
-				ctx->result_type = type;
+			symbol_id_t symbol = find_symbol(symbols, node.as.identifier);
+			if (symbol == SYMBOL_NONE) {
+				report_error(node.source_loc, "Undeclared identifier: '%s'", name_cstr(node.as.identifier));
 			}
+			ctx_info(ctx, node_ref)->symbol = symbol;
+			type = symbol_get(symbols, symbol)->type;
 		} break;
 		case NODE_FUNCTION: {
-			node_t *signature_node = node_ref_get(node->as.function.signature_ref);
-			node_t *return_type_node = node_ref_get(signature_node->as.function_signature.return_type_ref);
-			ctx->function_return_type = type_from_node(return_type_node);
+			node_t signature_node = node_ref_get(node.as.function.signature_ref);
+			type = type_from_node(node.as.function.signature_ref);
+			ctx->function_return_type = type->as.func.return_type;
 
-			assert(is_global_map(symbol_maps) && "Functions can only be declared in the global scope");
+			assert(is_global_scope(symbols) && "Functions can only be declared in the global scope");
 
-			bool is_forward_decl = node_ref_is_null(node->as.function.body_ref);
+			bool is_forward_decl = node_ref_is_null(node.as.function.body_ref);
+			symbol_id_t symbol;
 			if (is_forward_decl) {
-				add_symbol(symbol_maps, (symbol_t) {
-					.name = signature_node->as.function_signature.name,
-					.type = type_from_node(node_ref_get(node->as.function.signature_ref)),
+				symbol = add_symbol(symbols, (symbol_t) {
+					.name = signature_node.as.function_signature.name,
+					.source_loc = signature_node.as.function_signature.name_loc,
+					.type = type,
 					.global = true,
 					.is_forward_decl = true,
 				});
 			} else {
-				symbol_t *existing_symbol = find_symbol_recursive(symbol_maps, sv_from_cstr(signature_node->as.function_signature.name->as.identifier));
-				if (existing_symbol != NULL) {
-					if (!existing_symbol->is_forward_decl) {
+				symbol = find_symbol(symbols, signature_node.as.function_signature.name);
+				if (symbol != SYMBOL_NONE) {
+					if (!symbol_get(symbols, symbol)->is_forward_decl) {
 						todo("Report redeclaration error for function");
 					}
 				} else {
-					add_symbol(symbol_maps, (symbol_t) {
-						.name = signature_node->as.function_signature.name,
-						.type = type_from_node(node_ref_get(node->as.function.signature_ref)),
+					symbol = add_symbol(symbols, (symbol_t) {
+						.name = signature_node.as.function_signature.name,
+						.type = type,
 						.global = true,
 						.is_forward_decl = false,
 					});
 				}
 			}
+			ctx_info(ctx, node_ref)->symbol = symbol;
 
 			if (is_forward_decl) {
 				// Declaration only
-				return true;
+				break;
 			}
 
-			fprintf(ctx->out_file, "export function ");
-			qbe_write_type(ctx, qbe_type_from_type(ctx->function_return_type));
-			// TODO: Use qbe_var_from_symbol here
-			qbe_write_var(ctx, (qbe_var_t) {
-				.global = true,
-				.var_type = QBE_VAR_FUNC,
-				.as.func = signature_node->as.function_signature.name->as.identifier,
-			});
-
-			push_map(symbol_maps);
-
-			// Write signature and add symbols for parameters
-			fprintf(ctx->out_file, "(");
-			for (size_t i = 0; i < signature_node->as.function_signature.parameters.length; i++) {
-				node_ref_t *param_ref = list_at(&signature_node->as.function_signature.parameters, node_ref_t, i);
-				node_t *param_node = node_ref_get(*param_ref);
-				type_t param_type = type_from_var_decl(param_node, true);
+			push_scope(symbols);
 
-				if (i > 0) {
-					fprintf(ctx->out_file, ", ");
-				}
-				qbe_write_type(ctx, qbe_type_from_type(param_type));
-				if (param_type.kind != TYPE_VARARGS) {
-					qbe_write_var(ctx, (qbe_var_t) {
-						.global = false,
-						.var_type = QBE_VAR_PARAM,
-						.as.param = param_node->as.var_decl.name->as.identifier,
-					});
+			// Add symbols for parameters
+			for (size_t i = 0; i < signature_node.as.function_signature.parameters.length; i++) {
+				node_ref_t param_ref = node_list_at(signature_node.as.function_signature.parameters, i);
+				node_t param_node = node_ref_get(param_ref);
+				node_info_t *param_info = ctx_info(ctx, param_ref);
+				param_info->type = param_info->converted_type = type->as.func.parameter_types[i];
 
-					add_symbol(symbol_maps, (symbol_t) {
-						.name = param_node->as.var_decl.name,
-						.type = param_type,
+				if (param_info->type->kind != TYPE_VARARGS) {
+					param_info->symbol = add_symbol(symbols, (symbol_t) {
+						.name = param_node.as.var_decl.name,
+						.source_loc = param_node.as.var_decl.name_loc,
+						.type = param_info->type,
 						.global = false,
 					});
 				}
 			}
-			fprintf(ctx->out_file, ")\n{\n");
-			fprintf(ctx->out_file, "@start\n");
-
-			// Copy parameters to stack
-			for (size_t i = 0; i < signature_node->as.function_signature.parameters.length; i++) {
-				node_ref_t *param_ref = list_at(&signature_node->as.function_signature.parameters, node_ref_t, i);
-				node_t *param_node = node_ref_get(*param_ref);
-				type_t param_type = type_from_var_decl(param_node, true);
-
-				if (param_type.kind == TYPE_VARARGS) {
-					// LEFTOFF
-					// TODO: Do we need to copy varargs to stack or something?
-				} else {
-					qbe_var_t param_var = (qbe_var_t) {
-						.global = false,
-						.var_type = QBE_VAR_IDENTIFIER,
-						.value_type = qbe_type_from_type(param_type),
-						.as.identifier = {
-							.name = param_node->as.var_decl.name->as.identifier,
-							.scope_depth = scope_depth + 1,
-						},
-					};
-					qbe_var_t param_input_var = (qbe_var_t) {
-						.global = false,
-						.var_type = QBE_VAR_PARAM,
-						.value_type = qbe_type_from_type(param_type),
-						.as.param = param_node->as.var_decl.name->as.identifier,
-					};
-	
-					fprintf(ctx->out_file, "    ");
-					qbe_write_var(ctx, param_var);
-					fprintf(ctx->out_file, " =l alloc4 %zu\n", type_size(param_type));
-					fprintf(ctx->out_file, "    ");
-					qbe_write_store_instr(ctx, qbe_basetype_from_type(param_type));
-					qbe_write_var(ctx, param_input_var);
-					fprintf(ctx->out_file, ", ");
-					qbe_write_var(ctx, param_var);
-					fprintf(ctx->out_file, "\n");
-				}
-			}
 
 			// Body, we don't increment scope_depth because the block node does that already
-			if (node_ref_get(node->as.function.body_ref)->type != NODE_BLOCK) {
-				report_error(node->source_loc, "Function body must be a block");
+			if (node_ref_type(node.as.function.body_ref) != NODE_BLOCK) {
+				report_error(node.source_loc, "Function body must be a block");
 			}
-			if (!analyze_node(ctx, symbol_maps, node->as.function.body_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.function.body_ref, scope_depth)) {
 				return false;
 			}
-			fprintf(ctx->out_file, "@end\n");
-			if (type_eq(ctx->function_return_type, void_type)) {
-				fprintf(ctx->out_file, "    ret\n");
-			} else {
-				fprintf(ctx->out_file, "    ret %%result\n");
-			}
-			fprintf(ctx->out_file, "}\n");
 
-			pop_map(symbol_maps);
+			pop_scope(symbols);
 		} break;
 		case NODE_RETURN: {
-			type_t expr_type = void_type;
-			if (!node_ref_is_null(node->as.ret.expr_ref)) {
-				if (!analyze_node(ctx, symbol_maps, node->as.ret.expr_ref, false, scope_depth)) {
+			const type_t *expr_type = void_type;
+			if (!node_ref_is_null(node.as.ret.expr_ref)) {
+				if (!analyze_node(ctx, node.as.ret.expr_ref, scope_depth)) {
 					return false;
 				}
-				expr_type = ctx->result_type;
+				expr_type = ctx_type(ctx, node.as.ret.expr_ref);
 			}
 
 			// TODO: Implicit casting should be handled somewhere, probably not here though
-			if (!type_eq(ctx->function_return_type, expr_type)) {
+			if (ctx->function_return_type != expr_type) {
 				todo("Report return type mismatch error");
 			}
-
-			// Write return value to %result
-			if (!type_eq(expr_type, void_type)) {
-				fprintf(ctx->out_file, "    %%result =");
-				qbe_write_type(ctx, qbe_type_from_type(expr_type));
-				fprintf(ctx->out_file, "copy ");
-				qbe_write_var(ctx, ctx->result_var);
-				fprintf(ctx->out_file, "\n");
-			}
-			fprintf(ctx->out_file, "@unused_%zu\n", ctx->next_label++);  // TODO: This is a hack because every block can only end with 1 jump, we add a label to jumps to ensure there's only 1 jump per block.
-			fprintf(ctx->out_file, "    jmp @end\n");
-			fprintf(ctx->out_file, "@unused_%zu\n", ctx->next_label++);  // TODO: This is a hack because every block can only end with 1 jump, we add a label to jumps to ensure there's only 1 jump per block.
 		} break;
-		case NODE_CAST: {
-			if (!analyze_node(ctx, symbol_maps, node->as.cast.expr_ref, false, scope_depth)) {
+		case NODE_CAST:
+			if (!analyze_node(ctx, node.as.cast.expr_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t expr_var = ctx->result_var;
-			type_t expr_type = ctx->result_type;
-
-			type_t target_type = type_from_node(node_ref_get(node->as.cast.target_type_ref));
-			qbe_value_type_t target_qbe_type = qbe_type_from_type(target_type);
 
 			// TODO: Ensure expr_type can be cast to target_type
-
-			qbe_var_t result_var = ctx_new_temp(ctx, target_qbe_type);
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, result_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, target_qbe_type);
-			// If the cast is unnecessary, just copy instead of casting
-			if (qbe_type_from_type(target_type) == qbe_type_from_type(expr_type)) {
-				fprintf(ctx->out_file, "copy ");
-			} else {
-				fprintf(ctx->out_file, "cast ");
-			}
-			qbe_write_var(ctx, expr_var);
-			fprintf(ctx->out_file, "\n");
-
-			ctx->result_var = result_var;
-			ctx->result_type = target_type;
-		} break;
-		case NODE_ADDRESS_OF: {
-			if (!analyze_node(ctx, symbol_maps, node->as.address_of.expr_ref, true, scope_depth)) {
+			type = type_from_node(node.as.cast.target_type_ref);
+			break;
+		case NODE_ADDRESS_OF:
+			if (!analyze_node(ctx, node.as.address_of.expr_ref, scope_depth)) {
 				return false;
 			}
+			expect_lvalue(ctx, node.as.address_of.expr_ref, false, "Cannot take the address of an expression that is not an lvalue");
+			type = type_ptr_to(ctx_type(ctx, node.as.address_of.expr_ref));
 
-			ctx->result_type = type_ptr_to(ctx->result_type);
-		} break;
+			// Locals whose address is never taken can be kept in temps by codegen
+			if (node_ref_type(node.as.address_of.expr_ref) == NODE_IDENTIFIER) {
+				symbol_get(symbols, ctx_info(ctx, node.as.address_of.expr_ref)->symbol)->address_taken = true;
+			}
+			break;
 		case NODE_DEREF: {
-			if (!analyze_node(ctx, symbol_maps, node->as.deref.expr_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.deref.expr_ref, scope_depth)) {
 				return false;
 			}
 
-			if (emit_lvalue) {
-				// Don't dereference if we want the lvalue
-				return true;
+			const type_t *pointer_type = ctx_type(ctx, node.as.deref.expr_ref);
+			if (pointer_type->kind != TYPE_PTR) {
+				report_error(node.source_loc, "Cannot dereference non-pointer type");
 			}
-
-			qbe_var_t ptr_var = ctx->result_var;
-			qbe_value_type_t result_type = qbe_type_from_type(ctx->result_type);
-
-			qbe_var_t result_var = ctx_new_temp(ctx, result_type);
-
-			ctx->result_var = result_var;
-			if (ctx->result_type.kind != TYPE_PTR) {
-				report_error(node->source_loc, "Cannot dereference non-pointer type");
-			}
-			ctx->result_type = *ctx->result_type.as.pointer.inner;
-
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, result_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, qbe_basetype_from_type(ctx->result_type));
-			fprintf(ctx->out_file, "load");
-			qbe_write_type(ctx, result_type);
-			qbe_write_var(ctx, ptr_var);
-			fprintf(ctx->out_file, "\n");
+			type = pointer_type->as.pointer.inner;
 		} break;
 		case NODE_NEQ: {
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.left_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.binop.left_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t left_var = ctx->result_var;
-			type_t left_type = ctx->result_type;
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.right_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.binop.right_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t right_var = ctx->result_var;
-			type_t right_type = ctx->result_type;
 
-			if (!type_eq(left_type, right_type) || !type_is_primitive(left_type)) {
+			const type_t *left_type = ctx_type(ctx, node.as.binop.left_ref);
+			if (left_type != ctx_type(ctx, node.as.binop.right_ref) || !type_is_primitive(left_type)) {
 				todo("Type mismatch in NEQ operation");
 			}
-
-			qbe_var_t result_var = ctx_new_temp(ctx, QBE_VALUE_WORD);
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, result_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, QBE_VALUE_WORD);
-			fprintf(ctx->out_file, "cne");
-			qbe_write_type(ctx, qbe_type_from_type(left_type));
-			qbe_write_var(ctx, left_var);
-			fprintf(ctx->out_file, ", ");
-			qbe_write_var(ctx, right_var);
-			fprintf(ctx->out_file, "\n");
-
-			ctx->result_var = result_var;
-			ctx->result_type = int_type;
+			type = int_type;
 		} break;
-		case NODE_IF: {
+		case NODE_IF:
 			// TODO/NOTE: We dont increment scope_depth for ifs because a block would do it for us, the reason is that "a dependent statement may not be a declaration", so if the body is a single statement and not a block and its a decl, its invalid
 
-			if (!analyze_node(ctx, symbol_maps, node->as.if_.expr_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.if_.expr_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t cond_var = ctx->result_var;
-
-			qbe_label_t then_label = ctx_new_label(ctx);
-			qbe_label_t end_label = ctx_new_label(ctx);
-
-			// TODO: Clean this up
-			if (node_ref_is_null(node->as.if_.else_ref)) {
-				fprintf(ctx->out_file, "@unused_%zu\n", ctx->next_label++);  // TODO: This is a hack because every block can only end with 1 jump, we add a label to jumps to ensure there's only 1 jump per block.
-				fprintf(ctx->out_file, "    jnz ");
-				qbe_write_var(ctx, cond_var);
-				fprintf(ctx->out_file, ", @label_%zu, @label_%zu\n", then_label.label_num, end_label.label_num);  // TODO: Create some qbe_write_label function
-				fprintf(ctx->out_file, "@label_%zu\n", then_label.label_num);
-				if (!analyze_node(ctx, symbol_maps, node->as.if_.then_ref, false, scope_depth)) {
-					return false;
-				}
-				fprintf(ctx->out_file, "@unused_%zu\n", ctx->next_label++);  // TODO: This is a hack because every block can only end with 1 jump, we add a label to jumps to ensure there's only 1 jump per block.
-				fprintf(ctx->out_file, "    jmp @label_%zu\n", end_label.label_num);
-				fprintf(ctx->out_file, "@label_%zu\n", end_label.label_num);
-			} else {
-				qbe_label_t else_label = ctx_new_label(ctx);
-
-				fprintf(ctx->out_file, "@unused_%zu\n", ctx->next_label++);  // TODO: This is a hack because every block can only end with 1 jump, we add a label to jumps to ensure there's only 1 jump per block.
-				fprintf(ctx->out_file, "    jnz ");
-				qbe_write_var(ctx, cond_var);
-				fprintf(ctx->out_file, ", @label_%zu, @label_%zu\n", then_label.label_num, else_label.label_num);  // TODO: Create some qbe_write_label function
-				fprintf(ctx->out_file, "@label_%zu\n", then_label.label_num);
-				if (!analyze_node(ctx, symbol_maps, node->as.if_.then_ref, false, scope_depth)) {
-					return false;
-				}
-				fprintf(ctx->out_file, "@unused_%zu\n", ctx->next_label++);  // TODO: This is a hack because every block can only end with 1 jump, we add a label to jumps to ensure there's only 1 jump per block.
-				fprintf(ctx->out_file, "    jmp @label_%zu\n", end_label.label_num);
-				fprintf(ctx->out_file, "@label_%zu\n", else_label.label_num);
-				if (!analyze_node(ctx, symbol_maps, node->as.if_.else_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.if_.then_ref, scope_depth)) {
+				return false;
+			}
+			if (!node_ref_is_null(node.as.if_.else_ref)) {
+				if (!analyze_node(ctx, node.as.if_.else_ref, scope_depth)) {
 					return false;
 				}
-				fprintf(ctx->out_file, "@label_%zu\n", end_label.label_num);
 			}
-		} break;
-		case NODE_FILE: {
-			for (size_t i = 0; i < node->as.file.top_levels.length; i++) {
-				node_ref_t *child_ref = list_at(&node->as.file.top_levels, node_ref_t, i);
-				if (!analyze_node(ctx, symbol_maps, *child_ref, false, scope_depth)) {
+			break;
+		case NODE_FILE:
+			for (size_t i = 0; i < node.as.file.top_levels.length; i++) {
+				node_ref_t child_ref = node_list_at(node.as.file.top_levels, i);
+				if (!analyze_node(ctx, child_ref, scope_depth)) {
 					return false;
 				}
 			}
-		} break;
+			break;
 		case NODE_CALL: {
-			// Analyze arguments
-			list_t arg_vars = { .element_size = sizeof(qbe_var_t) };
-			list_t provided_arg_types = { .element_size = sizeof(type_t) };
-			for (size_t i = 0; i < node->as.call.arg_refs.length; i++) {
-				node_ref_t *arg_ref = list_at(&node->as.call.arg_refs, node_ref_t, i);
-				if (!analyze_node(ctx, symbol_maps, *arg_ref, false, scope_depth)) {
+			for (size_t i = 0; i < node.as.call.arg_refs.length; i++) {
+				node_ref_t arg_ref = node_list_at(node.as.call.arg_refs, i);
+				if (!analyze_node(ctx, arg_ref, scope_depth)) {
 					return false;
 				}
-				list_push(&arg_vars, &ctx->result_var);
-				list_push(&provided_arg_types, &ctx->result_type);
 			}
 
-			if (!analyze_node(ctx, symbol_maps, node->as.call.function_ref, true, scope_depth)) {
+			if (!analyze_node(ctx, node.as.call.function_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t function_var = ctx->result_var;
-			type_t function_type = ctx->result_type;
+			const type_t *function_type = ctx_type(ctx, node.as.call.function_ref);
 
-			if (function_type.kind != TYPE_FUNC) {
-				report_error(node->source_loc, "Attempted to call a non-function value");
+			if (function_type->kind != TYPE_FUNC) {
+				report_error(node.source_loc, "Attempted to call a non-function value");
 			}
 
-			type_t return_type = *function_type.as.func.return_type;
-
 			// Check argument types
-			if (provided_arg_types.length < num_required_args(function_type)) {
-				report_error(node->source_loc, "Function required at least %zu arguments but only %zu were provided", num_required_args(function_type), provided_arg_types.length);
-			}
-			for (size_t i = 0; i < num_required_args(function_type); i++) {
-				type_t *expected_type = list_at(&function_type.as.func.parameter_types, type_t, i);
-				type_t *actual_type = list_at(&provided_arg_types, type_t, i);
-				if (!type_eq(*expected_type, *actual_type)) {
+			size_t required_count = function_type->as.func.required_count;
+			if (node.as.call.arg_refs.length < required_count) {
+				report_error(node.source_loc, "Function required at least %zu arguments but only %zu were provided", required_count, (size_t)node.as.call.arg_refs.length);
+			}
+			for (size_t i = 0; i < required_count; i++) {
+				node_ref_t arg_ref = node_list_at(node.as.call.arg_refs, i);
+				const type_t *expected_type = function_type->as.func.parameter_types[i];
+				const type_t *actual_type = ctx_type(ctx, arg_ref);
+				if (expected_type != actual_type) {
 					// Try to implicitly cast
-					if (implicit_cast(ctx, list_at(&arg_vars, qbe_var_t, i), actual_type, *expected_type)) {
+					if (implicit_cast(ctx, arg_ref, expected_type)) {
 						continue;
 					}
 
-					report_start(node->source_loc, "Function argument type mismatch for argument at index %zu\n", i);
+					report_start(node.source_loc, "Function argument type mismatch for argument at index %zu\n", i);
 					report_line("    Expected type: ");
-					type_print(*expected_type);
+					type_print(expected_type);
 					fprintf(stderr, "\n");
 					report_line("    Provided type: ");
-					type_print(*actual_type);
+					type_print(actual_type);
 					fprintf(stderr, "\n");
 					report_end();
 				}
 			}
 
-			qbe_value_type_t return_qbe_type = qbe_type_from_type(return_type);
-			qbe_var_t result_var = ctx_new_temp(ctx, return_qbe_type);
-
-			fprintf(ctx->out_file, "    ");
-			if (return_qbe_type != QBE_VALUE_VOID) {
-				qbe_write_var(ctx, result_var);
-				fprintf(ctx->out_file, " =");
-			}
-			qbe_write_type(ctx, return_qbe_type);
-			fprintf(ctx->out_file, "call ");
-			qbe_write_var(ctx, function_var);
-			fprintf(ctx->out_file, "(");
-			for (size_t i = 0; i < arg_vars.length; i++) {
-				if (i > 0) {
-					fprintf(ctx->out_file, ", ");
-				}
-				qbe_var_t *arg_var = list_at(&arg_vars, qbe_var_t, i);
-				qbe_write_type(ctx, arg_var->value_type);
-				qbe_write_var(ctx, *arg_var);
-			}
-			fprintf(ctx->out_file, ")\n");
-
-			ctx->result_var = result_var;
-			ctx->result_type = return_type;
+			type = function_type->as.func.return_type;
 		} break;
-		case NODE_EQEQ: {
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.left_ref, false, scope_depth)) {
-				return false;
-			}
-			qbe_var_t left_var = ctx->result_var;
-			type_t left_type = ctx->result_type;
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.right_ref, false, scope_depth)) {
+		case NODE_EQEQ:
+			if (!analyze_node(ctx, node.as.binop.left_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t right_var = ctx->result_var;
-			type_t right_type = ctx->result_type;
-
-			if (!promote_vars(ctx, &left_var, &left_type, &right_var, &right_type)) {
+			if (!analyze_node(ctx, node.as.binop.right_ref, scope_depth)) {
 				return false;
 			}
-			if (!type_eq(left_type, right_type)) {
+			promote_operands(ctx, &node);
+			if (ctx_info(ctx, node.as.binop.left_ref)->converted_type != ctx_info(ctx, node.as.binop.right_ref)->converted_type) {
 				unreachable();
 			}
-
-			qbe_var_t result_var = ctx_new_temp(ctx, QBE_VALUE_WORD);
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, result_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, QBE_VALUE_WORD);
-			fprintf(ctx->out_file, "ceq");
-			qbe_write_type(ctx, qbe_type_from_type(left_type));
-			qbe_write_var(ctx, left_var);
-			fprintf(ctx->out_file, ", ");
-			qbe_write_var(ctx, right_var);
-			fprintf(ctx->out_file, "\n");
-
-			ctx->result_var = result_var;
-			ctx->result_type = int_type;
-		} break;
-		case NODE_DISCARD: {
-			if (!analyze_node(ctx, symbol_maps, node->as.discard.expr_ref, false, scope_depth)) {
+			type = int_type;
+			break;
+		case NODE_DISCARD:
+			if (!analyze_node(ctx, node.as.discard.expr_ref, scope_depth)) {
 				return false;
 			}
-
-			ctx->result_var = ctx_null_var;
-			ctx->result_type = void_type;
-		} break;
-		case NODE_STRINGLIT: {
-			// node->as.stringlit.as.stringlit.length
-			char str[node->as.stringlit.as.stringlit.length + 1];
-			sv_to_cstr(node->as.stringlit.as.stringlit, str, sizeof(str));
-
-			// data $fmt = { b "One and one make %d!\n", b 0 }
-			ctx->result_var = ctx_add_data(ctx, str, strlen(str) + 1);
-			ctx->result_type = type_ptr_to(char_type);
-		} break;
-		case NODE_WHILE: {
-			qbe_label_t cond_label = ctx_new_label(ctx);
-			qbe_label_t start_label = ctx_new_label(ctx);
-			qbe_label_t end_label = ctx_new_label(ctx);
-
-			loop_t loop = {
-				.continue_label = cond_label,
-				.break_label = end_label,
-			};
-			list_push(&ctx->loop_stack, &loop);
-
-			fprintf(ctx->out_file, "@label_%zu\n", cond_label.label_num);
+			break;
+		case NODE_STRINGLIT:
+			type = type_ptr_to(char_type);
+			break;
+		case NODE_WHILE:
 			// TODO: Ensure expr_ref evaluates to an int/bool or whatever, at least not void or something
-			if (!analyze_node(ctx, symbol_maps, node->as.while_.expr_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.while_.expr_ref, scope_depth)) {
 				return false;
 			}
-			fprintf(ctx->out_file, "    jnz ");
-			qbe_write_var(ctx, ctx->result_var);
-			fprintf(ctx->out_file, ", @label_%zu, @label_%zu\n", start_label.label_num, end_label.label_num);
-			fprintf(ctx->out_file, "@label_%zu\n", start_label.label_num);
-			if (!analyze_node(ctx, symbol_maps, node->as.while_.body_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.while_.body_ref, scope_depth)) {
 				return false;
 			}
-			fprintf(ctx->out_file, "    jmp @label_%zu\n", cond_label.label_num);
-			fprintf(ctx->out_file, "@label_%zu\n", end_label.label_num);
-
-			list_pop(&ctx->loop_stack);
-		} break;
-		case NODE_CHARLIT: {
-			ctx->result_var = ctx_new_temp(ctx, QBE_VALUE_SIGNED_BYTE);
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, ctx->result_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, qbe_basetype_from_type(char_type));
-			fprintf(ctx->out_file, "copy %d\n", node->as.charlit.as.charlit);
-			ctx->result_type = char_type;
-		} break;
-		case NODE_PLUSEQ: {
-			if (emit_lvalue) {
-				report_error(node->source_loc, "Cannot emit lvalue for += operation");
-			}
-
-			// Generate addition, then write back to lhs
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.left_ref, true, scope_depth)) {
+			break;
+		case NODE_CHARLIT:
+			type = char_type;
+			break;
+		case NODE_PLUSEQ:
+		case NODE_MINUSEQ:
+		case NODE_MULTEQ:
+		case NODE_DIVEQ: {
+			if (!analyze_node(ctx, node.as.binop.left_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t left_addr = ctx->result_var;
-			// type_t left_addr_type = ctx->result_type;
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.left_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.binop.right_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t left_var = ctx->result_var;
-			type_t left_type = ctx->result_type;
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.right_ref, false, scope_depth)) {
-				return false;
+
+			// The operation is done like the binary operator would, and the result is converted
+			// back to the type of the left operand when it's stored
+			const type_t *left_type = ctx_type(ctx, node.as.binop.left_ref);
+			const type_t *right_type = ctx_type(ctx, node.as.binop.right_ref);
+			bool is_additive = node.type == NODE_PLUSEQ || node.type == NODE_MINUSEQ;
+			if (!type_is_intlike(right_type) || !(type_is_intlike(left_type) || (is_additive && left_type->kind == TYPE_PTR))) {
+				report_error(node.source_loc, "Invalid operand types for compound assignment");
 			}
-			qbe_var_t right_var = ctx->result_var;
-			// type_t right_type = ctx->result_type;
-
-			// TODO: Promote if necessary
-
-			qbe_var_t temp = ctx_new_temp(ctx, qbe_type_from_type(left_type));
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, temp);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, qbe_type_from_type(left_type));
-			fprintf(ctx->out_file, "add ");
-			qbe_write_var(ctx, left_var);
-			fprintf(ctx->out_file, ", ");
-			qbe_write_var(ctx, right_var);
-			fprintf(ctx->out_file, "\n");
-			fprintf(ctx->out_file, "    ");
-			qbe_write_store_instr(ctx, qbe_type_from_type(left_type));
-			qbe_write_var(ctx, temp);
-			fprintf(ctx->out_file, ", ");
-			qbe_write_var(ctx, left_addr);
-			fprintf(ctx->out_file, "\n");
-
-			ctx->result_var = left_var;
-			ctx->result_type = left_type;
+			expect_lvalue(ctx, node.as.binop.left_ref, true, "Cannot assign to an expression that is not an lvalue");
+			promote_operands(ctx, &node);
+			type = left_type;
 		} break;
 		case NODE_GT:
 		case NODE_LT:
-		case NODE_LTE: {
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.left_ref, false, scope_depth)) {
+		case NODE_LTE:
+			if (!analyze_node(ctx, node.as.binop.left_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t left_var = ctx->result_var;
-			type_t left_type = ctx->result_type;
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.right_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.binop.right_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t right_var = ctx->result_var;
-			type_t right_type = ctx->result_type;
 
 			// TODO: Both should be primitives, otherwise you should still get an error (can't compare structs)
-			if (!type_eq(left_type, right_type)) {
+			if (ctx_type(ctx, node.as.binop.left_ref) != ctx_type(ctx, node.as.binop.right_ref)) {
 				todo("Type mismatch in comparison operation");
 			}
-
-			qbe_var_t result_var = ctx_new_temp(ctx, QBE_VALUE_WORD);
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, result_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, QBE_VALUE_WORD);
-			switch (node->type) {
-				case NODE_GT:
-					fprintf(ctx->out_file, "csgt");  // TODO: Handle signed vs unsigned
-					break;
-				case NODE_LT:
-					fprintf(ctx->out_file, "cslt");  // TODO: Handle signed vs unsigned
-					break;
-				case NODE_LTE:
-					fprintf(ctx->out_file, "csle");  // TODO: Handle signed vs unsigned
-					break;
-				default:
-					unreachable();
-			}
-			qbe_write_type(ctx, qbe_basetype_from_type(left_type));
-			qbe_write_var(ctx, left_var);
-			fprintf(ctx->out_file, ", ");
-			qbe_write_var(ctx, right_var);
-			fprintf(ctx->out_file, "\n");
-
-			ctx->result_var = result_var;
-			ctx->result_type = int_type;
-		} break;
-		case NODE_NEGATE: {
-			if (!analyze_node(ctx, symbol_maps, node->as.negate.expr_ref, false, scope_depth)) {
+			type = int_type;
+			break;
+		case NODE_NEGATE:
+			if (!analyze_node(ctx, node.as.negate.expr_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t expr_var = ctx->result_var;
-			type_t expr_type = ctx->result_type;
+			type = ctx_type(ctx, node.as.negate.expr_ref);
 
 			// TODO: Also, not sure if its allowed for pointers
 			// TODO: Ensure its not unsigned, what do we do in that case? Change the type?
-			if (!type_is_primitive(expr_type)) {
+			if (!type_is_primitive(type)) {
 				todo("Type mismatch in NEGATE operation");
 			}
-
-			qbe_var_t result_var = ctx_new_temp(ctx, qbe_type_from_type(expr_type));
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, result_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, qbe_type_from_type(expr_type));
-			fprintf(ctx->out_file, "neg ");
-			qbe_write_var(ctx, expr_var);
-			fprintf(ctx->out_file, "\n");
-
-			ctx->result_var = result_var;
-			ctx->result_type = expr_type;
-		} break;
+			break;
 		case NODE_INDEX: {
-			if (!analyze_node(ctx, symbol_maps, node->as.index.expr_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.index.expr_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t array_var = ctx->result_var;
-			type_t array_type = ctx->result_type;
+			const type_t *array_type = ctx_type(ctx, node.as.index.expr_ref);
 
-			if (array_type.kind != TYPE_PTR && array_type.kind != TYPE_ARRAY) {
-				report_error(node->source_loc, "Can only index pointer or array types");
+			if (array_type->kind != TYPE_PTR && array_type->kind != TYPE_ARRAY) {
+				report_error(node.source_loc, "Can only index pointer or array types");
 			}
 
-			if (!analyze_node(ctx, symbol_maps, node->as.index.index_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.index.index_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t index_var = ctx->result_var;
-			type_t index_type = ctx->result_type;
-
-			if (!type_is_intlike(index_type)) {
+			if (!type_is_intlike(ctx_type(ctx, node.as.index.index_ref))) {
 				assert(false && "Index expression must be of int-like non-pointer type, at least for now");
 			}
-
-			// Add and then deref if not lvalue
-			if (!promote_value(ctx, &index_var, &index_type, unsigned_long_type)) {
+			if (!implicit_cast(ctx, node.as.index.index_ref, unsigned_long_type)) {
 				return false;
 			}
 
-			qbe_var_t scaled_index_var = ctx_new_temp(ctx, QBE_VALUE_LONG);
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, scaled_index_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, QBE_VALUE_LONG);
-			fprintf(ctx->out_file, "mul ");
-			qbe_write_var(ctx, index_var);
-			fprintf(ctx->out_file, ", %zu\n", type_size(type_deref(array_type)));
-
-			qbe_var_t element_ptr_var = ctx_new_temp(ctx, QBE_VALUE_LONG);
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, element_ptr_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, QBE_VALUE_LONG);
-			fprintf(ctx->out_file, "add ");
-			qbe_write_var(ctx, array_var);
-			fprintf(ctx->out_file, ", ");
-			qbe_write_var(ctx, scaled_index_var);
-			fprintf(ctx->out_file, "\n");
-
-			if (emit_lvalue) {
-				// Just return the address
-				ctx->result_var = element_ptr_var;
-				ctx->result_type = type_deref(array_type);
-			} else {
-				// Deref
-				type_t element_type = type_deref(array_type);
-				qbe_var_t element_var = ctx_new_temp(ctx, qbe_type_from_type(element_type));
-				fprintf(ctx->out_file, "    ");
-				qbe_write_var(ctx, element_var);
-				fprintf(ctx->out_file, " =");
-				qbe_write_type(ctx, qbe_basetype_from_type(element_type));
-				fprintf(ctx->out_file, "load");
-				qbe_write_type(ctx, qbe_type_from_type(element_type));
-				qbe_write_var(ctx, element_ptr_var);
-				fprintf(ctx->out_file, "\n");
-
-				ctx->result_var = element_var;
-				ctx->result_type = element_type;
-			}
+			type = type_deref(array_type);
 		} break;
-		case NODE_POSTINC: {
-			if (emit_lvalue) {
-				report_error(node->source_loc, "Cannot emit lvalue for post-increment operation");
-			}
-
-			if (!analyze_node(ctx, symbol_maps, node->as.postinc.expr_ref, true, scope_depth)) {
+		case NODE_POSTINC:
+		case NODE_POSTDEC:
+		case NODE_PREINC:
+		case NODE_PREDEC:
+			if (!analyze_node(ctx, node.as.incdec.expr_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t addr_var = ctx->result_var;
-			// type_t addr_type = ctx->result_type;
-			if (!analyze_node(ctx, symbol_maps, node->as.postinc.expr_ref, false, scope_depth)) {
-				return false;
+			type = ctx_type(ctx, node.as.incdec.expr_ref);
+			if (!type_is_intlike(type) && type->kind != TYPE_PTR) {
+				report_error(node.source_loc, "Can only increment or decrement integer and pointer types");
 			}
-			qbe_var_t value_var = ctx->result_var;
-			type_t value_type = ctx->result_type;
-
-			qbe_var_t temp = ctx_new_temp(ctx, qbe_type_from_type(value_type));
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, temp);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, qbe_basetype_from_type(value_type));
-			fprintf(ctx->out_file, "add ");
-			qbe_write_var(ctx, value_var);
-			fprintf(ctx->out_file, ", 1\n");
-			fprintf(ctx->out_file, "    ");
-			qbe_write_store_instr(ctx, qbe_type_from_type(value_type));
-			qbe_write_var(ctx, temp);
-			fprintf(ctx->out_file, ", ");
-			qbe_write_var(ctx, addr_var);
-			fprintf(ctx->out_file, "\n");
-
-			ctx->result_var = value_var;
-			ctx->result_type = value_type;
-		} break;
-		case NODE_EMPTY_STMT: {
-			ctx->result_var = ctx_null_var;
-			ctx->result_type = void_type;
-		} break;
-		case NODE_BREAK: {
-			qbe_label_t break_label = list_at(&ctx->loop_stack, loop_t, ctx->loop_stack.length - 1)->break_label;
-			
-			fprintf(ctx->out_file, "@unused_%zu\n", ctx->next_label++);  // TODO: This is a hack because every block can only end with 1 jump, we add a label to jumps to ensure there's only 1 jump per block.
-			fprintf(ctx->out_file, "    jmp @label_%zu\n", break_label.label_num);
-			fprintf(ctx->out_file, "@unused_%zu\n", ctx->next_label++);  // TODO: This is a hack because every block can only end with 1 jump, we add a label to jumps to ensure there's only 1 jump per block.
-			ctx->result_var = ctx_null_var;
-			ctx->result_type = void_type;
-		} break;
-		case NODE_CONTINUE: {
-			qbe_label_t continue_label = list_at(&ctx->loop_stack, loop_t, ctx->loop_stack.length - 1)->continue_label;
-			
-			fprintf(ctx->out_file, "@unused_%zu\n", ctx->next_label++);  // TODO: This is a hack because every block can only end with 1 jump, we add a label to jumps to ensure there's only 1 jump per block.
-			fprintf(ctx->out_file, "    jmp @label_%zu\n", continue_label.label_num);
-			fprintf(ctx->out_file, "@unused_%zu\n", ctx->next_label++);  // TODO: This is a hack because every block can only end with 1 jump, we add a label to jumps to ensure there's only 1 jump per block.
-			ctx->result_var = ctx_null_var;
-			ctx->result_type = void_type;
-		} break;
-		case NODE_FOR: {
-			qbe_label_t cond_label = ctx_new_label(ctx);
-			qbe_label_t start_label = ctx_new_label(ctx);
-			qbe_label_t end_label = ctx_new_label(ctx);
-			qbe_label_t update_label = ctx_new_label(ctx);
-
-			// Update label falls through to condition check, on first enter we go straight to condition, after that, any continues will go to update
-			loop_t loop = {
-				.continue_label = update_label,
-				.break_label = end_label,
-			};
-			list_push(&ctx->loop_stack, &loop);
-
-			push_map(symbol_maps);
-
-			if (!analyze_node(ctx, symbol_maps, node->as.for_.init_stmt_ref, false, scope_depth + 1)) {
+			expect_lvalue(ctx, node.as.incdec.expr_ref, true, "Cannot increment or decrement an expression that is not an lvalue");
+			break;
+		case NODE_EMPTY_STMT:
+		case NODE_BREAK:
+		case NODE_CONTINUE:
+			break;
+		case NODE_FOR:
+			push_scope(symbols);
+
+			if (!analyze_node(ctx, node.as.for_.init_stmt_ref, scope_depth + 1)) {
 				return false;
 			}
-
-			fprintf(ctx->out_file, "    jmp @label_%zu\n", cond_label.label_num);
-
-			fprintf(ctx->out_file, "@label_%zu\n", update_label.label_num);
-			if (!analyze_node(ctx, symbol_maps, node->as.for_.update_expr_ref, false, scope_depth + 1)) {
+			if (!analyze_node(ctx, node.as.for_.update_expr_ref, scope_depth + 1)) {
 				return false;
 			}
-
-			fprintf(ctx->out_file, "@label_%zu\n", cond_label.label_num);
 			// TODO: Ensure cond_expr_ref evaluates to an int/bool or whatever, at least not void or something
-			if (!analyze_node(ctx, symbol_maps, node->as.for_.cond_expr_ref, false, scope_depth + 1)) {
+			if (!analyze_node(ctx, node.as.for_.cond_expr_ref, scope_depth + 1)) {
 				return false;
 			}
-			fprintf(ctx->out_file, "    jnz ");
-			qbe_write_var(ctx, ctx->result_var);
-			fprintf(ctx->out_file, ", @label_%zu, @label_%zu\n", start_label.label_num, end_label.label_num);
-			fprintf(ctx->out_file, "@label_%zu\n", start_label.label_num);
-			if (!analyze_node(ctx, symbol_maps, node->as.for_.body_ref, false, scope_depth + 1)) {
+			if (!analyze_node(ctx, node.as.for_.body_ref, scope_depth + 1)) {
 				return false;
 			}
-			fprintf(ctx->out_file, "    jmp @label_%zu\n", update_label.label_num);
-			fprintf(ctx->out_file, "@label_%zu\n", end_label.label_num);
-
-			list_pop(&ctx->loop_stack);
-
-			pop_map(symbol_maps);
-		} break;
-		case NODE_ANDAND: {
-			// If both operands are nonzero, result is 1, otherwise 0. If first operand is zero, second operand is not evaluated.
 
-			// TODO: Ensure the types used for temporaries here are correct
-			qbe_var_t result_var = ctx_new_temp(ctx, QBE_VALUE_WORD);
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, result_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, result_var.value_type);
-			fprintf(ctx->out_file, "copy 0\n");  // Default to false
-
-			qbe_label_t end_label = ctx_new_label(ctx);
-
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.left_ref, false, scope_depth)) {
+			pop_scope(symbols);
+			break;
+		case NODE_ANDAND:
+			if (!analyze_node(ctx, node.as.binop.left_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t left_var = ctx->result_var;
-			type_t left_type = ctx->result_type;
-			
-			qbe_label_t fallthrough_label = ctx_new_label(ctx);
-
-			fprintf(ctx->out_file, "    jnz ");
-			qbe_write_var(ctx, left_var);
-			fprintf(ctx->out_file, ", @label_%zu, @label_%zu\n", fallthrough_label.label_num, end_label.label_num);
-
-			fprintf(ctx->out_file, "@label_%zu\n", fallthrough_label.label_num);
-
-			if (!analyze_node(ctx, symbol_maps, node->as.binop.right_ref, false, scope_depth)) {
+			if (!analyze_node(ctx, node.as.binop.right_ref, scope_depth)) {
 				return false;
 			}
-			qbe_var_t right_var = ctx->result_var;
-			type_t right_type = ctx->result_type;
 
-			if (!type_is_intlike(left_type) || !type_is_intlike(right_type)) {
+			if (!type_is_intlike(ctx_type(ctx, node.as.binop.left_ref)) || !type_is_intlike(ctx_type(ctx, node.as.binop.right_ref))) {
 				todo("Type mismatch in ANDAND operation");
 			}
-
-			// Copy right var into result
-			fprintf(ctx->out_file, "    ");
-			qbe_write_var(ctx, result_var);
-			fprintf(ctx->out_file, " =");
-			qbe_write_type(ctx, result_var.value_type);
-			fprintf(ctx->out_file, "copy ");
-			qbe_write_var(ctx, right_var);
-			fprintf(ctx->out_file, "\n");
-			fprintf(ctx->out_file, "@label_%zu\n", end_label.label_num);
-
-			ctx->result_var = result_var;
-			ctx->result_type = int_type;
-		} break;
+			type = int_type;
+			break;
 		default:
 			todo("Unhandled node type in analyze_node");
 	}
 
+	node_info_t *info = ctx_info(ctx, node_ref);
+	info->type = type;
+	info->converted_type = type;
+	fold_constant(ctx, node_ref, &node);
 	return true;
 }
 
-bool analyze(node_ref_t root_ref, const char *out_path) {
-	FILE *out_file = fopen(out_path, "w");
-	if (out_file == NULL) {
-		todo("Handle file open error");
-	}
-
-	codegen_ctx_t ctx = {
-		.out_file = out_file,
-		.readonly_values = { .element_size = sizeof(readonly_value_t) },
-		.loop_stack = { .element_size = sizeof(loop_t) },
+bool analyze(node_ref_t root_ref, analysis_t *analysis) {
+	*analysis = (analysis_t) {
+		.info_count = ast_node_count(),
+		.symbols = { .element_size = sizeof(symbol_t) },
 	};
+	analysis->infos = calloc(analysis->info_count, sizeof(node_info_t));
+	assert(analysis->infos != NULL);
 
-	list_t symbol_maps = { .element_size = sizeof(list_t) };
-	push_map(&symbol_maps);
+	// Reserve id 0 for SYMBOL_NONE
+	symbol_t none = { 0 };
+	list_push(&analysis->symbols, &none);
 
-	bool success = analyze_node(&ctx, &symbol_maps, root_ref, false, 0);
+	analyze_ctx_t ctx = {
+		.analysis = analysis,
+		.symbols = symbol_table_new(&analysis->symbols),
+	};
+	push_scope(&ctx.symbols);
 
-	// Write readonly data
-	for (size_t i = 0; i < ctx.readonly_values.length; i++) {
-		readonly_value_t *readonly_value = list_at(&ctx.readonly_values, readonly_value_t, i);
-		fprintf(out_file, "data ");
-		fprintf(out_file, "$"PRIVATE_PREFIX"data_%zu = { ", i);
-		for (size_t j = 0; j < readonly_value->size; j++) {
-			if (j > 0) {
-				fprintf(out_file, ", ");
-			}
-			fprintf(out_file, "b %u", readonly_value->data[j]);
-		}
-		fprintf(out_file, " }\n");
-	}
+	bool success = analyze_node(&ctx, root_ref, 0);
 
-	fclose(out_file);
+	symbol_table_free(&ctx.symbols);
 	return success;
 }
+
+void analysis_free(analysis_t *analysis) {
+	free(analysis->infos);
+	list_clear(&analysis->symbols);
+	*analysis = (analysis_t) { 0 };
+}
@@ -2,44 +2,47 @@
 
 #include "scc.h"
 
-typedef enum {
-	TYPE_VARARGS,
-	TYPE_INT,
-	TYPE_UNSIGNED_INT,
-	TYPE_LONG,
-	TYPE_UNSIGNED_LONG,
-	TYPE_VOID,
-	TYPE_CHAR,
-	TYPE_UNSIGNED_CHAR,
-	TYPE_FUNC,
-	TYPE_PTR,
-	TYPE_ARRAY,
-} type_kind_t;
-
-typedef struct type_t type_t;
-struct type_t {
-	type_kind_t kind;
-	union {
-		struct {
-			type_t *return_type;
-			list_t parameter_types;
-		} func;
-		struct {
-			type_t *inner;
-		} pointer;
-		struct {
-			type_t *inner;
-			node_ref_t size_expr_ref;
-		} array;
-	} as;
-};
-
 typedef struct {
 	bool global;
 	bool is_forward_decl;
-	token_t *name;
-	type_t type;
+	bool address_taken;  // &x appears somewhere, so the variable must live in memory
+	name_t name;
+	source_loc_t source_loc;
+	const type_t *type;
 	size_t scope_depth;
 } symbol_t;
 
-bool analyze(node_ref_t root_ref, const char *out_path);
+// Index into analysis_t.symbols, every declaration gets its own id even if it shadows another
+typedef uint32_t symbol_id_t;
+
+#define SYMBOL_NONE ((symbol_id_t)0)
+
+// What the semantic pass resolved for one node
+typedef struct {
+	const type_t *type;           // type of the node's value, NULL for nodes that aren't analyzed
+	const type_t *converted_type; // type the parent uses the value as, equal to type if there's no implicit conversion
+	size_t scale;                 // pointer arithmetic offsets are multiplied by this after conversion, 0 if unscaled
+	int64_t constant;             // value of an integer constant expression, wrapped to type
+	symbol_id_t symbol;           // symbol declared or referenced by the node
+	bool is_constant;             // the value is known at compile time and stored in constant
+} node_info_t;
+
+// Typed AST, the result of analyze. Nodes themselves are untouched, annotations live next to them.
+typedef struct {
+	node_info_t *infos;  // indexed by node_ref_t.index
+	size_t info_count;
+	list_t symbols;      // symbol_t, indexed by symbol_id_t
+} analysis_t;
+
+bool analyze(node_ref_t root_ref, analysis_t *analysis);
+void analysis_free(analysis_t *analysis);
+
+static inline const node_info_t *analysis_info(const analysis_t *analysis, node_ref_t ref) {
+	assert(ref.index < analysis->info_count);
+	return &analysis->infos[ref.index];
+}
+
+static inline const symbol_t *analysis_symbol(const analysis_t *analysis, symbol_id_t symbol) {
+	assert(symbol != SYMBOL_NONE && symbol < analysis->symbols.length);
+	return &((const symbol_t *)analysis->symbols.element_bytes)[symbol];
+}
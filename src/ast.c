@@ -0,0 +1,413 @@
+#include "scc.h"
+
+static ast_t ast = {
+    .extra = { .element_size = sizeof(uint32_t) },
+    .strings = { .element_size = sizeof(sv_t) },
+    .scratch = { .element_size = sizeof(node_ref_t) },
+};
+
+static packed_node_t *ast_at(uint32_t index) {
+    assert(index > 0 && index < ast.length);
+    return &ast.chunks[index / AST_CHUNK_SIZE][index % AST_CHUNK_SIZE];
+}
+
+static uint32_t push_extra(uint32_t count, const uint32_t *words) {
+    uint32_t start = (uint32_t)ast.extra.length;
+    for (uint32_t i = 0; i < count; i++) {
+        list_push(&ast.extra, (void *)&words[i]);
+    }
+    return start;
+}
+
+static uint32_t extra_at(uint32_t index) {
+    return *list_at(&ast.extra, uint32_t, index);
+}
+
+static void encode(const node_t *node, packed_node_t *packed) {
+    uint32_t *operands = packed->operands;
+
+    switch (node->type) {
+        case NODE_INTLIT:
+            operands[0] = (uint32_t)node->as.intlit;
+            break;
+        case NODE_CHARLIT:
+            operands[0] = (unsigned char)node->as.charlit;
+            break;
+        case NODE_STRINGLIT:
+            list_push(&ast.strings, (void *)&node->as.stringlit);
+            operands[0] = (uint32_t)ast.strings.length - 1;
+            break;
+        case NODE_ADD:
+        case NODE_SUB:
+        case NODE_MULT:
+        case NODE_DIV:
+        case NODE_NEQ:
+        case NODE_EQEQ:
+        case NODE_ANDAND:
+        case NODE_GT:
+        case NODE_LT:
+        case NODE_LTE:
+        case NODE_ASSIGNMENT:
+        case NODE_PLUSEQ:
+        case NODE_MINUSEQ:
+        case NODE_MULTEQ:
+        case NODE_DIVEQ:
+            operands[0] = node->as.binop.left_ref.index;
+            operands[1] = node->as.binop.right_ref.index;
+            break;
+        case NODE_VAR_DECL: {
+            if (node->as.var_decl.is_array) {
+                packed->flags |= NODE_FLAG_ARRAY;
+            }
+            if (node->as.var_decl.is_varargs) {
+                packed->flags |= NODE_FLAG_VARARGS;
+            }
+            operands[0] = node->as.var_decl.type_ref.index;
+            operands[1] = node->as.var_decl.name;
+            uint32_t extra[] = {
+                node->as.var_decl.name_loc.offset,
+                node->as.var_decl.init_expr_ref.index,
+                node->as.var_decl.array_size_expr_ref.index,
+            };
+            operands[2] = push_extra(3, extra);
+        } break;
+        case NODE_FUNCTION:
+            operands[0] = node->as.function.signature_ref.index;
+            operands[1] = node->as.function.body_ref.index;
+            break;
+        case NODE_FUNCTION_SIGNATURE: {
+            operands[0] = node->as.function_signature.return_type_ref.index;
+            operands[1] = node->as.function_signature.name;
+            uint32_t extra[] = {
+                node->as.function_signature.name_loc.offset,
+                node->as.function_signature.parameters.start,
+                node->as.function_signature.parameters.length,
+            };
+            operands[2] = push_extra(3, extra);
+        } break;
+        case NODE_RETURN:
+            operands[0] = node->as.ret.expr_ref.index;
+            break;
+        case NODE_CAST:
+            operands[0] = node->as.cast.expr_ref.index;
+            operands[1] = node->as.cast.target_type_ref.index;
+            break;
+        case NODE_PTR_TYPE:
+            operands[0] = node->as.ptr_type.base_type_ref.index;
+            break;
+        case NODE_ADDRESS_OF:
+            operands[0] = node->as.address_of.expr_ref.index;
+            break;
+        case NODE_DEREF:
+            operands[0] = node->as.deref.expr_ref.index;
+            break;
+        case NODE_DISCARD:
+            operands[0] = node->as.discard.expr_ref.index;
+            break;
+        case NODE_NEGATE:
+            operands[0] = node->as.negate.expr_ref.index;
+            break;
+        case NODE_POSTINC:
+        case NODE_POSTDEC:
+        case NODE_PREINC:
+        case NODE_PREDEC:
+            operands[0] = node->as.incdec.expr_ref.index;
+            break;
+        case NODE_IF:
+            operands[0] = node->as.if_.expr_ref.index;
+            operands[1] = node->as.if_.then_ref.index;
+            operands[2] = node->as.if_.else_ref.index;
+            break;
+        case NODE_WHILE:
+            operands[0] = node->as.while_.expr_ref.index;
+            operands[1] = node->as.while_.body_ref.index;
+            break;
+        case NODE_FOR: {
+            operands[0] = node->as.for_.init_stmt_ref.index;
+            operands[1] = node->as.for_.cond_expr_ref.index;
+            uint32_t extra[] = {
+                node->as.for_.update_expr_ref.index,
+                node->as.for_.body_ref.index,
+            };
+            operands[2] = push_extra(2, extra);
+        } break;
+        case NODE_FILE:
+            operands[0] = node->as.file.top_levels.start;
+            operands[1] = node->as.file.top_levels.length;
+            break;
+        case NODE_CALL:
+            operands[0] = node->as.call.function_ref.index;
+            operands[1] = node->as.call.arg_refs.start;
+            operands[2] = node->as.call.arg_refs.length;
+            break;
+        case NODE_BLOCK:
+            operands[0] = node->as.block.start;
+            operands[1] = node->as.block.length;
+            break;
+        case NODE_IDENTIFIER:
+            operands[0] = node->as.identifier;
+            break;
+        case NODE_INDEX:
+            operands[0] = node->as.index.expr_ref.index;
+            operands[1] = node->as.index.index_ref.index;
+            break;
+        case NODE_INT:
+        case NODE_FLOAT:
+        case NODE_LONG:
+        case NODE_CHAR:
+        case NODE_VOID:
+            if (node->as.type.is_signed) {
+                packed->flags |= NODE_FLAG_SIGNED;
+            }
+            break;
+        case NODE_BREAK:
+        case NODE_CONTINUE:
+        case NODE_EMPTY_STMT:
+            break;
+    }
+}
+
+static node_ref_t make_ref(uint32_t index) {
+    return (node_ref_t){ .index = index };
+}
+
+static void decode(const packed_node_t *packed, node_t *node) {
+    const uint32_t *operands = packed->operands;
+
+    switch (node->type) {
+        case NODE_INTLIT:
+            node->as.intlit = (int)operands[0];
+            break;
+        case NODE_CHARLIT:
+            node->as.charlit = (char)operands[0];
+            break;
+        case NODE_STRINGLIT:
+            node->as.stringlit = *list_at(&ast.strings, sv_t, operands[0]);
+            break;
+        case NODE_ADD:
+        case NODE_SUB:
+        case NODE_MULT:
+        case NODE_DIV:
+        case NODE_NEQ:
+        case NODE_EQEQ:
+        case NODE_ANDAND:
+        case NODE_GT:
+        case NODE_LT:
+        case NODE_LTE:
+        case NODE_ASSIGNMENT:
+        case NODE_PLUSEQ:
+        case NODE_MINUSEQ:
+        case NODE_MULTEQ:
+        case NODE_DIVEQ:
+            node->as.binop.left_ref = make_ref(operands[0]);
+            node->as.binop.right_ref = make_ref(operands[1]);
+            break;
+        case NODE_VAR_DECL:
+            node->as.var_decl.is_array = packed->flags & NODE_FLAG_ARRAY;
+            node->as.var_decl.is_varargs = packed->flags & NODE_FLAG_VARARGS;
+            node->as.var_decl.type_ref = make_ref(operands[0]);
+            node->as.var_decl.name = operands[1];
+            node->as.var_decl.name_loc.offset = extra_at(operands[2]);
+            node->as.var_decl.init_expr_ref = make_ref(extra_at(operands[2] + 1));
+            node->as.var_decl.array_size_expr_ref = make_ref(extra_at(operands[2] + 2));
+            break;
+        case NODE_FUNCTION:
+            node->as.function.signature_ref = make_ref(operands[0]);
+            node->as.function.body_ref = make_ref(operands[1]);
+            break;
+        case NODE_FUNCTION_SIGNATURE:
+            node->as.function_signature.return_type_ref = make_ref(operands[0]);
+            node->as.function_signature.name = operands[1];
+            node->as.function_signature.name_loc.offset = extra_at(operands[2]);
+            node->as.function_signature.parameters.start = extra_at(operands[2] + 1);
+            node->as.function_signature.parameters.length = extra_at(operands[2] + 2);
+            break;
+        case NODE_RETURN:
+            node->as.ret.expr_ref = make_ref(operands[0]);
+            break;
+        case NODE_CAST:
+            node->as.cast.expr_ref = make_ref(operands[0]);
+            node->as.cast.target_type_ref = make_ref(operands[1]);
+            break;
+        case NODE_PTR_TYPE:
+            node->as.ptr_type.base_type_ref = make_ref(operands[0]);
+            break;
+        case NODE_ADDRESS_OF:
+            node->as.address_of.expr_ref = make_ref(operands[0]);
+            break;
+        case NODE_DEREF:
+            node->as.deref.expr_ref = make_ref(operands[0]);
+            break;
+        case NODE_DISCARD:
+            node->as.discard.expr_ref = make_ref(operands[0]);
+            break;
+        case NODE_NEGATE:
+            node->as.negate.expr_ref = make_ref(operands[0]);
+            break;
+        case NODE_POSTINC:
+        case NODE_POSTDEC:
+        case NODE_PREINC:
+        case NODE_PREDEC:
+            node->as.incdec.expr_ref = make_ref(operands[0]);
+            break;
+        case NODE_IF:
+            node->as.if_.expr_ref = make_ref(operands[0]);
+            node->as.if_.then_ref = make_ref(operands[1]);
+            node->as.if_.else_ref = make_ref(operands[2]);
+            break;
+        case NODE_WHILE:
+            node->as.while_.expr_ref = make_ref(operands[0]);
+            node->as.while_.body_ref = make_ref(operands[1]);
+            break;
+        case NODE_FOR:
+            node->as.for_.init_stmt_ref = make_ref(operands[0]);
+            node->as.for_.cond_expr_ref = make_ref(operands[1]);
+            node->as.for_.update_expr_ref = make_ref(extra_at(operands[2]));
+            node->as.for_.body_ref = make_ref(extra_at(operands[2] + 1));
+            break;
+        case NODE_FILE:
+            node->as.file.top_levels = (node_list_t){ operands[0], operands[1] };
+            break;
+        case NODE_CALL:
+            node->as.call.function_ref = make_ref(operands[0]);
+            node->as.call.arg_refs = (node_list_t){ operands[1], operands[2] };
+            break;
+        case NODE_BLOCK:
+            node->as.block = (node_list_t){ operands[0], operands[1] };
+            break;
+        case NODE_IDENTIFIER:
+            node->as.identifier = operands[0];
+            break;
+        case NODE_INDEX:
+            node->as.index.expr_ref = make_ref(operands[0]);
+            node->as.index.index_ref = make_ref(operands[1]);
+            break;
+        case NODE_INT:
+        case NODE_FLOAT:
+        case NODE_LONG:
+        case NODE_CHAR:
+        case NODE_VOID:
+            node->as.type.is_signed = packed->flags & NODE_FLAG_SIGNED;
+            break;
+        case NODE_BREAK:
+        case NODE_CONTINUE:
+        case NODE_EMPTY_STMT:
+            break;
+    }
+}
+
+node_ref_t ast_push(const node_t *node) {
+    if (ast.length == 0) {
+        // Reserve index 0 for NODE_REF_NULL
+        ast.length = 1;
+    }
+
+    if (ast.length / AST_CHUNK_SIZE == ast.chunk_count) {
+        packed_node_t **chunks = realloc(ast.chunks, (ast.chunk_count + 1) * sizeof(packed_node_t *));
+        assert(chunks != NULL);
+        chunks[ast.chunk_count] = malloc(AST_CHUNK_SIZE * sizeof(packed_node_t));
+        assert(chunks[ast.chunk_count] != NULL);
+        ast.chunks = chunks;
+        ast.chunk_count++;
+    }
+
+    assert(ast.length < UINT32_MAX);
+    uint32_t index = (uint32_t)ast.length++;
+    packed_node_t *packed = ast_at(index);
+    *packed = (packed_node_t){
+        .type = (uint8_t)node->type,
+        .source_loc = node->source_loc,
+    };
+    encode(node, packed);
+    return make_ref(index);
+}
+
+ast_mark_t ast_mark(void) {
+    return (ast_mark_t){
+        .nodes = ast.length,
+        .extra = ast.extra.length,
+        .strings = ast.strings.length,
+        .scratch = ast.scratch.length,
+    };
+}
+
+void ast_release(ast_mark_t mark) {
+    assert(mark.nodes <= ast.length);
+    ast.length = mark.nodes;
+    ast.extra.length = mark.extra;
+    ast.strings.length = mark.strings;
+    ast.scratch.length = mark.scratch;
+}
+
+void ast_free(void) {
+    for (size_t i = 0; i < ast.chunk_count; i++) {
+        free(ast.chunks[i]);
+    }
+    free(ast.chunks);
+    list_clear(&ast.scratch);
+    list_clear(&ast.extra);
+    list_clear(&ast.strings);
+    ast.chunks = NULL;
+    ast.chunk_count = 0;
+    ast.length = 0;
+}
+
+size_t ast_node_count(void) {
+    return ast.length;
+}
+
+size_t ast_scratch_start(void) {
+    return ast.scratch.length;
+}
+
+void ast_scratch_push(node_ref_t ref) {
+    list_push(&ast.scratch, &ref);
+}
+
+size_t ast_scratch_count(size_t start) {
+    assert(start <= ast.scratch.length);
+    return ast.scratch.length - start;
+}
+
+node_list_t ast_scratch_finish(size_t start) {
+    node_list_t list = {
+        .start = (uint32_t)ast.extra.length,
+        .length = (uint32_t)ast_scratch_count(start),
+    };
+    for (size_t i = start; i < ast.scratch.length; i++) {
+        list_push(&ast.extra, &list_at(&ast.scratch, node_ref_t, i)->index);
+    }
+    ast.scratch.length = start;
+    return list;
+}
+
+node_ref_t node_list_at(node_list_t list, size_t index) {
+    assert(index < list.length);
+    return make_ref(extra_at(list.start + (uint32_t)index));
+}
+
+node_t node_ref_get(node_ref_t ref) {
+    const packed_node_t *packed = ast_at(ref.index);
+    node_t node = {
+        .type = packed->type,
+        .source_loc = packed->source_loc,
+    };
+    decode(packed, &node);
+    return node;
+}
+
+node_type_t node_ref_type(node_ref_t ref) {
+    return ast_at(ref.index)->type;
+}
+
+source_loc_t node_ref_loc(node_ref_t ref) {
+    return ast_at(ref.index)->source_loc;
+}
+
+void node_ref_set_loc(node_ref_t ref, source_loc_t source_loc) {
+    ast_at(ref.index)->source_loc = source_loc;
+}
+
+bool node_ref_is_null(node_ref_t ref) {
+    return ref.index == 0;
+}
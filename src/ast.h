@@ -0,0 +1,215 @@
+#pragma once
+
+#include "scc.h"
+
+typedef enum {
+    NODE_INTLIT,
+    NODE_STRINGLIT,
+    NODE_CHARLIT,
+    NODE_ADD,
+    NODE_SUB,
+    NODE_MULT,
+    NODE_DIV,
+    NODE_VAR_DECL,
+    NODE_BLOCK,
+    NODE_FLOAT,
+    NODE_INT,
+    NODE_LONG,
+    NODE_CHAR,
+    NODE_VOID,
+    NODE_PTR_TYPE,
+    NODE_ASSIGNMENT,
+    NODE_IDENTIFIER,
+    NODE_RETURN,
+    NODE_FUNCTION,
+    NODE_FUNCTION_SIGNATURE,
+    NODE_CAST,
+    NODE_ADDRESS_OF,
+    NODE_DEREF,
+    NODE_IF,
+    NODE_NEQ,
+    NODE_FILE,
+    NODE_CALL,
+    NODE_EQEQ,
+    NODE_ANDAND,
+    NODE_GT,
+    NODE_LT,
+    NODE_LTE,
+    NODE_PLUSEQ,
+    NODE_DISCARD,
+    NODE_WHILE,
+    NODE_FOR,
+    NODE_NEGATE,
+    NODE_INDEX,
+    NODE_POSTINC,
+    NODE_BREAK,
+    NODE_CONTINUE,
+    NODE_EMPTY_STMT,
+    NODE_MINUSEQ,
+    NODE_MULTEQ,
+    NODE_DIVEQ,
+    NODE_POSTDEC,
+    NODE_PREINC,
+    NODE_PREDEC,
+} node_type_t;
+
+// Reference to a node in the AST, index 0 is never a node and marks a missing child
+typedef struct {
+    uint32_t index;
+} node_ref_t;
+
+#define NODE_REF_NULL ((node_ref_t){ 0 })
+
+// Children of a block, call, function signature or file, a range of the AST's extra array
+typedef struct {
+    uint32_t start;
+    uint32_t length;
+} node_list_t;
+
+// Node as seen by the parser and the analyzer. The AST stores nodes packed (see packed_node_t),
+// node_ref_get decodes one into a node_t by value and ast_push encodes one.
+typedef struct {
+    source_loc_t source_loc;
+    node_type_t type;
+    union {
+        int intlit;
+        sv_t stringlit;
+        char charlit;
+        struct {
+            node_ref_t left_ref;
+            node_ref_t right_ref;
+        } binop;
+        struct {
+            node_ref_t type_ref;
+            name_t name;
+            source_loc_t name_loc;
+            node_ref_t init_expr_ref;
+            bool is_array;
+            node_ref_t array_size_expr_ref;
+            bool is_varargs;
+        } var_decl;
+        struct {
+            node_ref_t signature_ref;
+            node_ref_t body_ref;
+        } function;
+        struct {
+            node_ref_t return_type_ref;
+            name_t name;
+            source_loc_t name_loc;
+            node_list_t parameters;
+        } function_signature;
+        struct {
+            node_ref_t expr_ref;
+        } ret;
+        struct {
+            node_ref_t expr_ref;
+            node_ref_t target_type_ref;
+        } cast;
+        struct {
+            node_ref_t base_type_ref;
+        } ptr_type;
+        struct {
+            node_ref_t expr_ref;
+        } address_of;
+        struct {
+            node_ref_t expr_ref;
+        } deref;
+        struct {
+            node_ref_t expr_ref;
+            node_ref_t then_ref;
+            node_ref_t else_ref;
+        } if_;
+        struct {
+            node_ref_t expr_ref;
+            node_ref_t body_ref;
+        } while_;
+        struct {
+            node_list_t top_levels;
+        } file;
+        struct {
+            node_ref_t function_ref;
+            node_list_t arg_refs;
+        } call;
+        // TODO: Put these in some unaryop struct
+        struct {
+            node_ref_t expr_ref;
+        } discard;
+        struct {
+            node_ref_t expr_ref;
+        } negate;
+        name_t identifier;
+        node_list_t block;
+        struct {
+            bool is_signed;
+        } type;
+        struct {
+            node_ref_t expr_ref;
+            node_ref_t index_ref;
+        } index;
+        // Pre and post increment and decrement
+        struct {
+            node_ref_t expr_ref;
+        } incdec;
+        struct {
+            node_ref_t init_stmt_ref;
+            node_ref_t cond_expr_ref;
+            node_ref_t update_expr_ref;
+            node_ref_t body_ref;
+        } for_;
+    } as;
+} node_t;
+
+#define NODE_FLAG_SIGNED  (1 << 0)
+#define NODE_FLAG_ARRAY   (1 << 1)
+#define NODE_FLAG_VARARGS (1 << 2)
+
+// Every node is a tag, a location and three 32-bit operands. Operands hold child references,
+// names and literal values directly, anything that does not fit goes to the side arrays in ast_t.
+typedef struct {
+    uint8_t type;   // node_type_t
+    uint8_t flags;  // NODE_FLAG_*
+    source_loc_t source_loc;
+    uint32_t operands[3];
+} packed_node_t;
+
+// Nodes are allocated in fixed size chunks, so a node never moves once allocated
+#define AST_CHUNK_SIZE 1024
+
+typedef struct {
+    packed_node_t **chunks;
+    size_t chunk_count;  // chunks stay allocated after a release and are reused
+    size_t length;
+    list_t extra;        // uint32_t, operands of nodes that need more than three and child lists
+    list_t strings;      // sv_t, string literal bodies
+    list_t scratch;      // node_ref_t, child lists that are still being parsed
+} ast_t;
+
+// Allocation position of the AST, releasing to it frees everything allocated since
+typedef struct {
+    size_t nodes;
+    size_t extra;
+    size_t strings;
+    size_t scratch;
+} ast_mark_t;
+
+node_ref_t ast_push(const node_t *node);
+ast_mark_t ast_mark(void);
+void ast_release(ast_mark_t mark);
+void ast_free(void);
+// Nodes allocated so far including the null node, every node_ref_t index is below this
+size_t ast_node_count(void);
+
+// Child lists are collected on a scratch stack while they are parsed, so lists of nested nodes
+// can be built at the same time. ast_scratch_finish moves everything pushed since the given
+// position to the extra array in one piece.
+size_t ast_scratch_start(void);
+void ast_scratch_push(node_ref_t ref);
+size_t ast_scratch_count(size_t start);
+node_list_t ast_scratch_finish(size_t start);
+node_ref_t node_list_at(node_list_t list, size_t index);
+
+node_t node_ref_get(node_ref_t ref);
+node_type_t node_ref_type(node_ref_t ref);
+source_loc_t node_ref_loc(node_ref_t ref);
+void node_ref_set_loc(node_ref_t ref, source_loc_t source_loc);
+bool node_ref_is_null(node_ref_t ref);
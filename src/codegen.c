@@ -0,0 +1,998 @@
+#include "scc.h"
+
+static qbe_value_type_t qbe_type_from_type(const type_t *type) {
+	switch (type->kind) {
+	case TYPE_VARARGS:
+		return QBE_VALUE_VARARGS;
+	case TYPE_INT:
+		return QBE_VALUE_WORD;
+	case TYPE_UNSIGNED_INT:
+		return QBE_VALUE_UNSIGNED_WORD;
+	case TYPE_LONG:
+		return QBE_VALUE_LONG;
+	case TYPE_UNSIGNED_LONG:
+		return QBE_VALUE_UNSIGNED_LONG;
+	case TYPE_CHAR:
+		return QBE_VALUE_SIGNED_BYTE;
+	case TYPE_UNSIGNED_CHAR:
+		return QBE_VALUE_UNSIGNED_BYTE;
+	case TYPE_VOID:
+		return QBE_VALUE_VOID;
+	case TYPE_FUNC:
+	case TYPE_ARRAY:
+	case TYPE_PTR:
+		return QBE_VALUE_LONG;
+	default:
+		todo("Unhandled type conversion from type to qbe type");
+	}
+}
+
+static qbe_value_type_t qbe_basetype_from_type(const type_t *type) {
+	switch (type->kind) {
+	case TYPE_CHAR:
+	case TYPE_INT:
+		return QBE_VALUE_WORD;
+	case TYPE_UNSIGNED_CHAR:
+	case TYPE_UNSIGNED_INT:
+		return QBE_VALUE_UNSIGNED_WORD;
+	case TYPE_FUNC:
+	case TYPE_PTR:
+	case TYPE_ARRAY:
+		return QBE_VALUE_UNSIGNED_LONG;
+	case TYPE_LONG:
+		return QBE_VALUE_LONG;
+	case TYPE_UNSIGNED_LONG:
+		return QBE_VALUE_UNSIGNED_LONG;
+	case TYPE_VOID:
+		return QBE_VALUE_VOID;
+	default:
+		todo("Unhandled type conversion from type to qbe type");
+	}
+}
+
+// TODO: DEPRECATED?
+static size_t qbe_type_size(qbe_value_type_t value_type) {
+	switch (value_type) {
+		case QBE_VALUE_VOID:
+			return 0;
+		case QBE_VALUE_UNSIGNED_WORD:
+		case QBE_VALUE_WORD:
+			return 4;
+		case QBE_VALUE_UNSIGNED_BYTE:
+		case QBE_VALUE_SIGNED_BYTE:
+			return 1;
+		case QBE_VALUE_SINGLE:
+			return 4;
+		case QBE_VALUE_UNSIGNED_LONG:
+		case QBE_VALUE_LONG:
+			return 8;
+		default:
+			unreachable();
+	}
+}
+
+typedef struct {
+	ir_block_id_t continue_block;
+	ir_block_id_t break_block;
+} loop_t;
+
+// Every top level node is lowered on its own into a unit, possibly on another thread. Temps and
+// blocks are local to QBE functions so each unit numbers them from 0.
+typedef struct {
+	node_ref_t node_ref;
+	outbuf_t text;
+	ir_stats_t stats;
+} codegen_unit_t;
+
+typedef struct {
+	const analysis_t *analysis;
+	// Temp holding the stack slot of every local, indexed by symbol id. Shared by all units,
+	// which is fine since a local is only ever touched by the unit of its function.
+	ir_temp_id_t *local_temps;
+	// String literals of every unit, filled before lowering starts
+	const strpool_t *strings;
+	ir_module_t *module;
+	ir_func_t *func;
+	ir_value_t result_var;
+	const type_t *function_return_type;
+	ir_value_t return_var;
+	ir_block_id_t end_block;
+	list_t loop_stack;
+} codegen_ctx_t;
+
+static const ir_value_t null_var = {
+	.kind = IR_VALUE_NONE,
+	.type = QBE_VALUE_VOID,
+};
+
+static const node_info_t *ctx_info(codegen_ctx_t *ctx, node_ref_t node_ref) {
+	return analysis_info(ctx->analysis, node_ref);
+}
+
+static const type_t *ctx_type(codegen_ctx_t *ctx, node_ref_t node_ref) {
+	return analysis_info(ctx->analysis, node_ref)->type;
+}
+
+static const symbol_t *ctx_symbol(codegen_ctx_t *ctx, node_ref_t node_ref) {
+	return analysis_symbol(ctx->analysis, analysis_info(ctx->analysis, node_ref)->symbol);
+}
+
+static ir_value_t ctx_new_temp(codegen_ctx_t *ctx, qbe_value_type_t value_type) {
+	return ir_new_temp(ctx->func, value_type);
+}
+
+// Local arrays of at least 16 bytes are 16 byte aligned like the SysV ABI asks, other locals use
+// the alignment of their type
+static size_t slot_align(const type_t *type, size_t size) {
+	if (type->kind == TYPE_ARRAY && size >= 16) {
+		return 16;
+	}
+	return type_align(type);
+}
+
+// Gives the local declared by node_ref a temp for the address of its stack slot. Locals of a
+// known size share slots with locals of scopes that have ended, variable length arrays are
+// allocated by the caller. Scalars whose address is never taken get a var instead, which is
+// loaded and stored the same way until ssa_construct keeps it in temps.
+static ir_value_t ctx_declare_local(codegen_ctx_t *ctx, node_ref_t node_ref, const type_t *type, size_t size, bool is_dynamic) {
+	symbol_id_t symbol_id = ctx_info(ctx, node_ref)->symbol;
+	const symbol_t *symbol = analysis_symbol(ctx->analysis, symbol_id);
+	assert(!symbol->global);
+
+	ir_value_t var;
+	if (is_dynamic) {
+		var = ir_new_local(ctx->func, symbol->name);
+	} else if (!symbol->address_taken && type->kind != TYPE_ARRAY) {
+		var = ir_new_var(ctx->func, qbe_type_from_type(type), symbol->name);
+	} else {
+		var = ir_alloc_local(ctx->func, symbol->name, size, slot_align(type, size));
+	}
+	ctx->local_temps[symbol_id] = var.as.temp;
+	return var;
+}
+
+// Address of the symbol node_ref refers to
+static ir_value_t ctx_symbol_var(codegen_ctx_t *ctx, node_ref_t node_ref) {
+	symbol_id_t symbol_id = ctx_info(ctx, node_ref)->symbol;
+	const symbol_t *symbol = analysis_symbol(ctx->analysis, symbol_id);
+	if (symbol->global) {
+		return ir_global(qbe_type_from_type(symbol->type), symbol->name);
+	}
+	return (ir_value_t) {
+		.kind = IR_VALUE_TEMP,
+		.type = QBE_VALUE_LONG,
+		.as.temp = ctx->local_temps[symbol_id],
+	};
+}
+
+static void ctx_emit_store(codegen_ctx_t *ctx, qbe_value_type_t value_type, ir_value_t value, ir_value_t addr) {
+	ir_emit(ctx->func, (ir_instr_t) {
+		.op = IR_STORE,
+		.arg_type = value_type,
+		.args = { value, addr },
+	});
+}
+
+// Loads a value of type from addr into a new temp
+static ir_value_t ctx_emit_load(codegen_ctx_t *ctx, const type_t *type, ir_value_t addr) {
+	ir_value_t result_var = ctx_new_temp(ctx, qbe_type_from_type(type));
+	ir_emit(ctx->func, (ir_instr_t) {
+		.op = IR_LOAD,
+		.type = qbe_basetype_from_type(type),
+		.arg_type = qbe_type_from_type(type),
+		.result = result_var,
+		.args = { addr },
+	});
+	return result_var;
+}
+
+// Emits result = op left, right where everything has the same type
+static ir_value_t ctx_emit_binary(codegen_ctx_t *ctx, ir_op_t op, qbe_value_type_t value_type, ir_value_t left, ir_value_t right) {
+	ir_value_t result_var = ctx_new_temp(ctx, value_type);
+	ir_emit(ctx->func, (ir_instr_t) {
+		.op = op,
+		.type = value_type,
+		.result = result_var,
+		.args = { left, right },
+	});
+	return result_var;
+}
+
+static qbe_value_type_t qbe_flip_signedness(qbe_value_type_t type) {
+	switch (type) {
+		case QBE_VALUE_WORD:
+			return QBE_VALUE_UNSIGNED_WORD;
+		case QBE_VALUE_UNSIGNED_WORD:
+			return QBE_VALUE_WORD;
+		case QBE_VALUE_SIGNED_BYTE:
+			return QBE_VALUE_UNSIGNED_BYTE;
+		case QBE_VALUE_UNSIGNED_BYTE:
+			return QBE_VALUE_SIGNED_BYTE;
+		case QBE_VALUE_LONG:
+			return QBE_VALUE_UNSIGNED_LONG;
+		case QBE_VALUE_UNSIGNED_LONG:
+			return QBE_VALUE_LONG;
+		default:
+			return type;
+	}
+}
+
+static bool qbe_needs_cast_instruction(qbe_value_type_t from, qbe_value_type_t to) {
+	if (from == to) {
+		return false;
+	}
+
+	// If types only differ in signedness, no instruction is needed
+	if (qbe_flip_signedness(from) == to) {
+		return false;
+	}
+
+	return true;
+}
+
+static void promote_value(codegen_ctx_t *ctx, ir_value_t *var, const type_t *from_type, const type_t *to_type) {
+	assert(type_is_primitive(from_type) && type_is_primitive(to_type));
+
+	qbe_value_type_t from_qbe_type = qbe_basetype_from_type(from_type);
+	qbe_value_type_t to_qbe_type = qbe_basetype_from_type(to_type);
+
+	if (!qbe_needs_cast_instruction(from_qbe_type, to_qbe_type)) {
+		// No instructions needed to promote
+		return;
+	}
+	assert(qbe_type_size(qbe_type_from_type(from_type)) != 8 && "Cannot extend further than long");
+
+	ir_value_t result_var = ctx_new_temp(ctx, qbe_type_from_type(to_type));
+	ir_emit(ctx->func, (ir_instr_t) {
+		.op = IR_EXT,
+		.type = to_qbe_type,
+		.arg_type = qbe_type_from_type(from_type),
+		.result = result_var,
+		.args = { *var },
+	});
+
+	*var = result_var;
+}
+
+// Applies the implicit conversion the semantic pass recorded for node_ref to its lowered value.
+// Parents call this once all their operands are lowered.
+static void convert_value(codegen_ctx_t *ctx, node_ref_t node_ref, ir_value_t *var) {
+	const node_info_t *info = ctx_info(ctx, node_ref);
+
+	// Constants are converted and scaled here instead of at runtime
+	if (var->kind == IR_VALUE_CONST && info->is_constant) {
+		int64_t constant = type_wrap(info->converted_type, var->as.constant);
+		var->type = qbe_type_from_type(info->converted_type);
+		if (info->scale != 0) {
+			constant = (int64_t)((uint64_t)constant * info->scale);
+			var->type = QBE_VALUE_LONG;
+		}
+		var->as.constant = constant;
+		return;
+	}
+
+	if (info->type != info->converted_type) {
+		if (info->type->kind == TYPE_ARRAY && info->converted_type->kind == TYPE_PTR) {
+			// Array decay, the value already is the address of the first element
+			var->type = qbe_type_from_type(info->converted_type);
+		} else {
+			promote_value(ctx, var, info->type, info->converted_type);
+		}
+	}
+
+	// Multiply by the element size of the pointer this is added to
+	if (info->scale != 0) {
+		ir_value_t result_var = ctx_new_temp(ctx, QBE_VALUE_LONG);
+		ir_emit(ctx->func, (ir_instr_t) {
+			.op = IR_MUL,
+			.type = QBE_VALUE_UNSIGNED_LONG,
+			.result = result_var,
+			.args = { *var, ir_const(QBE_VALUE_LONG, (int64_t)info->scale) },
+		});
+
+		*var = result_var;
+	}
+}
+
+static void lower_node(codegen_ctx_t *ctx, node_ref_t node_ref, bool emit_lvalue);
+
+// Lowers the operands of a binary operation and converts them to the operation's type
+static void lower_operands(codegen_ctx_t *ctx, node_t *node, ir_value_t *left_var, ir_value_t *right_var) {
+	lower_node(ctx, node->as.binop.left_ref, false);
+	*left_var = ctx->result_var;
+	lower_node(ctx, node->as.binop.right_ref, false);
+	*right_var = ctx->result_var;
+
+	convert_value(ctx, node->as.binop.left_ref, left_var);
+	convert_value(ctx, node->as.binop.right_ref, right_var);
+}
+
+// An lvalue whose address has been computed, so read-modify-write operations can load and store
+// it without lowering its expression (and running its side effects) a second time
+typedef struct {
+	ir_value_t addr;
+	const type_t *type;
+} lvalue_t;
+
+static lvalue_t lower_lvalue(codegen_ctx_t *ctx, node_ref_t node_ref) {
+	lower_node(ctx, node_ref, true);
+	return (lvalue_t) {
+		.addr = ctx->result_var,
+		.type = ctx_type(ctx, node_ref),
+	};
+}
+
+static ir_value_t lvalue_load(codegen_ctx_t *ctx, const lvalue_t *lvalue) {
+	return ctx_emit_load(ctx, lvalue->type, lvalue->addr);
+}
+
+static void lvalue_store(codegen_ctx_t *ctx, const lvalue_t *lvalue, ir_value_t value) {
+	ctx_emit_store(ctx, qbe_type_from_type(lvalue->type), value, lvalue->addr);
+}
+
+// left op= right, computed in the type the semantic pass promoted the operands to. Storing
+// truncates the result back to the type of left.
+static void lower_compound_assignment(codegen_ctx_t *ctx, node_t *node, ir_op_t op) {
+	lvalue_t target = lower_lvalue(ctx, node->as.binop.left_ref);
+	ir_value_t left_var = lvalue_load(ctx, &target);
+	lower_node(ctx, node->as.binop.right_ref, false);
+	ir_value_t right_var = ctx->result_var;
+
+	convert_value(ctx, node->as.binop.left_ref, &left_var);
+	convert_value(ctx, node->as.binop.right_ref, &right_var);
+
+	const type_t *op_type = ctx_info(ctx, node->as.binop.left_ref)->converted_type;
+	ir_value_t result_var = ctx_emit_binary(ctx, op, qbe_type_from_type(op_type), left_var, right_var);
+	lvalue_store(ctx, &target, result_var);
+
+	// Compound assignments are statements for now
+	ctx->result_var = null_var;
+}
+
+// Pre and post increment and decrement, pointers step by the size of what they point to
+static void lower_incdec(codegen_ctx_t *ctx, node_t *node, const type_t *type) {
+	bool is_increment = node->type == NODE_PREINC || node->type == NODE_POSTINC;
+	bool is_prefix = node->type == NODE_PREINC || node->type == NODE_PREDEC;
+
+	lvalue_t target = lower_lvalue(ctx, node->as.incdec.expr_ref);
+	ir_value_t old_var = lvalue_load(ctx, &target);
+
+	qbe_value_type_t op_type = qbe_basetype_from_type(type);
+	int64_t step = type->kind == TYPE_PTR ? (int64_t)type_size(type_deref(type)) : 1;
+	ir_value_t new_var = ctx_emit_binary(ctx, is_increment ? IR_ADD : IR_SUB, op_type, old_var, ir_const(op_type, step));
+	lvalue_store(ctx, &target, new_var);
+
+	if (!is_prefix) {
+		ctx->result_var = old_var;
+		return;
+	}
+
+	// The value of ++x is what was stored, so narrow types wrap like the store did
+	if (type_size(type) < type_size(int_type)) {
+		ir_value_t stored_var = ctx_new_temp(ctx, qbe_type_from_type(type));
+		ir_emit(ctx->func, (ir_instr_t) {
+			.op = IR_EXT,
+			.type = op_type,
+			.arg_type = qbe_type_from_type(type),
+			.result = stored_var,
+			.args = { new_var },
+		});
+		new_var = stored_var;
+	}
+	ctx->result_var = new_var;
+}
+
+static void lower_function(codegen_ctx_t *ctx, node_ref_t node_ref) {
+	node_t node = node_ref_get(node_ref);
+	node_t signature_node = node_ref_get(node.as.function.signature_ref);
+	ctx->function_return_type = ctx_type(ctx, node_ref)->as.func.return_type;
+
+	ir_func_t func;
+	ir_func_init(&func, signature_node.as.function_signature.name, qbe_type_from_type(ctx->function_return_type));
+	ctx->func = &func;
+
+	// Copy parameters to stack
+	for (size_t i = 0; i < signature_node.as.function_signature.parameters.length; i++) {
+		node_ref_t param_ref = node_list_at(signature_node.as.function_signature.parameters, i);
+		const type_t *param_type = ctx_type(ctx, param_ref);
+
+		if (param_type->kind == TYPE_VARARGS) {
+			// TODO: Do we need to copy varargs to stack or something?
+			ir_add_param(&func, QBE_VALUE_VARARGS, NAME_NONE);
+			continue;
+		}
+
+		ir_value_t param_input_var = ir_add_param(&func, qbe_type_from_type(param_type), ctx_symbol(ctx, param_ref)->name);
+		ir_value_t param_var = ctx_declare_local(ctx, param_ref, param_type, type_size(param_type), false);
+		ctx_emit_store(ctx, qbe_basetype_from_type(param_type), param_input_var, param_var);
+	}
+
+	// Returns store their value and jump to a shared block that returns it
+	ctx->return_var = null_var;
+	if (ctx->function_return_type != void_type) {
+		ctx->return_var = ctx_new_temp(ctx, qbe_type_from_type(ctx->function_return_type));
+	}
+	ctx->end_block = ir_new_block(&func);
+
+	lower_node(ctx, node.as.function.body_ref, false);
+
+	ir_place_block(&func, ctx->end_block);
+	ir_ret(&func, ctx->return_var);
+
+	ssa_construct(&func);
+
+	list_push(&ctx->module->funcs, &func);
+	ctx->func = NULL;
+}
+
+// Builds the instructions computing node_ref and leaves its value in ctx->result_var. Types and
+// symbols come from the semantic pass, so every error has already been reported.
+static void lower_node(codegen_ctx_t *ctx, node_ref_t node_ref, bool emit_lvalue) {
+	node_t node = node_ref_get(node_ref);
+	const type_t *type = ctx_type(ctx, node_ref);
+
+	// Folded by the semantic pass, constant expressions have no side effects to emit
+	const node_info_t *info = ctx_info(ctx, node_ref);
+	if (info->is_constant && !emit_lvalue) {
+		ctx->result_var = ir_const(qbe_type_from_type(type), info->constant);
+		return;
+	}
+
+	switch (node.type) {
+		case NODE_BLOCK:
+			ir_enter_scope(ctx->func);
+			for (size_t i = 0; i < node.as.block.length; i++) {
+				lower_node(ctx, node_list_at(node.as.block, i), false);
+			}
+			ir_leave_scope(ctx->func);
+			break;
+		case NODE_VAR_DECL: {
+			// Allocate stack space, fixed size locals get a slot in the frame
+			ir_value_t var;
+			if (type->kind != TYPE_ARRAY) {
+				var = ctx_declare_local(ctx, node_ref, type, type_size(type), false);
+			} else {
+				lower_node(ctx, node.as.var_decl.array_size_expr_ref, false);
+				ir_value_t elem_count_var = ctx->result_var;
+				convert_value(ctx, node.as.var_decl.array_size_expr_ref, &elem_count_var);
+
+				size_t elem_size = type_size(type_deref(type));
+				if (elem_count_var.kind == IR_VALUE_CONST) {
+					var = ctx_declare_local(ctx, node_ref, type, (size_t)elem_count_var.as.constant * elem_size, false);
+				} else {
+					// Variable length arrays are sized when the declaration runs, so they're
+					// allocated right here and every execution takes new stack space. They're
+					// aligned like any array that may be 16 bytes or larger.
+					var = ctx_declare_local(ctx, node_ref, type, 0, true);
+					ir_value_t alloc_size = ctx_emit_binary(ctx, IR_MUL, QBE_VALUE_LONG, elem_count_var, ir_const(QBE_VALUE_LONG, (int64_t)elem_size));
+					ir_emit(ctx->func, (ir_instr_t) {
+						.op = ir_alloc_op(16),
+						.type = QBE_VALUE_LONG,
+						.result = var,
+						.args = { alloc_size },
+					});
+				}
+			}
+
+			if (!node_ref_is_null(node.as.var_decl.init_expr_ref)) {
+				lower_node(ctx, node.as.var_decl.init_expr_ref, false);
+				ir_value_t init_var = ctx->result_var;
+				convert_value(ctx, node.as.var_decl.init_expr_ref, &init_var);
+
+				ctx_emit_store(ctx, qbe_type_from_type(type), init_var, var);
+			}
+		} break;
+		case NODE_ASSIGNMENT: {
+			lvalue_t target = lower_lvalue(ctx, node.as.binop.left_ref);
+			lower_node(ctx, node.as.binop.right_ref, false);
+			lvalue_store(ctx, &target, ctx->result_var);
+		} break;
+		case NODE_ADD:
+		case NODE_SUB:
+		case NODE_MULT:
+		case NODE_DIV: {
+			ir_value_t left_var, right_var;
+			lower_operands(ctx, &node, &left_var, &right_var);
+
+			ir_op_t op;
+			switch (node.type) {
+				case NODE_ADD:
+					op = IR_ADD;
+					break;
+				case NODE_SUB:
+					op = IR_SUB;
+					break;
+				case NODE_MULT:
+					op = IR_MUL;
+					break;
+				case NODE_DIV:
+					op = IR_DIV;
+					break;
+				default:
+					unreachable();
+			}
+			ctx->result_var = ctx_emit_binary(ctx, op, qbe_type_from_type(type), left_var, right_var);
+		} break;
+		case NODE_INTLIT:
+		case NODE_CHARLIT:
+			// Literals are always folded, and the semantic pass rejects them as lvalues
+			unreachable();
+		case NODE_IDENTIFIER: {
+			// Always emit pointer for functions, never implicitly dereference them
+			if (type->kind == TYPE_FUNC) {
+				emit_lvalue = true;
+			}
+
+			// For local arrays, if you reference them, you should get a pointer to the first element.
+			if (type->kind == TYPE_ARRAY) {
+				emit_lvalue = true;
+			}
+
+			ir_value_t var = ctx_symbol_var(ctx, node_ref);
+
+			if (emit_lvalue) {
+				// Just return the address
+				ctx->result_var = var;
+			} else {
+				ctx->result_var = ctx_emit_load(ctx, type, var);
+			}
+		} break;
+		case NODE_FUNCTION:
+			if (node_ref_is_null(node.as.function.body_ref)) {
+				// Declaration only
+				break;
+			}
+			lower_function(ctx, node_ref);
+			break;
+		case NODE_RETURN: {
+			// Store the return value, the end block returns it
+			if (!node_ref_is_null(node.as.ret.expr_ref)) {
+				lower_node(ctx, node.as.ret.expr_ref, false);
+
+				const type_t *expr_type = ctx_type(ctx, node.as.ret.expr_ref);
+				if (expr_type != void_type) {
+					ir_emit(ctx->func, (ir_instr_t) {
+						.op = IR_COPY,
+						.type = qbe_type_from_type(expr_type),
+						.result = ctx->return_var,
+						.args = { ctx->result_var },
+					});
+				}
+			}
+			ir_jmp(ctx->func, ctx->end_block);
+		} break;
+		case NODE_CAST: {
+			lower_node(ctx, node.as.cast.expr_ref, false);
+			ir_value_t expr_var = ctx->result_var;
+			const type_t *expr_type = ctx_type(ctx, node.as.cast.expr_ref);
+
+			qbe_value_type_t target_qbe_type = qbe_type_from_type(type);
+
+			// If the cast is unnecessary, just copy instead of casting
+			ir_op_t op = target_qbe_type == qbe_type_from_type(expr_type) ? IR_COPY : IR_CAST;
+			ctx->result_var = ctx_new_temp(ctx, target_qbe_type);
+			ir_emit(ctx->func, (ir_instr_t) {
+				.op = op,
+				.type = target_qbe_type,
+				.result = ctx->result_var,
+				.args = { expr_var },
+			});
+		} break;
+		case NODE_ADDRESS_OF:
+			lower_node(ctx, node.as.address_of.expr_ref, true);
+			break;
+		case NODE_DEREF: {
+			lower_node(ctx, node.as.deref.expr_ref, false);
+
+			if (emit_lvalue) {
+				// Don't dereference if we want the lvalue
+				break;
+			}
+
+			ctx->result_var = ctx_emit_load(ctx, type, ctx->result_var);
+		} break;
+		case NODE_NEQ:
+		case NODE_EQEQ: {
+			ir_value_t left_var, right_var;
+			lower_operands(ctx, &node, &left_var, &right_var);
+			const type_t *operand_type = ctx_info(ctx, node.as.binop.left_ref)->converted_type;
+
+			ctx->result_var = ctx_new_temp(ctx, QBE_VALUE_WORD);
+			ir_emit(ctx->func, (ir_instr_t) {
+				.op = node.type == NODE_EQEQ ? IR_CEQ : IR_CNE,
+				.type = QBE_VALUE_WORD,
+				.arg_type = qbe_type_from_type(operand_type),
+				.result = ctx->result_var,
+				.args = { left_var, right_var },
+			});
+		} break;
+		case NODE_IF: {
+			lower_node(ctx, node.as.if_.expr_ref, false);
+			ir_value_t cond_var = ctx->result_var;
+
+			ir_block_id_t then_block = ir_new_block(ctx->func);
+			ir_block_id_t end_block = ir_new_block(ctx->func);
+
+			if (node_ref_is_null(node.as.if_.else_ref)) {
+				ir_jnz(ctx->func, cond_var, then_block, end_block);
+				ir_place_block(ctx->func, then_block);
+				lower_node(ctx, node.as.if_.then_ref, false);
+			} else {
+				ir_block_id_t else_block = ir_new_block(ctx->func);
+
+				ir_jnz(ctx->func, cond_var, then_block, else_block);
+				ir_place_block(ctx->func, then_block);
+				lower_node(ctx, node.as.if_.then_ref, false);
+				ir_jmp(ctx->func, end_block);
+				ir_place_block(ctx->func, else_block);
+				lower_node(ctx, node.as.if_.else_ref, false);
+			}
+			ir_place_block(ctx->func, end_block);
+		} break;
+		case NODE_CALL: {
+			size_t arg_count = node.as.call.arg_refs.length;
+			ir_value_t *arg_vars = arg_count > 0 ? malloc(arg_count * sizeof(ir_value_t)) : NULL;
+			assert(arg_count == 0 || arg_vars != NULL);
+			for (size_t i = 0; i < arg_count; i++) {
+				lower_node(ctx, node_list_at(node.as.call.arg_refs, i), false);
+				arg_vars[i] = ctx->result_var;
+			}
+
+			lower_node(ctx, node.as.call.function_ref, true);
+			ir_value_t function_var = ctx->result_var;
+
+			for (size_t i = 0; i < arg_count; i++) {
+				convert_value(ctx, node_list_at(node.as.call.arg_refs, i), &arg_vars[i]);
+			}
+
+			qbe_value_type_t return_qbe_type = qbe_type_from_type(type);
+			ctx->result_var = return_qbe_type != QBE_VALUE_VOID ? ctx_new_temp(ctx, return_qbe_type) : null_var;
+			ir_emit(ctx->func, (ir_instr_t) {
+				.op = IR_CALL,
+				.type = return_qbe_type,
+				.result = ctx->result_var,
+				.args = { function_var },
+				.call_args = arg_vars,
+				.call_arg_count = arg_count,
+			});
+		} break;
+		case NODE_DISCARD:
+			lower_node(ctx, node.as.discard.expr_ref, false);
+			ctx->result_var = null_var;
+			break;
+		case NODE_STRINGLIT: {
+			// Tails of a longer literal point into its data
+			strpool_ref_t ref = strpool_get(ctx->strings, node.as.stringlit);
+			ctx->result_var = ir_data(ref.data);
+			if (ref.offset != 0) {
+				ctx->result_var = ctx_emit_binary(ctx, IR_ADD, QBE_VALUE_LONG, ctx->result_var, ir_const(QBE_VALUE_LONG, (int64_t)ref.offset));
+			}
+		} break;
+		case NODE_WHILE: {
+			ir_block_id_t cond_block = ir_new_block(ctx->func);
+			ir_block_id_t start_block = ir_new_block(ctx->func);
+			ir_block_id_t end_block = ir_new_block(ctx->func);
+
+			loop_t loop = {
+				.continue_block = cond_block,
+				.break_block = end_block,
+			};
+			list_push(&ctx->loop_stack, &loop);
+
+			ir_place_block(ctx->func, cond_block);
+			lower_node(ctx, node.as.while_.expr_ref, false);
+			ir_jnz(ctx->func, ctx->result_var, start_block, end_block);
+			ir_place_block(ctx->func, start_block);
+			lower_node(ctx, node.as.while_.body_ref, false);
+			ir_jmp(ctx->func, cond_block);
+			ir_place_block(ctx->func, end_block);
+
+			list_pop(&ctx->loop_stack);
+		} break;
+		case NODE_PLUSEQ:
+		case NODE_MINUSEQ:
+		case NODE_MULTEQ:
+		case NODE_DIVEQ: {
+			if (emit_lvalue) {
+				unreachable();
+			}
+
+			ir_op_t op;
+			switch (node.type) {
+				case NODE_PLUSEQ:
+					op = IR_ADD;
+					break;
+				case NODE_MINUSEQ:
+					op = IR_SUB;
+					break;
+				case NODE_MULTEQ:
+					op = IR_MUL;
+					break;
+				case NODE_DIVEQ:
+					op = IR_DIV;
+					break;
+				default:
+					unreachable();
+			}
+			lower_compound_assignment(ctx, &node, op);
+		} break;
+		case NODE_GT:
+		case NODE_LT:
+		case NODE_LTE: {
+			ir_value_t left_var, right_var;
+			lower_operands(ctx, &node, &left_var, &right_var);
+			const type_t *operand_type = ctx_info(ctx, node.as.binop.left_ref)->converted_type;
+
+			ir_op_t op;
+			switch (node.type) {
+				case NODE_GT:
+					op = IR_CSGT;  // TODO: Handle signed vs unsigned
+					break;
+				case NODE_LT:
+					op = IR_CSLT;  // TODO: Handle signed vs unsigned
+					break;
+				case NODE_LTE:
+					op = IR_CSLE;  // TODO: Handle signed vs unsigned
+					break;
+				default:
+					unreachable();
+			}
+
+			ctx->result_var = ctx_new_temp(ctx, QBE_VALUE_WORD);
+			ir_emit(ctx->func, (ir_instr_t) {
+				.op = op,
+				.type = QBE_VALUE_WORD,
+				.arg_type = qbe_basetype_from_type(operand_type),
+				.result = ctx->result_var,
+				.args = { left_var, right_var },
+			});
+		} break;
+		case NODE_NEGATE: {
+			lower_node(ctx, node.as.negate.expr_ref, false);
+			ir_value_t expr_var = ctx->result_var;
+
+			ctx->result_var = ctx_new_temp(ctx, qbe_type_from_type(type));
+			ir_emit(ctx->func, (ir_instr_t) {
+				.op = IR_NEG,
+				.type = qbe_type_from_type(type),
+				.result = ctx->result_var,
+				.args = { expr_var },
+			});
+		} break;
+		case NODE_INDEX: {
+			lower_node(ctx, node.as.index.expr_ref, false);
+			ir_value_t array_var = ctx->result_var;
+			lower_node(ctx, node.as.index.index_ref, false);
+			ir_value_t index_var = ctx->result_var;
+			convert_value(ctx, node.as.index.index_ref, &index_var);
+
+			// Add and then deref if not lvalue
+			ir_value_t elem_size = ir_const(QBE_VALUE_LONG, (int64_t)type_size(type));
+			ir_value_t scaled_index_var;
+			if (index_var.kind == IR_VALUE_CONST) {
+				scaled_index_var = ir_const(QBE_VALUE_LONG, index_var.as.constant * elem_size.as.constant);
+			} else {
+				scaled_index_var = ctx_emit_binary(ctx, IR_MUL, QBE_VALUE_LONG, index_var, elem_size);
+			}
+			// Element 0 is at the address of the array itself
+			ir_value_t element_ptr_var = array_var;
+			if (scaled_index_var.kind != IR_VALUE_CONST || scaled_index_var.as.constant != 0) {
+				element_ptr_var = ctx_emit_binary(ctx, IR_ADD, QBE_VALUE_LONG, array_var, scaled_index_var);
+			}
+
+			if (emit_lvalue) {
+				// Just return the address
+				ctx->result_var = element_ptr_var;
+			} else {
+				ctx->result_var = ctx_emit_load(ctx, type, element_ptr_var);
+			}
+		} break;
+		case NODE_POSTINC:
+		case NODE_POSTDEC:
+		case NODE_PREINC:
+		case NODE_PREDEC:
+			if (emit_lvalue) {
+				unreachable();
+			}
+			lower_incdec(ctx, &node, type);
+			break;
+		case NODE_EMPTY_STMT:
+			ctx->result_var = null_var;
+			break;
+		case NODE_BREAK:
+			ir_jmp(ctx->func, list_at(&ctx->loop_stack, loop_t, ctx->loop_stack.length - 1)->break_block);
+			ctx->result_var = null_var;
+			break;
+		case NODE_CONTINUE:
+			ir_jmp(ctx->func, list_at(&ctx->loop_stack, loop_t, ctx->loop_stack.length - 1)->continue_block);
+			ctx->result_var = null_var;
+			break;
+		case NODE_FOR: {
+			ir_block_id_t cond_block = ir_new_block(ctx->func);
+			ir_block_id_t start_block = ir_new_block(ctx->func);
+			ir_block_id_t end_block = ir_new_block(ctx->func);
+			ir_block_id_t update_block = ir_new_block(ctx->func);
+
+			// Update block falls through to condition check, on first enter we go straight to condition, after that, any continues will go to update
+			loop_t loop = {
+				.continue_block = update_block,
+				.break_block = end_block,
+			};
+			list_push(&ctx->loop_stack, &loop);
+			ir_enter_scope(ctx->func);
+
+			lower_node(ctx, node.as.for_.init_stmt_ref, false);
+
+			ir_jmp(ctx->func, cond_block);
+
+			ir_place_block(ctx->func, update_block);
+			lower_node(ctx, node.as.for_.update_expr_ref, false);
+
+			ir_place_block(ctx->func, cond_block);
+			lower_node(ctx, node.as.for_.cond_expr_ref, false);
+			ir_jnz(ctx->func, ctx->result_var, start_block, end_block);
+			ir_place_block(ctx->func, start_block);
+			lower_node(ctx, node.as.for_.body_ref, false);
+			ir_jmp(ctx->func, update_block);
+			ir_place_block(ctx->func, end_block);
+
+			ir_leave_scope(ctx->func);
+			list_pop(&ctx->loop_stack);
+		} break;
+		case NODE_ANDAND: {
+			// If both operands are nonzero, result is 1, otherwise 0. If first operand is zero, second operand is not evaluated.
+
+			// TODO: Ensure the types used for temporaries here are correct
+			ir_value_t result_var = ctx_new_temp(ctx, QBE_VALUE_WORD);
+			ir_emit(ctx->func, (ir_instr_t) {
+				.op = IR_COPY,
+				.type = result_var.type,
+				.result = result_var,
+				.args = { ir_const(QBE_VALUE_WORD, 0) },  // Default to false
+			});
+
+			ir_block_id_t end_block = ir_new_block(ctx->func);
+
+			lower_node(ctx, node.as.binop.left_ref, false);
+			ir_value_t left_var = ctx->result_var;
+
+			ir_block_id_t fallthrough_block = ir_new_block(ctx->func);
+
+			ir_jnz(ctx->func, left_var, fallthrough_block, end_block);
+
+			ir_place_block(ctx->func, fallthrough_block);
+
+			lower_node(ctx, node.as.binop.right_ref, false);
+			ir_value_t right_var = ctx->result_var;
+
+			// Copy right var into result
+			ir_emit(ctx->func, (ir_instr_t) {
+				.op = IR_COPY,
+				.type = result_var.type,
+				.result = result_var,
+				.args = { right_var },
+			});
+			ir_place_block(ctx->func, end_block);
+
+			ctx->result_var = result_var;
+		} break;
+		default:
+			unreachable();
+	}
+}
+
+typedef struct {
+	const analysis_t *analysis;
+	ir_temp_id_t *local_temps;
+	strpool_t strings;
+	codegen_unit_t *units;
+	size_t unit_count;
+	atomic_size_t next_unit;
+} codegen_job_t;
+
+static void lower_unit(codegen_job_t *job, codegen_unit_t *unit) {
+	ir_module_t module;
+	ir_module_init(&module);
+	codegen_ctx_t ctx = {
+		.analysis = job->analysis,
+		.local_temps = job->local_temps,
+		.strings = &job->strings,
+		.module = &module,
+		.loop_stack = { .element_size = sizeof(loop_t) },
+	};
+	lower_node(&ctx, unit->node_ref, false);
+	list_clear(&ctx.loop_stack);
+
+	ir_module_print(&module, &unit->text);
+	ir_module_add_stats(&module, &unit->stats);
+	ir_module_free(&module);
+}
+
+static void *codegen_worker(void *arg) {
+	codegen_job_t *job = arg;
+	for (;;) {
+		size_t unit_index = atomic_fetch_add(&job->next_unit, 1);
+		if (unit_index >= job->unit_count) {
+			return NULL;
+		}
+		lower_unit(job, &job->units[unit_index]);
+	}
+}
+
+bool codegen(node_ref_t root_ref, const analysis_t *analysis, const char *out_path, size_t jobs, ir_stats_t *stats) {
+	node_t root = node_ref_get(root_ref);
+	assert(root.type == NODE_FILE);
+	assert(jobs > 0);
+
+	int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out_fd < 0) {
+		todo("Handle file open error");
+	}
+
+	codegen_job_t job = {
+		.analysis = analysis,
+		.local_temps = calloc(analysis->symbols.length, sizeof(ir_temp_id_t)),
+		.units = calloc(root.as.file.top_levels.length, sizeof(codegen_unit_t)),
+		.unit_count = root.as.file.top_levels.length,
+	};
+	assert(job.local_temps != NULL);
+	assert(job.unit_count == 0 || job.units != NULL);
+	for (size_t i = 0; i < job.unit_count; i++) {
+		job.units[i].node_ref = node_list_at(root.as.file.top_levels, i);
+	}
+	atomic_init(&job.next_unit, 0);
+
+	// Literals are pooled up front so every unit sees the same data. Nodes without a type were
+	// dropped by the parser and are never lowered.
+	strpool_init(&job.strings);
+	for (size_t i = 1; i < ast_node_count(); i++) {
+		node_ref_t node_ref = { .index = (uint32_t)i };
+		if (node_ref_type(node_ref) == NODE_STRINGLIT && analysis_info(analysis, node_ref)->type != NULL) {
+			strpool_add(&job.strings, node_ref_get(node_ref).as.stringlit);
+		}
+	}
+	strpool_finish(&job.strings);
+
+	// The calling thread works too, so jobs == 1 never starts a thread
+	size_t thread_count = jobs - 1 < job.unit_count ? jobs - 1 : job.unit_count;
+	pthread_t threads[thread_count + 1];
+	for (size_t i = 0; i < thread_count; i++) {
+		if (pthread_create(&threads[i], NULL, codegen_worker, &job) != 0) {
+			thread_count = i;
+			break;
+		}
+	}
+	codegen_worker(&job);
+	for (size_t i = 0; i < thread_count; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	// Units are written in source order, so the output doesn't depend on scheduling. The string
+	// data goes after all the functions.
+	outbuf_t *bufs = malloc((job.unit_count + 1) * sizeof(outbuf_t));
+	assert(bufs != NULL);
+	for (size_t i = 0; i < job.unit_count; i++) {
+		bufs[i] = job.units[i].text;
+		if (stats != NULL) {
+			stats->funcs += job.units[i].stats.funcs;
+			stats->blocks += job.units[i].stats.blocks;
+			stats->instrs += job.units[i].stats.instrs;
+			stats->temps += job.units[i].stats.temps;
+		}
+	}
+	bufs[job.unit_count] = (outbuf_t) { 0 };
+	strpool_print(&job.strings, &bufs[job.unit_count]);
+	bool ok = outbuf_flush_all(out_fd, bufs, job.unit_count + 1);
+	for (size_t i = 0; i < job.unit_count + 1; i++) {
+		outbuf_free(&bufs[i]);
+	}
+	free(bufs);
+
+	free(job.units);
+	free(job.local_temps);
+	strpool_free(&job.strings);
+	if (close(out_fd) != 0 || !ok) {
+		todo("Handle file write error");
+	}
+	return true;
+}
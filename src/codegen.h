@@ -0,0 +1,8 @@
+#pragma once
+
+#include "scc.h"
+
+// Lowers an analyzed AST to QBE IR written to out_path. Top level nodes are lowered on up to
+// jobs threads, the output is the same for any number of jobs. Counts of what was built are added to
+// stats unless it's NULL.
+bool codegen(node_ref_t root_ref, const analysis_t *analysis, const char *out_path, size_t jobs, ir_stats_t *stats);
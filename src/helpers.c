@@ -2,7 +2,9 @@
 
 char *read_file(const char *path) {
     FILE *file = fopen(path, "rb");
-    assert(file != NULL);
+    if (file == NULL) {
+        return NULL;
+    }
 
     fseek(file, 0, SEEK_END);
     long file_size = ftell(file);
@@ -36,14 +36,18 @@
 // TODO: DEPRECATE
 #define report_error(source_loc, msg, ...) \
     do { \
+        resolved_loc_t _loc = source_loc_resolve(source_loc); \
         fprintf(stderr, "ERROR: %s:%zu:%zu: " msg "\n", \
-                source_loc.file_name, source_loc.line, source_loc.column, ##__VA_ARGS__); \
+                _loc.file_name, _loc.line, _loc.column, ##__VA_ARGS__); \
         exit(1); \
     } while (0)
 
 #define report_start(source_loc, msg, ...) \
-    fprintf(stderr, "ERROR: %s:%zu:%zu: " msg, \
-            source_loc.file_name, source_loc.line, source_loc.column, ##__VA_ARGS__)
+    do { \
+        resolved_loc_t _loc = source_loc_resolve(source_loc); \
+        fprintf(stderr, "ERROR: %s:%zu:%zu: " msg, \
+                _loc.file_name, _loc.line, _loc.column, ##__VA_ARGS__); \
+    } while (0)
 
 #define report_line(msg, ...) \
     fprintf(stderr, "        " msg, ##__VA_ARGS__)
@@ -0,0 +1,176 @@
+#include "scc.h"
+
+void image_write_bytes(image_writer_t *writer, const void *bytes, size_t length) {
+    if (writer->length + length > writer->capacity) {
+        size_t capacity = writer->capacity == 0 ? 4096 : writer->capacity;
+        while (writer->length + length > capacity) {
+            capacity *= 2;
+        }
+        char *new_bytes = realloc(writer->bytes, capacity);
+        assert(new_bytes != NULL);
+        writer->bytes = new_bytes;
+        writer->capacity = capacity;
+    }
+    memcpy(writer->bytes + writer->length, bytes, length);
+    writer->length += length;
+}
+
+void image_write_u8(image_writer_t *writer, uint8_t value) {
+    image_write_bytes(writer, &value, sizeof(value));
+}
+
+void image_write_u32(image_writer_t *writer, uint32_t value) {
+    image_write_bytes(writer, &value, sizeof(value));
+}
+
+void image_write_u64(image_writer_t *writer, uint64_t value) {
+    image_write_bytes(writer, &value, sizeof(value));
+}
+
+void image_write_sv(image_writer_t *writer, sv_t sv) {
+    assert(sv.length <= UINT32_MAX);
+    image_write_u32(writer, (uint32_t)sv.length);
+    image_write_bytes(writer, sv.string, sv.length);
+}
+
+bool image_save(const image_writer_t *writer, const char *path) {
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool written = fwrite(writer->bytes, 1, writer->length, file) == writer->length;
+    written &= fclose(file) == 0;
+
+    if (!written || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+void image_writer_free(image_writer_t *writer) {
+    free(writer->bytes);
+    *writer = (image_writer_t){ 0 };
+}
+
+bool image_open(image_reader_t *reader, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    *reader = (image_reader_t){ .bytes = mapping, .length = st.st_size };
+    return true;
+}
+
+void image_close(image_reader_t *reader) {
+    munmap((void *)reader->bytes, reader->length);
+    *reader = (image_reader_t){ 0 };
+}
+
+const void *image_read_bytes(image_reader_t *reader, size_t length) {
+    if (reader->failed || reader->length - reader->offset < length) {
+        reader->failed = true;
+        return NULL;
+    }
+    const void *bytes = reader->bytes + reader->offset;
+    reader->offset += length;
+    return bytes;
+}
+
+#define define_image_read(name, type) \
+    type name(image_reader_t *reader) { \
+        const void *bytes = image_read_bytes(reader, sizeof(type)); \
+        type value = 0; \
+        if (bytes != NULL) { \
+            memcpy(&value, bytes, sizeof(type)); \
+        } \
+        return value; \
+    }
+
+define_image_read(image_read_u8, uint8_t)
+define_image_read(image_read_u32, uint32_t)
+define_image_read(image_read_u64, uint64_t)
+
+sv_t image_read_sv(image_reader_t *reader) {
+    uint32_t length = image_read_u32(reader);
+    const char *string = image_read_bytes(reader, length);
+    if (string == NULL) {
+        return (sv_t){ .string = "", .length = 0 };
+    }
+    return (sv_t){ .string = string, .length = length };
+}
+
+uint64_t image_hash(uint64_t seed, const void *bytes, size_t length) {
+    uint64_t hash = seed;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= ((const unsigned char *)bytes)[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+const char *image_compiler_version(void) {
+    // The build time stands in for a version while the image formats are still changing
+    return "scc " SCC_VERSION " (" __DATE__ " " __TIME__ ")";
+}
+
+// mkdir -p
+static bool make_dirs(char *path) {
+    for (char *p = path + 1; *p != '\0'; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        bool ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+        *p = '/';
+        if (!ok) {
+            return false;
+        }
+    }
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+const char *image_cache_dir(void) {
+    static bool resolved = false;
+    static char dir[4096];
+    static const char *result = NULL;
+    if (resolved) {
+        return result;
+    }
+    resolved = true;
+
+    const char *env = getenv("SCC_CACHE_DIR");
+    if (env != NULL) {
+        if (env[0] == '\0') {
+            return NULL;
+        }
+        snprintf(dir, sizeof(dir), "%s", env);
+    } else {
+        const char *home = getenv("HOME");
+        if (home == NULL || home[0] == '\0') {
+            return NULL;
+        }
+        snprintf(dir, sizeof(dir), "%s/.cache/scc", home);
+    }
+
+    if (make_dirs(dir)) {
+        result = dir;
+    }
+    return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "scc.h"
+
+#define SCC_VERSION "0.1.0"
+
+// Binary images cached on disk between compiles. Images are only ever read back by the
+// same compiler build, so values are stored in native byte order.
+
+typedef struct {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+} image_writer_t;
+
+void image_write_bytes(image_writer_t *writer, const void *bytes, size_t length);
+void image_write_u8(image_writer_t *writer, uint8_t value);
+void image_write_u32(image_writer_t *writer, uint32_t value);
+void image_write_u64(image_writer_t *writer, uint64_t value);
+void image_write_sv(image_writer_t *writer, sv_t sv);
+// Writes to a temporary file and renames it into place, so readers never see a partial image
+bool image_save(const image_writer_t *writer, const char *path);
+void image_writer_free(image_writer_t *writer);
+
+typedef struct {
+    const char *bytes;
+    size_t length;
+    size_t offset;
+    bool failed;  // set by reads past the end, which return zeros
+} image_reader_t;
+
+bool image_open(image_reader_t *reader, const char *path);
+void image_close(image_reader_t *reader);
+const void *image_read_bytes(image_reader_t *reader, size_t length);
+uint8_t image_read_u8(image_reader_t *reader);
+uint32_t image_read_u32(image_reader_t *reader);
+uint64_t image_read_u64(image_reader_t *reader);
+sv_t image_read_sv(image_reader_t *reader);
+
+// FNV-1a, chain calls by passing the previous hash as seed
+#define IMAGE_HASH_SEED 14695981039346656037ull
+uint64_t image_hash(uint64_t seed, const void *bytes, size_t length);
+
+// Identifies the compiler build, images written by other builds are never used
+const char *image_compiler_version(void);
+
+// $SCC_CACHE_DIR, or ~/.cache/scc. NULL if caching is disabled by an empty SCC_CACHE_DIR
+// or the directory cannot be created.
+const char *image_cache_dir(void);
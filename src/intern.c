@@ -0,0 +1,136 @@
+#include "scc.h"
+
+#define INTERN_CHUNK_SIZE (64 * 1024)
+
+typedef struct intern_chunk_t intern_chunk_t;
+struct intern_chunk_t {
+    intern_chunk_t *next;
+    size_t used;
+    size_t capacity;
+    char bytes[];
+};
+
+typedef struct {
+    const char *string;
+    uint32_t length;
+    uint32_t hash;
+} intern_entry_t;
+
+typedef struct {
+    intern_chunk_t *chunks;
+    list_t entries;    // intern_entry_t, indexed by name_t
+    name_t *slots;     // open addressing, NAME_NONE marks an empty slot
+    size_t slot_count; // always a power of two
+} interner_t;
+
+static interner_t interner = {
+    .entries = { .element_size = sizeof(intern_entry_t) },
+};
+
+static uint32_t hash_sv(sv_t sv) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sv.length; i++) {
+        hash ^= (unsigned char)sv.string[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Copies the string into the arena, strings never move once stored
+static const char *arena_store(sv_t sv) {
+    size_t size = sv.length + 1;
+    intern_chunk_t *chunk = interner.chunks;
+    if (chunk == NULL || chunk->capacity - chunk->used < size) {
+        size_t capacity = size > INTERN_CHUNK_SIZE ? size : INTERN_CHUNK_SIZE;
+        intern_chunk_t *new_chunk = malloc(sizeof(intern_chunk_t) + capacity);
+        assert(new_chunk != NULL);
+        new_chunk->next = chunk;
+        new_chunk->used = 0;
+        new_chunk->capacity = capacity;
+        interner.chunks = chunk = new_chunk;
+    }
+
+    char *string = chunk->bytes + chunk->used;
+    memcpy(string, sv.string, sv.length);
+    string[sv.length] = '\0';
+    chunk->used += size;
+    return string;
+}
+
+static void grow_slots(void) {
+    size_t slot_count = interner.slot_count == 0 ? 256 : interner.slot_count * 2;
+    name_t *slots = calloc(slot_count, sizeof(name_t));
+    assert(slots != NULL);
+
+    for (size_t i = 0; i < interner.slot_count; i++) {
+        name_t name = interner.slots[i];
+        if (name == NAME_NONE) {
+            continue;
+        }
+        size_t slot = list_at(&interner.entries, intern_entry_t, name)->hash & (slot_count - 1);
+        while (slots[slot] != NAME_NONE) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = name;
+    }
+
+    free(interner.slots);
+    interner.slots = slots;
+    interner.slot_count = slot_count;
+}
+
+name_t intern(sv_t sv) {
+    if (sv.length == 0) {
+        return NAME_NONE;
+    }
+
+    if (interner.entries.length == 0) {
+        // Reserve id 0 for NAME_NONE
+        intern_entry_t none = { .string = "" };
+        list_push(&interner.entries, &none);
+    }
+
+    // Keep the load factor below 1/2
+    if ((interner.entries.length + 1) * 2 > interner.slot_count) {
+        grow_slots();
+    }
+
+    uint32_t hash = hash_sv(sv);
+    size_t slot = hash & (interner.slot_count - 1);
+    while (interner.slots[slot] != NAME_NONE) {
+        intern_entry_t *entry = list_at(&interner.entries, intern_entry_t, interner.slots[slot]);
+        if (entry->hash == hash && entry->length == sv.length && memcmp(entry->string, sv.string, sv.length) == 0) {
+            return interner.slots[slot];
+        }
+        slot = (slot + 1) & (interner.slot_count - 1);
+    }
+
+    assert(sv.length <= UINT32_MAX);
+    intern_entry_t entry = {
+        .string = arena_store(sv),
+        .length = (uint32_t)sv.length,
+        .hash = hash,
+    };
+    name_t name = (name_t)interner.entries.length;
+    list_push(&interner.entries, &entry);
+    interner.slots[slot] = name;
+    return name;
+}
+
+name_t intern_cstr(const char *cstr) {
+    return intern(sv_from_cstr(cstr));
+}
+
+sv_t name_sv(name_t name) {
+    if (name == NAME_NONE) {
+        return (sv_t){ .string = "", .length = 0 };
+    }
+    assert(name < interner.entries.length);
+    intern_entry_t *entry = list_at(&interner.entries, intern_entry_t, name);
+    return (sv_t){ .string = entry->string, .length = entry->length };
+}
+
+const char *name_cstr(name_t name) {
+    return name_sv(name).string;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "scc.h"
+
+// Dense id of an interned string, equal names always get the same id
+typedef uint32_t name_t;
+
+#define NAME_NONE ((name_t)0)
+
+name_t intern(sv_t sv);
+name_t intern_cstr(const char *cstr);
+sv_t name_sv(name_t name);
+const char *name_cstr(name_t name);
@@ -0,0 +1,559 @@
+#include "scc.h"
+
+void ir_module_init(ir_module_t *module) {
+	*module = (ir_module_t) {
+		.funcs = { .element_size = sizeof(ir_func_t) },
+	};
+}
+
+static void ir_func_free(ir_func_t *func) {
+	for (size_t i = 0; i < func->blocks.length; i++) {
+		ir_block_t *block = ir_block(func, i);
+		for (size_t j = 0; j < block->phis.length; j++) {
+			free(list_at(&block->phis, ir_phi_t, j)->args);
+		}
+		for (size_t j = 0; j < block->instrs.length; j++) {
+			free(list_at(&block->instrs, ir_instr_t, j)->call_args);
+		}
+		list_clear(&block->phis);
+		list_clear(&block->instrs);
+	}
+	list_clear(&func->blocks);
+	list_clear(&func->allocs);
+	list_clear(&func->slots);
+	list_clear(&func->live_slots);
+	list_clear(&func->scope_starts);
+	list_clear(&func->layout);
+	list_clear(&func->temps);
+	list_clear(&func->params);
+}
+
+void ir_module_free(ir_module_t *module) {
+	for (size_t i = 0; i < module->funcs.length; i++) {
+		ir_func_free(list_at(&module->funcs, ir_func_t, i));
+	}
+	list_clear(&module->funcs);
+}
+
+void ir_func_init(ir_func_t *func, name_t name, qbe_value_type_t return_type) {
+	*func = (ir_func_t) {
+		.name = name,
+		.return_type = return_type,
+		.params = { .element_size = sizeof(ir_temp_id_t) },
+		.temps = { .element_size = sizeof(ir_temp_t) },
+		.allocs = { .element_size = sizeof(ir_instr_t) },
+		.slots = { .element_size = sizeof(ir_slot_t) },
+		.live_slots = { .element_size = sizeof(size_t) },
+		.scope_starts = { .element_size = sizeof(size_t) },
+		.blocks = { .element_size = sizeof(ir_block_t) },
+		.layout = { .element_size = sizeof(ir_block_id_t) },
+		.current = IR_BLOCK_NONE,
+	};
+	ir_place_block(func, ir_new_block(func));
+}
+
+static ir_value_t ir_add_temp(ir_func_t *func, ir_temp_t temp) {
+	list_push(&func->temps, &temp);
+	return (ir_value_t) {
+		.kind = IR_VALUE_TEMP,
+		.type = temp.type,
+		.as.temp = (ir_temp_id_t)(func->temps.length - 1),
+	};
+}
+
+ir_value_t ir_new_temp(ir_func_t *func, qbe_value_type_t type) {
+	return ir_add_temp(func, (ir_temp_t) {
+		.kind = IR_TEMP_ANON,
+		.type = type,
+	});
+}
+
+ir_value_t ir_new_local(ir_func_t *func, name_t name) {
+	return ir_add_temp(func, (ir_temp_t) {
+		.kind = IR_TEMP_LOCAL,
+		.type = QBE_VALUE_LONG,
+		.name = name,
+	});
+}
+
+ir_value_t ir_new_var(ir_func_t *func, qbe_value_type_t type, name_t name) {
+	return ir_add_temp(func, (ir_temp_t) {
+		.kind = IR_TEMP_VAR,
+		.type = type,
+		.name = name,
+	});
+}
+
+ir_value_t ir_add_param(ir_func_t *func, qbe_value_type_t type, name_t name) {
+	if (type == QBE_VALUE_VARARGS) {
+		func->varargs = true;
+		return (ir_value_t) { .kind = IR_VALUE_NONE, .type = QBE_VALUE_VARARGS };
+	}
+
+	assert(!func->varargs && "Varargs must be the last parameter");
+	ir_value_t param = ir_add_temp(func, (ir_temp_t) {
+		.kind = IR_TEMP_PARAM,
+		.type = type,
+		.name = name,
+	});
+	list_push(&func->params, &param.as.temp);
+	return param;
+}
+
+ir_block_id_t ir_new_block(ir_func_t *func) {
+	ir_block_t block = {
+		.phis = { .element_size = sizeof(ir_phi_t) },
+		.instrs = { .element_size = sizeof(ir_instr_t) },
+	};
+	list_push(&func->blocks, &block);
+	return (ir_block_id_t)(func->blocks.length - 1);
+}
+
+void ir_place_block(ir_func_t *func, ir_block_id_t block) {
+	assert(!ir_block(func, block)->placed && "Blocks can only be placed once");
+
+	if (func->current != IR_BLOCK_NONE) {
+		ir_jmp(func, block);
+	}
+
+	ir_block(func, block)->placed = true;
+	list_push(&func->layout, &block);
+	func->current = block;
+}
+
+// The block code is appended to, after a jump that's a new block nothing can jump to
+static ir_block_t *ir_current_block(ir_func_t *func) {
+	if (func->current == IR_BLOCK_NONE) {
+		ir_place_block(func, ir_new_block(func));
+	}
+	return ir_block(func, func->current);
+}
+
+void ir_emit(ir_func_t *func, ir_instr_t instr) {
+	list_push(&ir_current_block(func)->instrs, &instr);
+}
+
+// Best fit among the free slots: the smallest one that is large and aligned enough, otherwise the
+// largest one, which then has to grow the least
+static size_t ir_find_free_slot(ir_func_t *func, size_t size, size_t align) {
+	size_t best = SIZE_MAX;
+	bool best_fits = false;
+	int64_t best_size = 0;
+	for (size_t i = 0; i < func->slots.length; i++) {
+		ir_slot_t *slot = list_at(&func->slots, ir_slot_t, i);
+		if (slot->in_use) {
+			continue;
+		}
+
+		int64_t slot_size = list_at(&func->allocs, ir_instr_t, slot->alloc)->args[0].as.constant;
+		bool fits = slot->align >= align && slot_size >= (int64_t)size;
+		bool is_better;
+		if (best == SIZE_MAX || fits != best_fits) {
+			is_better = best == SIZE_MAX || fits;
+		} else {
+			is_better = fits ? slot_size < best_size : slot_size > best_size;
+		}
+		if (is_better) {
+			best = i;
+			best_fits = fits;
+			best_size = slot_size;
+		}
+	}
+	return best;
+}
+
+ir_value_t ir_alloc_local(ir_func_t *func, name_t name, size_t size, size_t align) {
+	size_t slot_index = ir_find_free_slot(func, size, align);
+	if (slot_index == SIZE_MAX) {
+		ir_instr_t instr = {
+			.op = ir_alloc_op(align),
+			.type = QBE_VALUE_LONG,
+			.result = ir_new_local(func, name),
+			.args = { ir_const(QBE_VALUE_LONG, 0) },
+		};
+		list_push(&func->allocs, &instr);
+
+		ir_slot_t slot = {
+			.alloc = func->allocs.length - 1,
+		};
+		list_push(&func->slots, &slot);
+		slot_index = func->slots.length - 1;
+	}
+
+	// Shared slots are as large and as aligned as their most demanding local
+	ir_slot_t *slot = list_at(&func->slots, ir_slot_t, slot_index);
+	ir_instr_t *alloc = list_at(&func->allocs, ir_instr_t, slot->alloc);
+	if (alloc->args[0].as.constant < (int64_t)size) {
+		alloc->args[0].as.constant = (int64_t)size;
+	}
+	if (slot->align < align) {
+		slot->align = align;
+		alloc->op = ir_alloc_op(align);
+	}
+
+	slot->in_use = true;
+	list_push(&func->live_slots, &slot_index);
+	return alloc->result;
+}
+
+void ir_enter_scope(ir_func_t *func) {
+	list_push(&func->scope_starts, &func->live_slots.length);
+}
+
+void ir_leave_scope(ir_func_t *func) {
+	size_t start = *list_at(&func->scope_starts, size_t, func->scope_starts.length - 1);
+	list_pop(&func->scope_starts);
+
+	while (func->live_slots.length > start) {
+		size_t slot_index = *list_at(&func->live_slots, size_t, func->live_slots.length - 1);
+		list_at(&func->slots, ir_slot_t, slot_index)->in_use = false;
+		list_pop(&func->live_slots);
+	}
+}
+
+// A jump right after another one can never be reached, so it's dropped
+static void ir_set_jump(ir_func_t *func, ir_jump_t jump) {
+	if (func->current == IR_BLOCK_NONE) {
+		return;
+	}
+	ir_block(func, func->current)->jump = jump;
+	func->current = IR_BLOCK_NONE;
+}
+
+void ir_jmp(ir_func_t *func, ir_block_id_t target) {
+	ir_set_jump(func, (ir_jump_t) {
+		.kind = IR_JUMP_JMP,
+		.targets = { target, IR_BLOCK_NONE },
+	});
+}
+
+void ir_jnz(ir_func_t *func, ir_value_t cond, ir_block_id_t then_block, ir_block_id_t else_block) {
+	ir_set_jump(func, (ir_jump_t) {
+		.kind = IR_JUMP_JNZ,
+		.arg = cond,
+		.targets = { then_block, else_block },
+	});
+}
+
+void ir_ret(ir_func_t *func, ir_value_t value) {
+	ir_set_jump(func, (ir_jump_t) {
+		.kind = IR_JUMP_RET,
+		.arg = value,
+		.targets = { IR_BLOCK_NONE, IR_BLOCK_NONE },
+	});
+}
+
+static void ir_print_type(outbuf_t *out, qbe_value_type_t type) {
+	switch (type) {
+		case QBE_VALUE_VOID:
+			break;
+		case QBE_VALUE_VARARGS:
+			outbuf_lit(out, "...");
+			break;
+		case QBE_VALUE_UNSIGNED_WORD:
+		case QBE_VALUE_WORD:
+			outbuf_lit(out, "w ");
+			break;
+		case QBE_VALUE_UNSIGNED_LONG:
+		case QBE_VALUE_LONG:
+			outbuf_lit(out, "l ");
+			break;
+		case QBE_VALUE_SINGLE:
+			outbuf_lit(out, "s ");
+			break;
+		case QBE_VALUE_SIGNED_BYTE:
+			outbuf_lit(out, "sb ");
+			break;
+		case QBE_VALUE_UNSIGNED_BYTE:
+			outbuf_lit(out, "ub ");
+			break;
+		default:
+			unreachable();
+	}
+}
+
+static void ir_print_store_type(outbuf_t *out, qbe_value_type_t type) {
+	switch (type) {
+		case QBE_VALUE_UNSIGNED_WORD:
+		case QBE_VALUE_WORD:
+			outbuf_lit(out, "w ");
+			break;
+		case QBE_VALUE_UNSIGNED_LONG:
+		case QBE_VALUE_LONG:
+			outbuf_lit(out, "l ");
+			break;
+		case QBE_VALUE_SINGLE:
+			outbuf_lit(out, "s ");
+			break;
+		case QBE_VALUE_UNSIGNED_BYTE:
+		case QBE_VALUE_SIGNED_BYTE:
+			outbuf_lit(out, "b ");
+			break;
+		default:
+			unreachable();
+	}
+}
+
+static void ir_print_ext_type(outbuf_t *out, qbe_value_type_t type) {
+	switch (type) {
+		case QBE_VALUE_SIGNED_BYTE:
+			outbuf_lit(out, "sb ");
+			break;
+		case QBE_VALUE_UNSIGNED_BYTE:
+			outbuf_lit(out, "ub ");
+			break;
+		case QBE_VALUE_WORD:
+			outbuf_lit(out, "sw ");
+			break;
+		case QBE_VALUE_UNSIGNED_WORD:
+			outbuf_lit(out, "uw ");
+			break;
+		default:
+			assert(false && "Cannot extend further than long");
+	}
+}
+
+void ir_print_data_name(outbuf_t *out, size_t data) {
+	outbuf_lit(out, "$"PRIVATE_PREFIX"str_");
+	outbuf_u64(out, data);
+}
+
+static void ir_print_value(outbuf_t *out, ir_func_t *func, ir_value_t value) {
+	switch (value.kind) {
+		case IR_VALUE_NONE:
+			unreachable();
+		case IR_VALUE_TEMP: {
+			const ir_temp_t *temp = ir_temp(func, value.as.temp);
+			switch (temp->kind) {
+				case IR_TEMP_ANON:
+					outbuf_lit(out, "%temp_");
+					outbuf_u64(out, value.as.temp);
+					break;
+				case IR_TEMP_LOCAL:
+					outbuf_lit(out, "%ident_");
+					outbuf_u64(out, value.as.temp);
+					outbuf_char(out, '_');
+					outbuf_sv(out, name_sv(temp->name));
+					break;
+				case IR_TEMP_PARAM:
+					outbuf_lit(out, "%param_");
+					outbuf_sv(out, name_sv(temp->name));
+					break;
+				case IR_TEMP_VAR:
+					assert(false && "Variables are replaced by their values before writing");
+					break;
+			}
+		} break;
+		case IR_VALUE_CONST:
+			outbuf_i64(out, value.as.constant);
+			break;
+		case IR_VALUE_GLOBAL:
+			outbuf_char(out, '$');
+			outbuf_sv(out, name_sv(value.as.global));
+			break;
+		case IR_VALUE_DATA:
+			ir_print_data_name(out, value.as.data);
+			break;
+	}
+}
+
+static const char *ir_op_name(ir_op_t op) {
+	switch (op) {
+		case IR_COPY: return "copy";
+		case IR_ADD: return "add";
+		case IR_SUB: return "sub";
+		case IR_MUL: return "mul";
+		case IR_DIV: return "div";
+		case IR_NEG: return "neg";
+		case IR_CEQ: return "ceq";
+		case IR_CNE: return "cne";
+		case IR_CSGT: return "csgt";
+		case IR_CSLT: return "cslt";
+		case IR_CSLE: return "csle";
+		case IR_EXT: return "ext";
+		case IR_CAST: return "cast";
+		case IR_LOAD: return "load";
+		case IR_STORE: return "store";
+		case IR_ALLOC4: return "alloc4";
+		case IR_ALLOC8: return "alloc8";
+		case IR_ALLOC16: return "alloc16";
+		case IR_CALL: return "call";
+	}
+	unreachable();
+}
+
+static void ir_print_instr(outbuf_t *out, ir_func_t *func, const ir_instr_t *instr) {
+	outbuf_lit(out, "    ");
+	if (instr->result.kind != IR_VALUE_NONE) {
+		ir_print_value(out, func, instr->result);
+		outbuf_lit(out, " =");
+		ir_print_type(out, instr->type);
+	} else if (instr->op == IR_CALL) {
+		ir_print_type(out, instr->type);
+	}
+
+	outbuf_str(out, ir_op_name(instr->op));
+	switch (instr->op) {
+		case IR_CEQ:
+		case IR_CNE:
+		case IR_CSGT:
+		case IR_CSLT:
+		case IR_CSLE:
+		case IR_LOAD:
+			ir_print_type(out, instr->arg_type);
+			break;
+		case IR_STORE:
+			ir_print_store_type(out, instr->arg_type);
+			break;
+		case IR_EXT:
+			ir_print_ext_type(out, instr->arg_type);
+			break;
+		default:
+			outbuf_char(out, ' ');
+			break;
+	}
+
+	if (instr->op == IR_CALL) {
+		ir_print_value(out, func, instr->args[0]);
+		outbuf_char(out, '(');
+		for (size_t i = 0; i < instr->call_arg_count; i++) {
+			if (i > 0) {
+				outbuf_lit(out, ", ");
+			}
+			ir_print_type(out, instr->call_args[i].type);
+			ir_print_value(out, func, instr->call_args[i]);
+		}
+		outbuf_lit(out, ")\n");
+		return;
+	}
+
+	for (size_t i = 0; i < 2 && instr->args[i].kind != IR_VALUE_NONE; i++) {
+		if (i > 0) {
+			outbuf_lit(out, ", ");
+		}
+		ir_print_value(out, func, instr->args[i]);
+	}
+	outbuf_char(out, '\n');
+}
+
+static void ir_print_label(outbuf_t *out, ir_block_id_t block) {
+	if (block == 0) {
+		outbuf_lit(out, "@start");
+	} else {
+		outbuf_lit(out, "@label_");
+		outbuf_u64(out, block);
+	}
+}
+
+static void ir_print_phi(outbuf_t *out, ir_func_t *func, const ir_phi_t *phi) {
+	outbuf_lit(out, "    ");
+	ir_print_value(out, func, phi->result);
+	outbuf_lit(out, " =");
+	ir_print_type(out, phi->result.type);
+	outbuf_lit(out, "phi ");
+	for (size_t i = 0; i < phi->arg_count; i++) {
+		if (i > 0) {
+			outbuf_lit(out, ", ");
+		}
+		ir_print_label(out, phi->args[i].block);
+		outbuf_char(out, ' ');
+		ir_print_value(out, func, phi->args[i].value);
+	}
+	outbuf_char(out, '\n');
+}
+
+static void ir_print_jump(outbuf_t *out, ir_func_t *func, const ir_jump_t *jump) {
+	switch (jump->kind) {
+		case IR_JUMP_NONE:
+			assert(false && "Every block must end with a jump");
+		case IR_JUMP_JMP:
+			outbuf_lit(out, "    jmp ");
+			ir_print_label(out, jump->targets[0]);
+			break;
+		case IR_JUMP_JNZ:
+			outbuf_lit(out, "    jnz ");
+			ir_print_value(out, func, jump->arg);
+			outbuf_lit(out, ", ");
+			ir_print_label(out, jump->targets[0]);
+			outbuf_lit(out, ", ");
+			ir_print_label(out, jump->targets[1]);
+			break;
+		case IR_JUMP_RET:
+			outbuf_lit(out, "    ret");
+			if (jump->arg.kind != IR_VALUE_NONE) {
+				outbuf_char(out, ' ');
+				ir_print_value(out, func, jump->arg);
+			}
+			break;
+	}
+	outbuf_char(out, '\n');
+}
+
+static void ir_print_func(outbuf_t *out, ir_func_t *func) {
+	outbuf_lit(out, "export function ");
+	ir_print_type(out, func->return_type);
+	ir_print_value(out, func, ir_global(QBE_VALUE_LONG, func->name));
+
+	outbuf_char(out, '(');
+	for (size_t i = 0; i < func->params.length; i++) {
+		ir_temp_id_t param = *list_at(&func->params, ir_temp_id_t, i);
+		if (i > 0) {
+			outbuf_lit(out, ", ");
+		}
+		ir_print_type(out, ir_temp(func, param)->type);
+		ir_print_value(out, func, (ir_value_t) { .kind = IR_VALUE_TEMP, .as.temp = param });
+	}
+	if (func->varargs) {
+		if (func->params.length > 0) {
+			outbuf_lit(out, ", ");
+		}
+		outbuf_lit(out, "...");
+	}
+	outbuf_lit(out, ")\n{\n");
+
+	for (size_t i = 0; i < func->layout.length; i++) {
+		ir_block_id_t block_id = *list_at(&func->layout, ir_block_id_t, i);
+		ir_block_t *block = ir_block(func, block_id);
+
+		ir_print_label(out, block_id);
+		outbuf_char(out, '\n');
+		if (block_id == 0) {
+			for (size_t j = 0; j < func->allocs.length; j++) {
+				ir_print_instr(out, func, list_at(&func->allocs, ir_instr_t, j));
+			}
+		}
+		for (size_t j = 0; j < block->phis.length; j++) {
+			ir_print_phi(out, func, list_at(&block->phis, ir_phi_t, j));
+		}
+		for (size_t j = 0; j < block->instrs.length; j++) {
+			ir_print_instr(out, func, list_at(&block->instrs, ir_instr_t, j));
+		}
+		ir_print_jump(out, func, &block->jump);
+	}
+	outbuf_lit(out, "}\n");
+}
+
+void ir_module_print(ir_module_t *module, outbuf_t *out) {
+	for (size_t i = 0; i < module->funcs.length; i++) {
+		ir_print_func(out, list_at(&module->funcs, ir_func_t, i));
+	}
+}
+
+void ir_module_add_stats(ir_module_t *module, ir_stats_t *stats) {
+	for (size_t i = 0; i < module->funcs.length; i++) {
+		ir_func_t *func = list_at(&module->funcs, ir_func_t, i);
+		stats->funcs++;
+		stats->blocks += func->layout.length;
+		stats->temps += func->temps.length;
+		stats->instrs += func->allocs.length;
+		for (size_t j = 0; j < func->layout.length; j++) {
+			ir_block_t *block = ir_block(func, *list_at(&func->layout, ir_block_id_t, j));
+			stats->instrs += block->phis.length + block->instrs.length;
+		}
+	}
+}
+
+void ir_stats_print(const ir_stats_t *stats, FILE *file) {
+	fprintf(file, "%-20s %12s %12s %12s\n", "functions", "blocks", "instructions", "temps");
+	fprintf(file, "%-20zu %12zu %12zu %12zu\n", stats->funcs, stats->blocks, stats->instrs, stats->temps);
+}
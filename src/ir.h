@@ -0,0 +1,226 @@
+#pragma once
+
+#include "scc.h"
+
+// In-memory QBE IR. Codegen builds functions out of basic blocks of typed instructions over
+// numbered temps, passes can inspect and rewrite them, and the text is only written at the end.
+
+typedef enum {
+	QBE_VALUE_VARARGS,
+	QBE_VALUE_VOID,
+	QBE_VALUE_WORD,
+	QBE_VALUE_UNSIGNED_WORD,
+	QBE_VALUE_SIGNED_BYTE,
+	QBE_VALUE_UNSIGNED_BYTE,
+	QBE_VALUE_LONG,
+	QBE_VALUE_UNSIGNED_LONG,
+	QBE_VALUE_SINGLE,
+} qbe_value_type_t;
+
+// Index into ir_func_t.temps
+typedef uint32_t ir_temp_id_t;
+// Index into ir_func_t.blocks
+typedef uint32_t ir_block_id_t;
+
+#define IR_BLOCK_NONE ((ir_block_id_t)UINT32_MAX)
+
+typedef enum {
+	IR_TEMP_ANON,
+	IR_TEMP_LOCAL,  // address of a local variable's stack slot
+	IR_TEMP_PARAM,
+	// Local that lives in temps. Codegen loads and stores it like a slot, ssa_construct then
+	// replaces those with the values stored, so it never appears in the written IR.
+	IR_TEMP_VAR,
+} ir_temp_kind_t;
+
+typedef struct {
+	ir_temp_kind_t kind;
+	qbe_value_type_t type;
+	// Locals and params keep their source name so the written IR stays readable. Locals are
+	// also numbered by temp id, since sibling scopes can declare the same name.
+	name_t name;
+} ir_temp_t;
+
+typedef enum {
+	IR_VALUE_NONE,
+	IR_VALUE_TEMP,
+	IR_VALUE_CONST,
+	IR_VALUE_GLOBAL,
+	IR_VALUE_DATA,
+} ir_value_kind_t;
+
+typedef struct {
+	ir_value_kind_t kind;
+	qbe_value_type_t type;
+	union {
+		ir_temp_id_t temp;
+		int64_t constant;
+		name_t global;
+		size_t data;  // index of a string pool data definition
+	} as;
+} ir_value_t;
+
+typedef enum {
+	IR_COPY,
+	IR_ADD,
+	IR_SUB,
+	IR_MUL,
+	IR_DIV,
+	IR_NEG,
+	IR_CEQ,
+	IR_CNE,
+	IR_CSGT,
+	IR_CSLT,
+	IR_CSLE,
+	IR_EXT,
+	IR_CAST,
+	IR_LOAD,
+	IR_STORE,
+	IR_ALLOC4,
+	IR_ALLOC8,
+	IR_ALLOC16,
+	IR_CALL,
+} ir_op_t;
+
+typedef struct {
+	ir_op_t op;
+	qbe_value_type_t type;      // type the result is assigned with
+	qbe_value_type_t arg_type;  // suffix of loads, stores, extensions and comparisons
+	ir_value_t result;          // IR_VALUE_NONE for stores and void calls
+	ir_value_t args[2];         // calls keep the callee in args[0]
+	ir_value_t *call_args;      // owned by the instruction
+	size_t call_arg_count;
+} ir_instr_t;
+
+typedef enum {
+	IR_JUMP_NONE,
+	IR_JUMP_JMP,
+	IR_JUMP_JNZ,
+	IR_JUMP_RET,
+} ir_jump_kind_t;
+
+typedef struct {
+	ir_jump_kind_t kind;
+	ir_value_t arg;            // condition of jnz, value of ret
+	ir_block_id_t targets[2];  // jmp goes to targets[0], jnz to targets[0] if arg is nonzero
+} ir_jump_t;
+
+typedef struct {
+	ir_block_id_t block;
+	ir_value_t value;
+} ir_phi_arg_t;
+
+typedef struct {
+	ir_value_t result;
+	ir_temp_id_t var;    // IR_TEMP_VAR the phi merges the values of
+	ir_phi_arg_t *args;  // one per predecessor, owned by the phi
+	size_t arg_count;
+} ir_phi_t;
+
+typedef struct {
+	list_t phis;    // ir_phi_t
+	list_t instrs;  // ir_instr_t
+	ir_jump_t jump;
+	bool placed;
+} ir_block_t;
+
+typedef struct {
+	size_t alloc;  // index into ir_func_t.allocs
+	size_t align;
+	bool in_use;
+} ir_slot_t;
+
+typedef struct {
+	name_t name;
+	qbe_value_type_t return_type;
+	list_t params;  // ir_temp_id_t
+	bool varargs;
+	list_t temps;   // ir_temp_t
+	list_t allocs;  // ir_instr_t, fixed size stack slots, written at the top of the entry block
+	// A slot is free again once the scope of its local ends and the next local takes it over.
+	// Scopes are visited in order, so this is a linear scan coloring of the locals' lifetimes
+	// and disjoint scopes share frame space.
+	list_t slots;         // ir_slot_t
+	list_t live_slots;    // size_t, slots in use in the order they were taken
+	list_t scope_starts;  // size_t, length of live_slots when each open scope was entered
+	list_t blocks;  // ir_block_t, block 0 is the entry
+	list_t layout;  // ir_block_id_t, the order blocks are written in
+	// Block instructions are appended to, IR_BLOCK_NONE after a jump until the next block is placed
+	ir_block_id_t current;
+} ir_func_t;
+
+typedef struct {
+	list_t funcs;  // ir_func_t
+} ir_module_t;
+
+typedef struct {
+	size_t funcs;
+	size_t blocks;
+	size_t instrs;
+	size_t temps;
+} ir_stats_t;
+
+static inline ir_value_t ir_const(qbe_value_type_t type, int64_t constant) {
+	return (ir_value_t) { .kind = IR_VALUE_CONST, .type = type, .as.constant = constant };
+}
+
+static inline ir_value_t ir_global(qbe_value_type_t type, name_t name) {
+	return (ir_value_t) { .kind = IR_VALUE_GLOBAL, .type = type, .as.global = name };
+}
+
+static inline ir_value_t ir_data(size_t data) {
+	return (ir_value_t) { .kind = IR_VALUE_DATA, .type = QBE_VALUE_LONG, .as.data = data };
+}
+
+// Allocation instruction for a slot aligned to align bytes, QBE aligns to at least 4
+static inline ir_op_t ir_alloc_op(size_t align) {
+	if (align > 8) {
+		return IR_ALLOC16;
+	}
+	return align > 4 ? IR_ALLOC8 : IR_ALLOC4;
+}
+
+static inline ir_temp_t *ir_temp(ir_func_t *func, ir_temp_id_t temp) {
+	return list_at(&func->temps, ir_temp_t, temp);
+}
+
+static inline ir_block_t *ir_block(ir_func_t *func, ir_block_id_t block) {
+	return list_at(&func->blocks, ir_block_t, block);
+}
+
+void ir_module_init(ir_module_t *module);
+void ir_module_free(ir_module_t *module);
+
+// Starts a function with its entry block placed
+void ir_func_init(ir_func_t *func, name_t name, qbe_value_type_t return_type);
+ir_value_t ir_new_temp(ir_func_t *func, qbe_value_type_t type);
+ir_value_t ir_new_local(ir_func_t *func, name_t name);
+// type is how the local is loaded and stored, which also decides the class of its values
+ir_value_t ir_new_var(ir_func_t *func, qbe_value_type_t type, name_t name);
+ir_value_t ir_add_param(ir_func_t *func, qbe_value_type_t type, name_t name);
+
+// Blocks are created first so they can be jumped to, and placed once their code follows
+ir_block_id_t ir_new_block(ir_func_t *func);
+// Makes block current, an unterminated current block jumps to it
+void ir_place_block(ir_func_t *func, ir_block_id_t block);
+
+// Instructions after a jump go to a new unreachable block and jumps after a jump are dropped, so
+// lowering never has to check whether the current block already ended
+void ir_emit(ir_func_t *func, ir_instr_t instr);
+
+// Gives a fixed size local a stack slot, reusing a free one when possible. Slots are allocated
+// for the whole function, wherever the local is declared. QBE turns constant allocations in the
+// entry block into frame slots, so loops never grow the stack. A shared slot keeps the name of
+// the first local that used it.
+ir_value_t ir_alloc_local(ir_func_t *func, name_t name, size_t size, size_t align);
+// Locals allocated after entering a scope give their slots back when leaving it
+void ir_enter_scope(ir_func_t *func);
+void ir_leave_scope(ir_func_t *func);
+void ir_jmp(ir_func_t *func, ir_block_id_t target);
+void ir_jnz(ir_func_t *func, ir_value_t cond, ir_block_id_t then_block, ir_block_id_t else_block);
+void ir_ret(ir_func_t *func, ir_value_t value);
+
+void ir_module_print(ir_module_t *module, outbuf_t *out);
+void ir_print_data_name(outbuf_t *out, size_t data);
+void ir_module_add_stats(ir_module_t *module, ir_stats_t *stats);
+void ir_stats_print(const ir_stats_t *stats, FILE *file);
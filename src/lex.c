@@ -1,35 +1,21 @@
 #include "scc.h"
 
 typedef struct {
-    list_t *tokens;
+    token_stream_t *tokens;
     sv_t *code_view;
-    const char *code;
-    const char *file_name;
+    const source_file_t *file;
+    name_t restrict_name;
+    name_t const_name;
 } lex_ctx_t;
 
 source_loc_t ctx_get_source_loc(const lex_ctx_t *ctx) {
-    size_t line = 1;
-    size_t column = 1;
-    const char *p = ctx->code;
-    while (p < ctx->code_view->string) {
-        if (*p == '\n') {
-            line++;
-            column = 1;
-        } else {
-            column++;
-        }
-        p++;
-    }
-    return (source_loc_t){ .file_name = ctx->file_name, .line = line, .column = column };
+    return source_loc_at(ctx->file, ctx->code_view->string);
 }
 
 static bool try_consume_intlit(lex_ctx_t *ctx) {
     source_loc_t start_loc = ctx_get_source_loc(ctx);
 
-    size_t i = 0;
-    while (i < ctx->code_view->length && isdigit(ctx->code_view->string[i])) {
-        i++;
-    }
+    size_t i = scan_digits(ctx->code_view->string, ctx->code_view->length);
     if (i == 0) {
         return false;
     }
@@ -45,7 +31,7 @@ static bool try_consume_intlit(lex_ctx_t *ctx) {
     sv_to_cstr(intlit_sv, buffer, sizeof(buffer));
 
     token_t token = { .type = TOKEN_INTLIT, .source_loc = start_loc, .as.intlit = atoi(buffer) };
-    list_push(ctx->tokens, &token);
+    token_stream_push(ctx->tokens, &token);
 
     return true;
 }
@@ -57,18 +43,14 @@ static bool try_consume_charlit(lex_ctx_t *ctx) {
         return false;
     }
 
+    // Skip to the closing quote, jumping over escape sequences
     size_t i = 1;
-    bool escape = false;
     while (i < ctx->code_view->length) {
-        if (ctx->code_view->string[i] == '\'' && !escape) {
+        i += scan_string_body(ctx->code_view->string + i, ctx->code_view->length - i, '\'');
+        if (i >= ctx->code_view->length || ctx->code_view->string[i] == '\'') {
             break;
         }
-        if (ctx->code_view->string[i] == '\\' && !escape) {
-            escape = true;
-        } else {
-            escape = false;
-        }
-        i++;
+        i += 2;
     }
     if (i >= ctx->code_view->length) {
         report_error(start_loc, "Unterminated char literal");
@@ -115,7 +97,7 @@ static bool try_consume_charlit(lex_ctx_t *ctx) {
     }
 
     token_t token = { .type = TOKEN_CHARLIT, .source_loc = start_loc, .as.charlit = unescaped[0] };
-    list_push(ctx->tokens, &token);
+    token_stream_push(ctx->tokens, &token);
 
     return true;
 }
@@ -127,18 +109,14 @@ static bool try_consume_stringlit(lex_ctx_t *ctx) {
         return false;
     }
 
+    // Skip to the closing quote, jumping over escape sequences
     size_t i = 1;
-    bool escape = false;
     while (i < ctx->code_view->length) {
-        if (ctx->code_view->string[i] == '"' && !escape) {
+        i += scan_string_body(ctx->code_view->string + i, ctx->code_view->length - i, '"');
+        if (i >= ctx->code_view->length || ctx->code_view->string[i] == '"') {
             break;
         }
-        if (ctx->code_view->string[i] == '\\' && !escape) {
-            escape = true;
-        } else {
-            escape = false;
-        }
-        i++;
+        i += 2;
     }
     if (i >= ctx->code_view->length) {
         report_error(start_loc, "Unterminated string literal");
@@ -183,63 +161,77 @@ static bool try_consume_stringlit(lex_ctx_t *ctx) {
     string_sv = (sv_t){ .string = strdup(unescaped), .length = strlen(unescaped) };
 
     token_t token = { .type = TOKEN_STRINGLIT, .source_loc = start_loc, .as.stringlit = string_sv };
-    list_push(ctx->tokens, &token);
+    token_stream_push(ctx->tokens, &token);
 
     return true;
 }
 
+// Keywords are dispatched on length and first character, then confirmed with a single memcmp
+#define match_keyword(sv, keyword, token_type) \
+    if (memcmp((sv).string, keyword, sizeof(keyword) - 1) == 0) return token_type
+
+token_type_t keyword_lookup(sv_t sv) {
+    switch (sv.length) {
+        case 2:
+            match_keyword(sv, "if", TOKEN_IF);
+            break;
+        case 3:
+            switch (sv.string[0]) {
+                case 'i': match_keyword(sv, "int", TOKEN_INT); break;
+                case 'f': match_keyword(sv, "for", TOKEN_FOR); break;
+            }
+            break;
+        case 4:
+            switch (sv.string[0]) {
+                case 'v': match_keyword(sv, "void", TOKEN_VOID); break;
+                case 'c': match_keyword(sv, "char", TOKEN_CHAR); break;
+                case 'l': match_keyword(sv, "long", TOKEN_LONG); break;
+                case 'e': match_keyword(sv, "else", TOKEN_ELSE); break;
+            }
+            break;
+        case 5:
+            switch (sv.string[0]) {
+                case 'f': match_keyword(sv, "float", TOKEN_FLOAT); break;
+                case 'b': match_keyword(sv, "break", TOKEN_BREAK); break;
+                case 'w': match_keyword(sv, "while", TOKEN_WHILE); break;
+            }
+            break;
+        case 6:
+            match_keyword(sv, "return", TOKEN_RETURN);
+            break;
+        case 8:
+            switch (sv.string[0]) {
+                case 'c': match_keyword(sv, "continue", TOKEN_CONTINUE); break;
+                case 'u': match_keyword(sv, "unsigned", TOKEN_UNSIGNED); break;
+            }
+            break;
+    }
+    return TOKEN_IDENTIFIER;
+}
+
+#undef match_keyword
+
 static bool try_consume_identifier(lex_ctx_t *ctx) {
     source_loc_t start_loc = ctx_get_source_loc(ctx);
 
-    size_t i = 0;
-    while (i < ctx->code_view->length && (isalpha(ctx->code_view->string[i]) || ctx->code_view->string[i] == '_' || (i > 0 && isdigit(ctx->code_view->string[i])))) {
-        i++;
-    }
-    if (i == 0) {
+    if (!char_is(ctx->code_view->string[0], CHAR_IDENT_START)) {
         return false;
     }
+    size_t i = 1 + scan_identifier(ctx->code_view->string + 1, ctx->code_view->length - 1);
 
     sv_t identifier_sv = sv_consume(ctx->code_view, i);
 
-    char buffer[32];
-    if (identifier_sv.length >= sizeof(buffer)) {
-        report_error(start_loc, "Identifier too long");  // TODO: Shouldn't be an error
-    }
+    token_t token = { .type = keyword_lookup(identifier_sv), .source_loc = start_loc };
+    if (token.type == TOKEN_IDENTIFIER) {
+        token.as.identifier = intern(identifier_sv);
 
-    sv_to_cstr(identifier_sv, buffer, sizeof(buffer));
-
-    token_t token = { .type = TOKEN_IDENTIFIER, .source_loc = start_loc };
-    if (strcmp(buffer, "int") == 0) {
-        token.type = TOKEN_INT;
-    } else if (strcmp(buffer, "float") == 0) {
-        token.type = TOKEN_FLOAT;
-    } else if (strcmp(buffer, "void") == 0) {
-        token.type = TOKEN_VOID;
-    } else if (strcmp(buffer, "return") == 0) {
-        token.type = TOKEN_RETURN;
-    } else if (strcmp(buffer, "break") == 0) {
-        token.type = TOKEN_BREAK;
-    } else if (strcmp(buffer, "continue") == 0) {
-        token.type = TOKEN_CONTINUE;
-    } else if (strcmp(buffer, "char") == 0) {
-        token.type = TOKEN_CHAR;
-    } else if (strcmp(buffer, "long") == 0) {
-        token.type = TOKEN_LONG;
-    } else if (strcmp(buffer, "if") == 0) {
-        token.type = TOKEN_IF;
-    } else if (strcmp(buffer, "else") == 0) {
-        token.type = TOKEN_ELSE;
-    } else if (strcmp(buffer, "while") == 0) {
-        token.type = TOKEN_WHILE;
-    } else if (strcmp(buffer, "for") == 0) {
-        token.type = TOKEN_FOR;
-    } else if (strcmp(buffer, "unsigned") == 0) {
-        token.type = TOKEN_UNSIGNED;
-    } else {
-        strcpy(token.as.identifier, buffer);
+        // Drop "restrict" and "const" for now
+        if (token.as.identifier == ctx->restrict_name || token.as.identifier == ctx->const_name) {
+            return true;
+        }
     }
 
-    list_push(ctx->tokens, &token);
+    token_stream_push(ctx->tokens, &token);
     return true;
 }
 
@@ -258,15 +250,33 @@ static bool try_consume_symbol(lex_ctx_t *ctx) {
             token.type = TOKEN_PLUS;
         }
     } else if (ctx->code_view->string[0] == '-') {
-        token.type = TOKEN_MINUS;
+        if (ctx->code_view->length >= 2 && ctx->code_view->string[1] == '=') {
+            token.type = TOKEN_MINUSEQ;
+            sv_consume(ctx->code_view, 1); // consume extra '='
+        } else if (ctx->code_view->length >= 2 && ctx->code_view->string[1] == '-') {
+            token.type = TOKEN_DEC;
+            sv_consume(ctx->code_view, 1); // consume extra '-'
+        } else {
+            token.type = TOKEN_MINUS;
+        }
     } else if (ctx->code_view->string[0] == '[') {
         token.type = TOKEN_LBRACK;
     } else if (ctx->code_view->string[0] == ']') {
         token.type = TOKEN_RBRACK;
     } else if (ctx->code_view->string[0] == '*') {
-        token.type = TOKEN_STAR;
+        if (ctx->code_view->length >= 2 && ctx->code_view->string[1] == '=') {
+            token.type = TOKEN_STAREQ;
+            sv_consume(ctx->code_view, 1); // consume extra '='
+        } else {
+            token.type = TOKEN_STAR;
+        }
     } else if (ctx->code_view->string[0] == '/') {
-        token.type = TOKEN_SLASH;
+        if (ctx->code_view->length >= 2 && ctx->code_view->string[1] == '=') {
+            token.type = TOKEN_SLASHEQ;
+            sv_consume(ctx->code_view, 1); // consume extra '='
+        } else {
+            token.type = TOKEN_SLASH;
+        }
     } else if (ctx->code_view->string[0] == '>') {
         token.type = TOKEN_GT;
     } else if (ctx->code_view->string[0] == '<') {
@@ -328,21 +338,51 @@ static bool try_consume_symbol(lex_ctx_t *ctx) {
     }
 
     sv_consume(ctx->code_view, 1);
-    list_push(ctx->tokens, &token);
+    token_stream_push(ctx->tokens, &token);
     return true;
 }
 
-bool tokenize(list_t *tokens, sv_t code_view, const char *file_name) {
+size_t skip_trivia(const char *s, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        i += scan_whitespace(s + i, n - i);
+        if (n - i >= 2 && s[i] == '/' && s[i + 1] == '/') {
+            const char *newline = memchr(s + i, '\n', n - i);
+            i = newline ? (size_t)(newline - s) : n;
+        } else if (n - i >= 2 && s[i] == '/' && s[i + 1] == '*') {
+            // An unterminated comment runs to the end of the input
+            size_t j = i + 2;
+            while (j < n && !(s[j] == '*' && j + 1 < n && s[j + 1] == '/')) {
+                j++;
+            }
+            i = j < n ? j + 2 : n;
+        } else if (n - i >= 2 && s[i] == '\\' && s[i + 1] == '\n') {
+            i += 2;  // line splice
+        } else {
+            break;
+        }
+    }
+    return i;
+}
+
+bool tokenize(token_stream_t *tokens, const source_file_t *file) {
+    return tokenize_range(tokens, file, file->code, file->code + file->length);
+}
+
+bool tokenize_range(token_stream_t *tokens, const source_file_t *file, const char *begin, const char *end) {
+    assert(begin >= file->code && end <= file->code + file->length && begin <= end);
+
+    sv_t code_view = { .string = begin, .length = end - begin };
     lex_ctx_t ctx = {
         .tokens = tokens,
         .code_view = &code_view,
-        .code = code_view.string,
-        .file_name = file_name,
+        .file = file,
+        .restrict_name = intern_cstr("restrict"),
+        .const_name = intern_cstr("const"),
     };
 
     while (true) {
-        code_view = sv_trim_left(code_view);
-        ctx.code_view = &code_view;
+        sv_consume(&code_view, skip_trivia(code_view.string, code_view.length));
 
         if (code_view.length == 0) {
             return true;
@@ -364,6 +404,84 @@ bool tokenize(list_t *tokens, sv_t code_view, const char *file_name) {
     }
 }
 
+token_stream_t token_stream_new(void) {
+    return (token_stream_t){
+        .kinds = { .element_size = sizeof(uint8_t) },
+        .offsets = { .element_size = sizeof(uint32_t) },
+        .payloads = { .element_size = sizeof(uint32_t) },
+        .strings = { .element_size = sizeof(sv_t) },
+    };
+}
+
+void token_stream_push(token_stream_t *stream, const token_t *token) {
+    uint8_t kind = token->type;
+    uint32_t offset = token->source_loc.offset;
+    uint32_t payload = 0;
+    switch (token->type) {
+        case TOKEN_INTLIT:
+            payload = (uint32_t)token->as.intlit;
+            break;
+        case TOKEN_CHARLIT:
+            payload = (unsigned char)token->as.charlit;
+            break;
+        case TOKEN_IDENTIFIER:
+            payload = token->as.identifier;
+            break;
+        case TOKEN_STRINGLIT:
+            payload = (uint32_t)stream->strings.length;
+            list_push(&stream->strings, (void *)&token->as.stringlit);
+            break;
+        default:
+            break;
+    }
+
+    list_push(&stream->kinds, &kind);
+    list_push(&stream->offsets, &offset);
+    list_push(&stream->payloads, &payload);
+}
+
+token_t token_stream_get(const token_stream_t *stream, size_t index) {
+    assert(index < token_stream_length(stream));
+
+    token_t token = {
+        .type = token_stream_kind(stream, index),
+        .source_loc.offset = ((const uint32_t *)stream->offsets.element_bytes)[index],
+    };
+    uint32_t payload = ((const uint32_t *)stream->payloads.element_bytes)[index];
+    switch (token.type) {
+        case TOKEN_INTLIT:
+            token.as.intlit = (int)payload;
+            break;
+        case TOKEN_CHARLIT:
+            token.as.charlit = (char)payload;
+            break;
+        case TOKEN_IDENTIFIER:
+            token.as.identifier = payload;
+            break;
+        case TOKEN_STRINGLIT:
+            token.as.stringlit = ((const sv_t *)stream->strings.element_bytes)[payload];
+            break;
+        default:
+            break;
+    }
+    return token;
+}
+
+// Empties the stream but keeps its storage for reuse
+void token_stream_reset(token_stream_t *stream) {
+    stream->kinds.length = 0;
+    stream->offsets.length = 0;
+    stream->payloads.length = 0;
+    stream->strings.length = 0;
+}
+
+void token_stream_clear(token_stream_t *stream) {
+    list_clear(&stream->kinds);
+    list_clear(&stream->offsets);
+    list_clear(&stream->payloads);
+    list_clear(&stream->strings);
+}
+
 void token_print(const token_t *token) {
     switch (token->type) {
         case TOKEN_INTLIT:
@@ -388,7 +506,7 @@ void token_print(const token_t *token) {
             fprintf(stderr, "RPAREN");
             break;
         case TOKEN_IDENTIFIER:
-            fprintf(stderr, "IDENTIFIER(%s)", token->as.identifier);
+            fprintf(stderr, "IDENTIFIER(%s)", name_cstr(token->as.identifier));
             break;
         case TOKEN_INT:
             fprintf(stderr, "INT");
@@ -483,6 +601,18 @@ void token_print(const token_t *token) {
         case TOKEN_FOR:
             fprintf(stderr, "FOR");
             break;
+        case TOKEN_MINUSEQ:
+            fprintf(stderr, "MINUSEQ");
+            break;
+        case TOKEN_STAREQ:
+            fprintf(stderr, "STAREQ");
+            break;
+        case TOKEN_SLASHEQ:
+            fprintf(stderr, "SLASHEQ");
+            break;
+        case TOKEN_DEC:
+            fprintf(stderr, "DEC");
+            break;
         default:
             unreachable();
     }
@@ -43,24 +43,50 @@ typedef enum {
     TOKEN_BREAK,
     TOKEN_CONTINUE,
     TOKEN_DOTS,
+    TOKEN_MINUSEQ,
+    TOKEN_STAREQ,
+    TOKEN_SLASHEQ,
+    TOKEN_DEC,
 } token_type_t;
 
-typedef struct {
-    const char *file_name;
-    size_t line;
-    size_t column;
-} source_loc_t;
-
 typedef struct {
     source_loc_t source_loc;
     token_type_t type;
     union {
         int intlit;
-        char identifier[32];
+        name_t identifier;
         sv_t stringlit;
         char charlit;
     } as;
 } token_t;
 
-bool tokenize(list_t *tokens, sv_t code_view, const char *file_name);
+// Tokens are stored as parallel arrays so the parser, which mostly looks at kinds while
+// backtracking, walks a dense byte array. token_stream_get materializes a token_t by value.
+typedef struct {
+    list_t kinds;    // uint8_t, token_type_t
+    list_t offsets;  // uint32_t, source_loc_t offsets
+    list_t payloads; // uint32_t, literal value, name_t or index into strings
+    list_t strings;  // sv_t, string literal bodies
+} token_stream_t;
+
+token_stream_t token_stream_new(void);
+void token_stream_push(token_stream_t *stream, const token_t *token);
+token_t token_stream_get(const token_stream_t *stream, size_t index);
+void token_stream_reset(token_stream_t *stream);
+void token_stream_clear(token_stream_t *stream);
+
+static inline size_t token_stream_length(const token_stream_t *stream) {
+    return stream->kinds.length;
+}
+
+static inline token_type_t token_stream_kind(const token_stream_t *stream, size_t index) {
+    return ((const uint8_t *)stream->kinds.element_bytes)[index];
+}
+
+token_type_t keyword_lookup(sv_t sv);
+// Length of the whitespace, comments and line splices at the start of s, at most n
+size_t skip_trivia(const char *s, size_t n);
+bool tokenize(token_stream_t *tokens, const source_file_t *file);
+// Lexes [begin, end), which must lie within file, appending to tokens
+bool tokenize_range(token_stream_t *tokens, const source_file_t *file, const char *begin, const char *end);
 void token_print(const token_t *token);
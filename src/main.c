@@ -1,86 +1,80 @@
 #include "scc.h"
 
-char *preprocess_file(const char *in_path) {
-    // Run `cpp -x c {PATH} | grep -v "^#"`
-    char command[512];
-    snprintf(command, sizeof(command), "cpp -I./std -nostdinc -x c \"%s\" | grep -v \"^#\"", in_path);
-
-    FILE *pipe = popen(command, "r");
-    if (pipe == NULL) {
-        todo("Handle preprocess error");
-    }
-
-    char *buf = NULL;
-    size_t len = 0;
-    FILE *mem = open_memstream(&buf, &len);
-    assert(mem != NULL);
-
-    char tmp[4096];
-    while (fgets(tmp, sizeof tmp, pipe))
-        fputs(tmp, mem);
-
-    pclose(pipe);
-    fclose(mem);   // finalizes buffer
-    // buf is NUL-terminated, length in len
-
-    return buf;
-}
-
 int main(int argc, char **argv) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <input-file>\n", argv[0]);
+    char *in_path = NULL;
+    bool parse_stats = false;
+    bool ir_stats = false;
+    size_t jobs = 1;
+    bool usage_error = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--parse-stats") == 0) {
+            parse_stats = true;
+        } else if (strcmp(argv[i], "--ir-stats") == 0) {
+            ir_stats = true;
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            // Both -j N and -jN
+            const char *count = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            char *end;
+            unsigned long parsed = strtoul(count, &end, 10);
+            if (*count == '\0' || *end != '\0' || parsed == 0 || parsed > 1024) {
+                usage_error = true;
+                break;
+            }
+            jobs = parsed;
+        } else if (in_path == NULL) {
+            in_path = argv[i];
+        } else {
+            in_path = NULL;
+            break;
+        }
+    }
+    if (in_path == NULL || usage_error) {
+        fprintf(stderr, "Usage: %s [--parse-stats] [--ir-stats] [-j N] <input-file>\n", argv[0]);
         return 1;
     }
-
-    char *in_path = argv[1];
     char *out_path = "out.qbe";
 
-    char *code = preprocess_file(in_path);
-    // char *code = read_file(in_path);
-    sv_t code_view = sv_from_cstr(code);
-
-    list_t tokens = { .element_size = sizeof(token_t) };
-    if (!tokenize(&tokens, code_view, in_path)) {
-        todo("Handle tokenization error");
-    }
-
-    // Remove "restrict" and "const" tokens for now
-    for (size_t i = 0; i < tokens.length; ) {
-        token_t *token = list_at(&tokens, token_t, i);
-        if (token->type != TOKEN_IDENTIFIER) {
-            i++;
-            continue;
-        }
-        if (strcmp(token->as.identifier, "restrict") == 0 || strcmp(token->as.identifier, "const") == 0) {
-            list_remove(&tokens, i);
-        } else {
-            i++;
-        }
+    token_stream_t tokens = token_stream_new();
+    if (!preprocess(&tokens, in_path)) {
+        fprintf(stderr, "ERROR: Could not read '%s'\n", in_path);
+        return 1;
     }
 
-    // for (size_t i = 0; i < tokens.length; i++) {
-    //     token_print(list_at(&tokens, token_t, i));
+    // for (size_t i = 0; i < token_stream_length(&tokens); i++) {
+    //     token_t token = token_stream_get(&tokens, i);
+    //     token_print(&token);
     //     fprintf(stderr, "\n");
     // }
 
-    list_t nodes = { .element_size = sizeof(node_t) };
     node_ref_t root_ref;
-    if (!parse(&nodes, &tokens, &root_ref)) {
+    bool parsed = parse(&tokens, &root_ref);
+    if (parse_stats) {
+        parse_stats_print(stderr);
+    }
+    if (!parsed) {
         fprintf(stderr, "Parse error\n");
         return 1;
     }
 
-    // assert(nodes.length > 0);
     // node_print(root_ref);
     // printf("\n");
 
-    if (!analyze(root_ref, out_path)) {
+    analysis_t analysis;
+    if (!analyze(root_ref, &analysis)) {
         fprintf(stderr, "Analyze error\n");
         return 1;
     }
+    ir_stats_t stats = { 0 };
+    if (!codegen(root_ref, &analysis, out_path, jobs, ir_stats ? &stats : NULL)) {
+        fprintf(stderr, "Codegen error\n");
+        return 1;
+    }
+    if (ir_stats) {
+        ir_stats_print(&stats, stderr);
+    }
 
-    list_clear(&nodes);
-    list_clear(&tokens);
-    free(code);
+    analysis_free(&analysis);
+    ast_free();
+    token_stream_clear(&tokens);
     return 0;
 }
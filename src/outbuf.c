@@ -0,0 +1,115 @@
+#include "scc.h"
+
+static void outbuf_reserve(outbuf_t *out, size_t length) {
+    if (out->length + length <= out->capacity) {
+        return;
+    }
+    size_t capacity = out->capacity == 0 ? 256 : out->capacity;
+    while (out->length + length > capacity) {
+        capacity *= 2;
+    }
+    char *bytes = realloc(out->bytes, capacity);
+    assert(bytes != NULL);
+    out->bytes = bytes;
+    out->capacity = capacity;
+}
+
+void outbuf_write(outbuf_t *out, const void *bytes, size_t length) {
+    outbuf_reserve(out, length);
+    memcpy(out->bytes + out->length, bytes, length);
+    out->length += length;
+}
+
+void outbuf_char(outbuf_t *out, char c) {
+    outbuf_reserve(out, 1);
+    out->bytes[out->length++] = c;
+}
+
+void outbuf_str(outbuf_t *out, const char *cstr) {
+    outbuf_write(out, cstr, strlen(cstr));
+}
+
+void outbuf_sv(outbuf_t *out, sv_t sv) {
+    outbuf_write(out, sv.string, sv.length);
+}
+
+void outbuf_u64(outbuf_t *out, uint64_t value) {
+    // Digits are produced back to front, two at a time
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char digits[20];
+    size_t start = sizeof(digits);
+    while (value >= 100) {
+        size_t pair = (value % 100) * 2;
+        value /= 100;
+        digits[--start] = pairs[pair + 1];
+        digits[--start] = pairs[pair];
+    }
+    if (value >= 10) {
+        digits[--start] = pairs[value * 2 + 1];
+        digits[--start] = pairs[value * 2];
+    } else {
+        digits[--start] = (char)('0' + value);
+    }
+    outbuf_write(out, digits + start, sizeof(digits) - start);
+}
+
+void outbuf_i64(outbuf_t *out, int64_t value) {
+    if (value < 0) {
+        outbuf_char(out, '-');
+        // Negate in unsigned arithmetic so INT64_MIN doesn't overflow
+        outbuf_u64(out, -(uint64_t)value);
+    } else {
+        outbuf_u64(out, (uint64_t)value);
+    }
+}
+
+void outbuf_free(outbuf_t *out) {
+    free(out->bytes);
+    *out = (outbuf_t){ 0 };
+}
+
+// IOV_MAX on Linux, IOV_MAX itself is only defined with _XOPEN_SOURCE
+#define OUTBUF_MAX_IOV 1024
+
+bool outbuf_flush_all(int fd, const outbuf_t *bufs, size_t count) {
+    struct iovec iov[OUTBUF_MAX_IOV];
+    size_t next = 0;
+    size_t iov_count = 0;
+    while (next < count || iov_count > 0) {
+        // Fill the batch, skipping empty buffers
+        while (next < count && iov_count < OUTBUF_MAX_IOV) {
+            if (bufs[next].length > 0) {
+                iov[iov_count++] = (struct iovec){ .iov_base = bufs[next].bytes, .iov_len = bufs[next].length };
+            }
+            next++;
+        }
+        if (iov_count == 0) {
+            break;
+        }
+
+        ssize_t written = writev(fd, iov, (int)iov_count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        // Drop what was written, a short write leaves the rest of the batch for the next call
+        size_t done = 0;
+        while (done < iov_count && (size_t)written >= iov[done].iov_len) {
+            written -= iov[done].iov_len;
+            done++;
+        }
+        if (done < iov_count) {
+            iov[done].iov_base = (char *)iov[done].iov_base + written;
+            iov[done].iov_len -= written;
+        }
+        memmove(iov, iov + done, (iov_count - done) * sizeof(iov[0]));
+        iov_count -= done;
+    }
+    return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "scc.h"
+
+// Append-only output buffer. The writers below format directly into it, so emitting IR never
+// goes through stdio or parses a format string.
+typedef struct {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+} outbuf_t;
+
+void outbuf_write(outbuf_t *out, const void *bytes, size_t length);
+void outbuf_char(outbuf_t *out, char c);
+void outbuf_str(outbuf_t *out, const char *cstr);
+void outbuf_sv(outbuf_t *out, sv_t sv);
+void outbuf_u64(outbuf_t *out, uint64_t value);
+void outbuf_i64(outbuf_t *out, int64_t value);
+void outbuf_free(outbuf_t *out);
+
+// String literals only, their length is known at compile time
+#define outbuf_lit(out, lit) outbuf_write((out), "" lit, sizeof(lit) - 1)
+
+// Writes the buffers to fd in order with as few writev calls as possible
+bool outbuf_flush_all(int fd, const outbuf_t *bufs, size_t count);
@@ -1,85 +1,238 @@
 #include "scc.h"
 
+// Window into the token stream that is still to be parsed
 typedef struct {
-    list_t *nodes;
-    lv_t token_view;
-    size_t *result_index;
+    const token_stream_t *stream;
+    size_t start;
+    size_t length;
+} token_view_t;
+
+typedef struct {
+    token_view_t token_view;
+    node_ref_t *result;
+    size_t expr_depth;
 } parse_ctx_t;
 
 node_ref_t ctx_get_result_ref(parse_ctx_t *ctx) {
-    node_ref_t ref = {
-        .nodes = ctx->nodes,
-        .index = *ctx->result_index,
-    };
-    return ref;
+    return *ctx->result;
+}
+
+static void ctx_push(parse_ctx_t *ctx, const node_t *node) {
+    *ctx->result = ast_push(node);
 }
 
 static void ctx_update(parse_ctx_t *ctx, parse_ctx_t *new_ctx, node_t *node) {
-    list_push(new_ctx->nodes, node);
-    *new_ctx->result_index = new_ctx->nodes->length - 1;
+    ctx_push(new_ctx, node);
     *ctx = *new_ctx;
 }
 
-node_t *node_ref_get(node_ref_t ref) {
-    return list_at(ref.nodes, node_t, ref.index);
+// Runs a rule speculatively. Nodes allocated by a rule that fails are unreachable, so they
+// are released right away instead of piling up behind the backtracking.
+static bool try_rule(parse_ctx_t *ctx, bool (*rule)(parse_ctx_t *ctx)) {
+    ast_mark_t mark = ast_mark();
+    if (rule(ctx)) {
+        return true;
+    }
+    ast_release(mark);
+    return false;
+}
+
+// Grammar rules that take only the parse context. Each try_consume_<rule> runs consume_<rule>
+// through run_rule, which keeps the statistics printed by --parse-stats.
+#define PARSE_RULES(X) \
+    X(type) \
+    X(identifier) \
+    X(intlit) \
+    X(charlit) \
+    X(stringlit) \
+    X(parens) \
+    X(index) \
+    X(call) \
+    X(incdec) \
+    X(primary) \
+    X(postfix) \
+    X(cast) \
+    X(unary) \
+    X(expr) \
+    X(var_decl) \
+    X(return) \
+    X(while) \
+    X(for) \
+    X(if) \
+    X(expr_stmt) \
+    X(empty_stmt) \
+    X(break) \
+    X(continue) \
+    X(stmt) \
+    X(block) \
+    X(param) \
+    X(function_signature) \
+    X(function) \
+    X(top_level) \
+    X(file)
+
+typedef enum {
+#define X(rule) PARSE_RULE_##rule,
+    PARSE_RULES(X)
+#undef X
+    PARSE_RULE_prefix,
+    PARSE_RULE_binary,
+    PARSE_RULE_array_decl,
+    PARSE_RULE_COUNT,
+} parse_rule_t;
+
+static const char *parse_rule_names[PARSE_RULE_COUNT] = {
+#define X(rule) [PARSE_RULE_##rule] = #rule,
+    PARSE_RULES(X)
+#undef X
+    [PARSE_RULE_prefix] = "prefix",
+    [PARSE_RULE_binary] = "binary",
+    [PARSE_RULE_array_decl] = "array_decl",
+};
+
+typedef struct {
+    uint64_t attempts;
+    uint64_t successes;
+    uint64_t failures;
+    uint64_t tokens_discarded;  // consumed by failed attempts, including nested rules
+    uint64_t nodes_orphaned;    // allocated by failed attempts, including nested rules
+} parse_rule_stats_t;
+
+static parse_rule_stats_t parse_rule_stats[PARSE_RULE_COUNT];
+
+// Furthest token consumed since the innermost running rule started
+static size_t consumed_high_water;
+
+typedef struct {
+    size_t start;
+    size_t high_water;
+    size_t nodes;
+} rule_frame_t;
+
+static rule_frame_t rule_begin(parse_ctx_t *ctx) {
+    rule_frame_t frame = {
+        .start = ctx->token_view.start,
+        .high_water = consumed_high_water,
+        .nodes = ast_mark().nodes,
+    };
+    consumed_high_water = ctx->token_view.start;
+    return frame;
+}
+
+static bool rule_end(parse_rule_t rule, rule_frame_t frame, bool parsed) {
+    parse_rule_stats_t *stats = &parse_rule_stats[rule];
+    stats->attempts++;
+    if (parsed) {
+        stats->successes++;
+    } else {
+        stats->failures++;
+        stats->tokens_discarded += consumed_high_water - frame.start;
+        stats->nodes_orphaned += ast_mark().nodes - frame.nodes;
+    }
+
+    if (consumed_high_water < frame.high_water) {
+        consumed_high_water = frame.high_water;
+    }
+    return parsed;
+}
+
+static bool run_rule(parse_ctx_t *ctx, parse_rule_t rule, bool (*consume)(parse_ctx_t *ctx)) {
+    rule_frame_t frame = rule_begin(ctx);
+    return rule_end(rule, frame, consume(ctx));
+}
+
+#define X(rule) \
+    static bool consume_##rule(parse_ctx_t *ctx); \
+    static bool try_consume_##rule(parse_ctx_t *ctx) { \
+        return run_rule(ctx, PARSE_RULE_##rule, consume_##rule); \
+    }
+PARSE_RULES(X)
+#undef X
+
+static int compare_rule_stats(const void *a, const void *b) {
+    const parse_rule_stats_t *left = &parse_rule_stats[*(const parse_rule_t *)a];
+    const parse_rule_stats_t *right = &parse_rule_stats[*(const parse_rule_t *)b];
+    if (left->tokens_discarded != right->tokens_discarded) {
+        return left->tokens_discarded < right->tokens_discarded ? 1 : -1;
+    }
+    if (left->attempts != right->attempts) {
+        return left->attempts < right->attempts ? 1 : -1;
+    }
+    return 0;
 }
 
-bool node_ref_is_null(node_ref_t ref) {
-    return ref.nodes == NULL;
+void parse_stats_print(FILE *file) {
+    parse_rule_t rules[PARSE_RULE_COUNT];
+    for (size_t i = 0; i < PARSE_RULE_COUNT; i++) {
+        rules[i] = (parse_rule_t)i;
+    }
+    qsort(rules, PARSE_RULE_COUNT, sizeof(rules[0]), compare_rule_stats);
+
+    fprintf(file, "%-20s %12s %12s %12s %12s %12s\n", "rule", "attempts", "successes", "failures", "discarded", "orphaned");
+    for (size_t i = 0; i < PARSE_RULE_COUNT; i++) {
+        const parse_rule_stats_t *stats = &parse_rule_stats[rules[i]];
+        if (stats->attempts == 0) {
+            continue;
+        }
+        fprintf(
+            file, "%-20s %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+            parse_rule_names[rules[i]], stats->attempts, stats->successes, stats->failures,
+            stats->tokens_discarded, stats->nodes_orphaned
+        );
+    }
 }
 
 void node_print(node_ref_t ref) {
-    node_t *node = node_ref_get(ref);
+    node_t node = node_ref_get(ref);
 
-    switch (node->type) {
+    switch (node.type) {
         case NODE_INTLIT:
-            token_print(&node->as.intlit);
+            fprintf(stderr, "INTLIT(%d)", node.as.intlit);
             break;
         case NODE_ADD:
             fprintf(stderr, "ADD(");
-            node_print(node->as.binop.left_ref);
+            node_print(node.as.binop.left_ref);
             fprintf(stderr, ", ");
-            node_print(node->as.binop.right_ref);
+            node_print(node.as.binop.right_ref);
             fprintf(stderr, ")");
             break;
         case NODE_MULT:
             fprintf(stderr, "MULT(");
-            node_print(node->as.binop.left_ref);
+            node_print(node.as.binop.left_ref);
             fprintf(stderr, ", ");
-            node_print(node->as.binop.right_ref);
+            node_print(node.as.binop.right_ref);
             fprintf(stderr, ")");
             break;
         case NODE_SUB:
             fprintf(stderr, "SUB(");
-            node_print(node->as.binop.left_ref);
+            node_print(node.as.binop.left_ref);
             fprintf(stderr, ", ");
-            node_print(node->as.binop.right_ref);
+            node_print(node.as.binop.right_ref);
             fprintf(stderr, ")");
             break;
         case NODE_DIV:
             fprintf(stderr, "DIV(");
-            node_print(node->as.binop.left_ref);
+            node_print(node.as.binop.left_ref);
             fprintf(stderr, ", ");
-            node_print(node->as.binop.right_ref);
+            node_print(node.as.binop.right_ref);
             fprintf(stderr, ")");
             break;
         case NODE_VAR_DECL:
             fprintf(stderr, "VAR_DECL(");
-            node_print(node->as.var_decl.type_ref);
+            node_print(node.as.var_decl.type_ref);
             fprintf(stderr, ", ");
-            fprintf(stderr, "IDENTIFIER(%s)", node->as.var_decl.name->as.identifier);
-            if (!node_ref_is_null(node->as.var_decl.init_expr_ref)) {
+            fprintf(stderr, "IDENTIFIER(%s)", name_cstr(node.as.var_decl.name));
+            if (!node_ref_is_null(node.as.var_decl.init_expr_ref)) {
                 fprintf(stderr, ", ");
-                node_print(node->as.var_decl.init_expr_ref);
+                node_print(node.as.var_decl.init_expr_ref);
             }
             fprintf(stderr, ")");
             break;
         case NODE_BLOCK:
             fprintf(stderr, "BLOCK{");
-            for (size_t i = 0; i < node->as.block.length; i++) {
-                node_ref_t stmt_ref = *(node_ref_t *)list_at(&node->as.block, node_ref_t, i);
-                node_print(stmt_ref);
-                if (i + 1 < node->as.block.length) {
+            for (size_t i = 0; i < node.as.block.length; i++) {
+                node_print(node_list_at(node.as.block, i));
+                if (i + 1 < node.as.block.length) {
                     fprintf(stderr, ", ");
                 }
             }
@@ -93,40 +246,51 @@ void node_print(node_ref_t ref) {
             break;
         case NODE_ASSIGNMENT:
             fprintf(stderr, "ASSIGNMENT(");
-            node_print(node->as.binop.left_ref);
+            node_print(node.as.binop.left_ref);
             fprintf(stderr, ", ");
-            node_print(node->as.binop.right_ref);
+            node_print(node.as.binop.right_ref);
             fprintf(stderr, ")");
             break;
         case NODE_IDENTIFIER:
-            token_print(&node->as.identifier);
+            fprintf(stderr, "IDENTIFIER(%s)", name_cstr(node.as.identifier));
             break;
         default:
             unreachable();
     }
 }
 
-static bool try_consume_stmt(parse_ctx_t *ctx);
-static bool try_consume_block(parse_ctx_t *ctx);
-
-static bool try_consume_token(parse_ctx_t *ctx, token_type_t expected_type, token_t **token) {
-    if (ctx->token_view.length == 0) {
+// Kind of the index-th remaining token, peeking only touches the kinds array
+static bool token_view_peek(const token_view_t *view, size_t index, token_type_t *type) {
+    if (index >= view->length) {
         return false;
     }
-    if (lv_at(&ctx->token_view, token_t, 0)->type != expected_type) {
+    *type = token_stream_kind(view->stream, view->start + index);
+    return true;
+}
+
+static void ctx_advance(parse_ctx_t *ctx) {
+    ctx->token_view.start++;
+    ctx->token_view.length--;
+    if (ctx->token_view.start > consumed_high_water) {
+        consumed_high_water = ctx->token_view.start;
+    }
+}
+
+static bool try_consume_token(parse_ctx_t *ctx, token_type_t expected_type, token_t *token) {
+    token_type_t type;
+    if (!token_view_peek(&ctx->token_view, 0, &type) || type != expected_type) {
         return false;
     }
 
     if (token) {
-        *token = lv_at(&ctx->token_view, token_t, 0);
+        *token = token_stream_get(ctx->token_view.stream, ctx->token_view.start);
     }
 
-    ctx->token_view.start++;
-    ctx->token_view.length--;
+    ctx_advance(ctx);
     return true;
 }
 
-static bool try_consume_type(parse_ctx_t *ctx) {
+static bool consume_type(parse_ctx_t *ctx) {
     trace("+ try_consume_type\n");
     parse_ctx_t new_ctx = *ctx;
 
@@ -144,38 +308,40 @@ static bool try_consume_type(parse_ctx_t *ctx) {
         .as.type.is_signed = !is_unsigned,
     };
 
-    token_t *token = lv_at(&new_ctx.token_view, token_t, 0);
-    type_node.source_loc = token->source_loc;
-    if (token->type == TOKEN_INT) {
+    token_type_t token_type;
+    if (!token_view_peek(&new_ctx.token_view, 0, &token_type)) {
+        trace("- try_consume_type: false\n");
+        return false;
+    }
+
+    if (token_type == TOKEN_INT) {
         type_node.type = NODE_INT;
-    } else if (token->type == TOKEN_FLOAT) {
+    } else if (token_type == TOKEN_FLOAT) {
         type_node.type = NODE_FLOAT;
-    } else if (token->type == TOKEN_VOID) {
+    } else if (token_type == TOKEN_VOID) {
         type_node.type = NODE_VOID;
-    } else if (token->type == TOKEN_CHAR) {
+    } else if (token_type == TOKEN_CHAR) {
         type_node.type = NODE_CHAR;
-    } else if (token->type == TOKEN_LONG) {
+    } else if (token_type == TOKEN_LONG) {
         type_node.type = NODE_LONG;
     } else {
         trace("- try_consume_type: false\n");
         return false;
     }
 
-    new_ctx.token_view.start++;
-    new_ctx.token_view.length--;
+    type_node.source_loc = token_stream_get(new_ctx.token_view.stream, new_ctx.token_view.start).source_loc;
+    ctx_advance(&new_ctx);
 
-    list_push(new_ctx.nodes, &type_node);
-    *new_ctx.result_index = new_ctx.nodes->length - 1;
+    ctx_push(&new_ctx, &type_node);
 
-    token_t *star_token;
+    token_t star_token;
     while (try_consume_token(&new_ctx, TOKEN_STAR, &star_token)) {
         node_t ptr_node = {
             .type = NODE_PTR_TYPE,
-            .source_loc = star_token->source_loc,
+            .source_loc = star_token.source_loc,
             .as.ptr_type.base_type_ref = ctx_get_result_ref(&new_ctx),
         };
-        list_push(new_ctx.nodes, &ptr_node);
-        *new_ctx.result_index = new_ctx.nodes->length - 1;
+        ctx_push(&new_ctx, &ptr_node);
     }
 
     *ctx = new_ctx;
@@ -183,13 +349,11 @@ static bool try_consume_type(parse_ctx_t *ctx) {
     return true;
 }
 
-static bool try_consume_expr_0(parse_ctx_t *ctx);
-
-static bool try_consume_identifier(parse_ctx_t *ctx) {
+static bool consume_identifier(parse_ctx_t *ctx) {
     trace("+ try_consume_identifier\n");
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *identifier_token;
+    token_t identifier_token;
     if (!try_consume_token(&new_ctx, TOKEN_IDENTIFIER, &identifier_token)) {
         trace("- try_consume_identifier: false\n");
         return false;
@@ -197,8 +361,8 @@ static bool try_consume_identifier(parse_ctx_t *ctx) {
 
     node_t var_node = {
         .type = NODE_IDENTIFIER,
-        .source_loc = identifier_token->source_loc,
-        .as.identifier = *identifier_token,
+        .source_loc = identifier_token.source_loc,
+        .as.identifier = identifier_token.as.identifier,
     };
     ctx_update(ctx, &new_ctx, &var_node);
 
@@ -206,11 +370,11 @@ static bool try_consume_identifier(parse_ctx_t *ctx) {
     return true;
 }
 
-static bool try_consume_intlit(parse_ctx_t *ctx) {
+static bool consume_intlit(parse_ctx_t *ctx) {
     trace("+ try_consume_intlit\n");
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *intlit_token;
+    token_t intlit_token;
     if (!try_consume_token(&new_ctx, TOKEN_INTLIT, &intlit_token)) {
         trace("- try_consume_intlit: false\n");
         return false;
@@ -218,8 +382,8 @@ static bool try_consume_intlit(parse_ctx_t *ctx) {
 
     node_t node = {
         .type = NODE_INTLIT,
-        .source_loc = intlit_token->source_loc,
-        .as.intlit = *intlit_token
+        .source_loc = intlit_token.source_loc,
+        .as.intlit = intlit_token.as.intlit,
     };
     ctx_update(ctx, &new_ctx, &node);
 
@@ -227,11 +391,11 @@ static bool try_consume_intlit(parse_ctx_t *ctx) {
     return true;
 }
 
-static bool try_consume_charlit(parse_ctx_t *ctx) {
+static bool consume_charlit(parse_ctx_t *ctx) {
     trace("+ try_consume_charlit\n");
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *charlit_token;
+    token_t charlit_token;
     if (!try_consume_token(&new_ctx, TOKEN_CHARLIT, &charlit_token)) {
         trace("- try_consume_charlit: false\n");
         return false;
@@ -239,8 +403,8 @@ static bool try_consume_charlit(parse_ctx_t *ctx) {
 
     node_t node = {
         .type = NODE_CHARLIT,
-        .source_loc = charlit_token->source_loc,
-        .as.charlit = *charlit_token
+        .source_loc = charlit_token.source_loc,
+        .as.charlit = charlit_token.as.charlit,
     };
     ctx_update(ctx, &new_ctx, &node);
 
@@ -248,11 +412,11 @@ static bool try_consume_charlit(parse_ctx_t *ctx) {
     return true;
 }
 
-static bool try_consume_stringlit(parse_ctx_t *ctx) {
+static bool consume_stringlit(parse_ctx_t *ctx) {
     trace("+ try_consume_stringlit\n");
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *stringlit_token;
+    token_t stringlit_token;
     if (!try_consume_token(&new_ctx, TOKEN_STRINGLIT, &stringlit_token)) {
         trace("- try_consume_stringlit: false\n");
         return false;
@@ -260,8 +424,8 @@ static bool try_consume_stringlit(parse_ctx_t *ctx) {
 
     node_t node = {
         .type = NODE_STRINGLIT,
-        .source_loc = stringlit_token->source_loc,
-        .as.stringlit = *stringlit_token
+        .source_loc = stringlit_token.source_loc,
+        .as.stringlit = stringlit_token.as.stringlit,
     };
     ctx_update(ctx, &new_ctx, &node);
 
@@ -269,19 +433,16 @@ static bool try_consume_stringlit(parse_ctx_t *ctx) {
     return true;
 }
 
-static bool try_consume_expr_0(parse_ctx_t *ctx);
-static bool try_consume_expr_2(parse_ctx_t *ctx);
-
-static bool try_consume_parens(parse_ctx_t *ctx) {
+static bool consume_parens(parse_ctx_t *ctx) {
     trace("+ try_consume_parens\n");
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *lpar_token;
+    token_t lpar_token;
     if (!try_consume_token(&new_ctx, TOKEN_LPAREN, &lpar_token)) {
         trace("- try_consume_parens: false\n");
         return false;
     }
-    if (!try_consume_expr_0(&new_ctx)) {
+    if (!try_consume_expr(&new_ctx)) {
         trace("- try_consume_parens: false\n");
         return false;
     }
@@ -290,698 +451,417 @@ static bool try_consume_parens(parse_ctx_t *ctx) {
         return false;
     }
 
-    node_t *expr_node = node_ref_get(ctx_get_result_ref(&new_ctx));
-    expr_node->source_loc = lpar_token->source_loc;
-    ctx_update(ctx, &new_ctx, expr_node);
+    // The inner expression is the result, it just takes the location of the parenthesis
+    node_ref_set_loc(ctx_get_result_ref(&new_ctx), lpar_token.source_loc);
+    *ctx = new_ctx;
 
     trace("- try_consume_parens: true\n");
     return true;
 }
 
-static bool try_consume_index(parse_ctx_t *ctx) {
+static bool consume_index(parse_ctx_t *ctx) {
     trace("+ try_consume_index\n");
     parse_ctx_t new_ctx = *ctx;
 
-    bool parsed = false;
-
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_LBRACK, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
-
-        node_ref_t index_ref;
-        if (!try_consume_expr_0(&new_ctx)) {
-            trace("- try_consume_index: false\n");
-            return false;
-        }
-        index_ref = ctx_get_result_ref(&new_ctx);
-
-        node_t index_node = {
-            .type = NODE_INDEX,
-            .source_loc = source_loc,
-            .as.index = {
-                .expr_ref = left_ref,
-                .index_ref = index_ref,
-            }
-        };
-        ctx_update(ctx, &new_ctx, &index_node);
-        parsed = true;
-    }
-
-    if (!try_consume_token(&new_ctx, TOKEN_RBRACK, NULL)) {
+    node_ref_t left_ref = ctx_get_result_ref(&new_ctx);
+    if (!try_consume_token(&new_ctx, TOKEN_LBRACK, NULL)) {
         trace("- try_consume_index: false\n");
         return false;
     }
 
-    if (parsed) {
-        ctx_update(ctx, &new_ctx, node_ref_get(ctx_get_result_ref(&new_ctx)));
-        trace("- try_consume_index: true\n");
-    } else {
+    if (!try_consume_expr(&new_ctx)) {
         trace("- try_consume_index: false\n");
-    }
-    return parsed;
-}
-
-static bool try_consume_call(parse_ctx_t *ctx) {
-    trace("+ try_consume_call\n");
-    parse_ctx_t new_ctx = *ctx;
-
-    bool parsed = false;
-
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_LPAREN, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
-
-        list_t arg_refs = { .element_size = sizeof(node_ref_t) };
-        while (true) {
-            if (try_consume_token(&new_ctx, TOKEN_RPAREN, NULL)) {
-                break;
-            }
-            if (arg_refs.length > 0) {
-                if (!try_consume_token(&new_ctx, TOKEN_COMMA, NULL)) {
-                    trace("- try_consume_call: false\n");
-                    return false;
-                }
-            }
-            if (!try_consume_expr_0(&new_ctx)) {
-                trace("- try_consume_call: false\n");
-                return false;
-            }
-            node_ref_t arg_ref = ctx_get_result_ref(&new_ctx);
-            list_push(&arg_refs, &arg_ref);
-        }
-
-        node_t call_node = {
-            .type = NODE_CALL,
-            .source_loc = source_loc,
-            .as.call = {
-                .function_ref = left_ref,
-                .arg_refs = arg_refs,
-            }
-        };
-        ctx_update(ctx, &new_ctx, &call_node);
-        parsed = true;
-    }
-
-    if (parsed) {
-        trace("- try_consume_call: true\n");
-    } else {
-        trace("- try_consume_call: false\n");
-    }
-    return parsed;
-}
-
-static bool try_consume_cast(parse_ctx_t *ctx) {
-    trace("+ try_consume_cast\n");
-    parse_ctx_t new_ctx = *ctx;
-
-    token_t *lpar_token;
-    if (!try_consume_token(&new_ctx, TOKEN_LPAREN, &lpar_token)) {
-        trace("- try_consume_cast: false\n");
-        return false;
-    }
-
-    if (!try_consume_type(&new_ctx)) {
-        trace("- try_consume_cast: false\n");
-        return false;
-    }
-    node_ref_t target_type_ref = ctx_get_result_ref(&new_ctx);
-
-    if (!try_consume_token(&new_ctx, TOKEN_RPAREN, NULL)) {
-        trace("- try_consume_cast: false\n");
         return false;
     }
+    node_ref_t index_ref = ctx_get_result_ref(&new_ctx);
 
-    if (!try_consume_expr_2(&new_ctx)) {
-        trace("- try_consume_cast: false\n");
+    if (!try_consume_token(&new_ctx, TOKEN_RBRACK, NULL)) {
+        trace("- try_consume_index: false\n");
         return false;
     }
-    node_ref_t expr_ref = ctx_get_result_ref(&new_ctx);
 
-    node_t cast_node = {
-        .type = NODE_CAST,
-        .source_loc = lpar_token->source_loc,
-        .as.cast.target_type_ref = target_type_ref,
-        .as.cast.expr_ref = expr_ref,
+    node_t index_node = {
+        .type = NODE_INDEX,
+        .source_loc = node_ref_loc(left_ref),
+        .as.index = {
+            .expr_ref = left_ref,
+            .index_ref = index_ref,
+        }
     };
-    ctx_update(ctx, &new_ctx, &cast_node);
+    ctx_update(ctx, &new_ctx, &index_node);
 
-    trace("- try_consume_cast: true\n");
+    trace("- try_consume_index: true\n");
     return true;
 }
 
-static bool try_consume_address_of(parse_ctx_t *ctx) {
-    trace("+ try_consume_address_of\n");
+static bool consume_call(parse_ctx_t *ctx) {
+    trace("+ try_consume_call\n");
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *amp_token;
-    if (!try_consume_token(&new_ctx, TOKEN_AMPERSAND, &amp_token)) {
-        trace("- try_consume_address_of: false\n");
+    node_ref_t left_ref = ctx_get_result_ref(&new_ctx);
+    if (!try_consume_token(&new_ctx, TOKEN_LPAREN, NULL)) {
+        trace("- try_consume_call: false\n");
         return false;
     }
 
-    if (!try_consume_expr_0(&new_ctx)) {
-        trace("- try_consume_address_of: false\n");
-        return false;
+    size_t args_start = ast_scratch_start();
+    while (!try_consume_token(&new_ctx, TOKEN_RPAREN, NULL)) {
+        if (ast_scratch_count(args_start) > 0) {
+            if (!try_consume_token(&new_ctx, TOKEN_COMMA, NULL)) {
+                trace("- try_consume_call: false\n");
+                return false;
+            }
+        }
+        if (!try_consume_expr(&new_ctx)) {
+            trace("- try_consume_call: false\n");
+            return false;
+        }
+        ast_scratch_push(ctx_get_result_ref(&new_ctx));
     }
-    node_ref_t expr_ref = ctx_get_result_ref(&new_ctx);
+    node_list_t arg_refs = ast_scratch_finish(args_start);
 
-    node_t ptr_node = {
-        .type = NODE_ADDRESS_OF,
-        .source_loc = amp_token->source_loc,
-        .as.address_of.expr_ref = expr_ref,
+    node_t call_node = {
+        .type = NODE_CALL,
+        .source_loc = node_ref_loc(left_ref),
+        .as.call = {
+            .function_ref = left_ref,
+            .arg_refs = arg_refs,
+        }
     };
-    ctx_update(ctx, &new_ctx, &ptr_node);
+    ctx_update(ctx, &new_ctx, &call_node);
 
-    trace("- try_consume_address_of: true\n");
+    trace("- try_consume_call: true\n");
     return true;
 }
 
-static bool try_consume_deref(parse_ctx_t *ctx) {
-    trace("+ try_consume_deref\n");
+// Postfix ++ and --
+static bool consume_incdec(parse_ctx_t *ctx) {
+    trace("+ try_consume_incdec\n");
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *star_token;
-    if (!try_consume_token(&new_ctx, TOKEN_STAR, &star_token)) {
-        trace("- try_consume_deref: false\n");
-        return false;
-    }
-
-    if (!try_consume_expr_0(&new_ctx)) {
-        trace("- try_consume_deref: false\n");
-        return false;
-    }
     node_ref_t expr_ref = ctx_get_result_ref(&new_ctx);
 
-    node_t deref_node = {
-        .type = NODE_DEREF,
-        .source_loc = star_token->source_loc,
-        .as.deref.expr_ref = expr_ref,
-    };
-    ctx_update(ctx, &new_ctx, &deref_node);
-
-    trace("- try_consume_deref: true\n");
-    return true;
-}
-
-static bool try_consume_negate(parse_ctx_t *ctx) {
-    trace("+ try_consume_negate\n");
-    parse_ctx_t new_ctx = *ctx;
-
-    token_t *minus_token;
-    if (!try_consume_token(&new_ctx, TOKEN_MINUS, &minus_token)) {
-        trace("- try_consume_negate: false\n");
-        return false;
-    }
-
-    if (!try_consume_expr_0(&new_ctx)) {
-        trace("- try_consume_negate: false\n");
+    node_type_t node_type;
+    if (try_consume_token(&new_ctx, TOKEN_INC, NULL)) {
+        node_type = NODE_POSTINC;
+    } else if (try_consume_token(&new_ctx, TOKEN_DEC, NULL)) {
+        node_type = NODE_POSTDEC;
+    } else {
+        trace("- try_consume_incdec: false\n");
         return false;
     }
-    node_ref_t expr_ref = ctx_get_result_ref(&new_ctx);
 
-    node_t negate_node = {
-        .type = NODE_NEGATE,
-        .source_loc = minus_token->source_loc,
-        .as.negate.expr_ref = expr_ref,
+    node_t incdec_node = {
+        .type = node_type,
+        .source_loc = node_ref_loc(expr_ref),
+        .as.incdec.expr_ref = expr_ref,
     };
-    ctx_update(ctx, &new_ctx, &negate_node);
+    ctx_update(ctx, &new_ctx, &incdec_node);
 
-    trace("- try_consume_negate: true\n");
+    trace("- try_consume_incdec: true\n");
     return true;
 }
 
-static bool try_consume_expr_3(parse_ctx_t *ctx) {
-    trace("| try_consume_expr_3\n");
-    return try_consume_deref(ctx)
-        || try_consume_negate(ctx)
-        || try_consume_address_of(ctx)
-        || try_consume_cast(ctx)
-        || try_consume_parens(ctx)
-        || try_consume_identifier(ctx)
-        || try_consume_intlit(ctx)
-        || try_consume_stringlit(ctx)
-        || try_consume_charlit(ctx);
-}
-
-static bool try_consume_postinc(parse_ctx_t *ctx) {
-    trace("+ try_consume_postinc\n");
-    parse_ctx_t new_ctx = *ctx;
-
-    node_ref_t expr_ref = ctx_get_result_ref(&new_ctx);
-
-    if (!try_consume_token(&new_ctx, TOKEN_INC, NULL)) {
-        trace("- try_consume_postinc: false\n");
+static bool consume_primary(parse_ctx_t *ctx) {
+    token_type_t type;
+    if (!token_view_peek(&ctx->token_view, 0, &type)) {
         return false;
     }
 
-    node_t postinc_node = {
-        .type = NODE_POSTINC,
-        .source_loc = node_ref_get(expr_ref)->source_loc,
-        .as.postinc.expr_ref = expr_ref,
-    };
-    ctx_update(ctx, &new_ctx, &postinc_node);
-
-    trace("- try_consume_postinc: true\n");
-    return true;
+    switch (type) {
+        case TOKEN_LPAREN:
+            return try_consume_parens(ctx);
+        case TOKEN_IDENTIFIER:
+            return try_consume_identifier(ctx);
+        case TOKEN_INTLIT:
+            return try_consume_intlit(ctx);
+        case TOKEN_STRINGLIT:
+            return try_consume_stringlit(ctx);
+        case TOKEN_CHARLIT:
+            return try_consume_charlit(ctx);
+        default:
+            return false;
+    }
 }
 
-static bool try_consume_expr_2(parse_ctx_t *ctx) {
-    trace("| try_consume_expr_2\n");
+static bool consume_postfix(parse_ctx_t *ctx) {
+    trace("| try_consume_postfix\n");
 
-    if (!try_consume_expr_3(ctx)) {
+    if (!try_consume_primary(ctx)) {
         return false;
     }
 
-    while (ctx->token_view.length > 0) {
-        if (try_consume_postinc(ctx)) {
-            continue;
+    while (true) {
+        token_type_t type;
+        if (!token_view_peek(&ctx->token_view, 0, &type)) {
+            break;
         }
 
-        while (ctx->token_view.length > 0) {
-            if (try_consume_call(ctx)) {
-                continue;
-            }
-            if (try_consume_index(ctx)) {
-                continue;
-            }
+        bool parsed;
+        if (type == TOKEN_INC || type == TOKEN_DEC) {
+            parsed = try_consume_incdec(ctx);
+        } else if (type == TOKEN_LPAREN) {
+            parsed = try_consume_call(ctx);
+        } else if (type == TOKEN_LBRACK) {
+            parsed = try_consume_index(ctx);
+        } else {
             break;
         }
-
-        if (try_consume_postinc(ctx)) {
-            continue;
+        if (!parsed) {
+            return false;
         }
-
-        break;
     }
 
     return true;
 }
 
-// TODO: All this new_ctx stuff can be abstracted
-// TODO: All this binop parsing can be abstracted
-// TODO: Come up with a way to handle precedence with some sort of map or something, not this expr_1, expr_0, expr_3, etc. mess...
-static bool try_consume_mult(parse_ctx_t *ctx) {
-    trace("+ try_consume_mult\n");
+static bool consume_cast(parse_ctx_t *ctx) {
+    trace("+ try_consume_cast\n");
     parse_ctx_t new_ctx = *ctx;
 
-    bool parsed = false;
-
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_STAR, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
-
-        if (!try_consume_expr_2(&new_ctx)) {
-            trace("- try_consume_mult: false\n");
-            return false;
-        }
-        node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
-
-        node_t mult_node = {
-            .type = NODE_MULT,
-            .source_loc = source_loc,
-            .as.binop = {
-                .left_ref = left_ref,
-                .right_ref = right_ref
-            }
-        };
-        ctx_update(ctx, &new_ctx, &mult_node);
-        parsed = true;
-    }
-
-    if (parsed) {
-        trace("- try_consume_mult: true\n");
-    } else {
-        trace("- try_consume_mult: false\n");
+    token_t lpar_token;
+    if (!try_consume_token(&new_ctx, TOKEN_LPAREN, &lpar_token)) {
+        trace("- try_consume_cast: false\n");
+        return false;
     }
-    return parsed;
-}
-
-static bool try_consume_div(parse_ctx_t *ctx) {
-    trace("+ try_consume_div\n");
-    parse_ctx_t new_ctx = *ctx;
 
-    bool parsed = false;
-
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_SLASH, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
-
-        if (!try_consume_expr_2(&new_ctx)) {
-            trace("- try_consume_div: false\n");
-            return false;
-        }
-        node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
-
-        node_t div_node = {
-            .type = NODE_DIV,
-            .source_loc = source_loc,
-            .as.binop = {
-                .left_ref = left_ref,
-                .right_ref = right_ref
-            }
-        };
-        ctx_update(ctx, &new_ctx, &div_node);
-        parsed = true;
+    if (!try_consume_type(&new_ctx)) {
+        trace("- try_consume_cast: false\n");
+        return false;
     }
+    node_ref_t target_type_ref = ctx_get_result_ref(&new_ctx);
 
-    if (parsed) {
-        trace("- try_consume_div: true\n");
-    } else {
-        trace("- try_consume_div: false\n");
+    if (!try_consume_token(&new_ctx, TOKEN_RPAREN, NULL)) {
+        trace("- try_consume_cast: false\n");
+        return false;
     }
-    return parsed;
-}
-
-static bool try_consume_expr_1(parse_ctx_t *ctx) {
-    trace("| try_consume_expr_1\n");
 
-    if (!try_consume_expr_2(ctx)) {
+    if (!try_consume_unary(&new_ctx)) {
+        trace("- try_consume_cast: false\n");
         return false;
     }
+    node_ref_t expr_ref = ctx_get_result_ref(&new_ctx);
 
-    while (ctx->token_view.length > 0) {
-        if (try_consume_mult(ctx)) {
-            continue;
-        }
-        if (try_consume_div(ctx)) {
-            continue;
-        }
-        break;
-    }
+    node_t cast_node = {
+        .type = NODE_CAST,
+        .source_loc = lpar_token.source_loc,
+        .as.cast.target_type_ref = target_type_ref,
+        .as.cast.expr_ref = expr_ref,
+    };
+    ctx_update(ctx, &new_ctx, &cast_node);
 
+    trace("- try_consume_cast: true\n");
     return true;
 }
 
-static bool try_consume_add(parse_ctx_t *ctx) {
-    trace("+ try_consume_add\n");
-    parse_ctx_t new_ctx = *ctx;
-
-    bool parsed = false;
-
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_PLUS, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
-
-        if (!try_consume_expr_1(&new_ctx)) {
-            trace("- try_consume_add: false\n");
-            return false;
-        }
-        node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
-
-        node_t add_node = {
-            .type = NODE_ADD,
-            .source_loc = source_loc,
-            .as.binop = {
-                .left_ref = left_ref,
-                .right_ref = right_ref
-            }
-        };
-        ctx_update(ctx, &new_ctx, &add_node);
-        parsed = true;
-    }
+// Prefix operators, all of them build a node with a single operand
+static bool consume_prefix(parse_ctx_t *ctx, token_type_t token_type, node_type_t node_type);
 
-    if (parsed) {
-        trace("- try_consume_add: true\n");
-    } else {
-        trace("- try_consume_add: false\n");
-    }
-    return parsed;
+static bool try_consume_prefix(parse_ctx_t *ctx, token_type_t token_type, node_type_t node_type) {
+    rule_frame_t frame = rule_begin(ctx);
+    return rule_end(PARSE_RULE_prefix, frame, consume_prefix(ctx, token_type, node_type));
 }
 
-static bool try_consume_sub(parse_ctx_t *ctx) {
+static bool consume_prefix(parse_ctx_t *ctx, token_type_t token_type, node_type_t node_type) {
+    trace("+ try_consume_prefix\n");
     parse_ctx_t new_ctx = *ctx;
 
-    bool parsed = false;
-
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_MINUS, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
-
-        if (!try_consume_expr_1(&new_ctx)) {
-            return false;
-        }
-        node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
-
-        node_t sub_node = {
-            .type = NODE_SUB,
-            .source_loc = source_loc,
-            .as.binop = {
-                .left_ref = left_ref,
-                .right_ref = right_ref
-            }
-        };
-        ctx_update(ctx, &new_ctx, &sub_node);
-        parsed = true;
+    token_t op_token;
+    if (!try_consume_token(&new_ctx, token_type, &op_token)) {
+        trace("- try_consume_prefix: false\n");
+        return false;
     }
 
-    if (parsed) {
-        trace("try_consume_sub succeeded\n");
+    if (!try_consume_unary(&new_ctx)) {
+        trace("- try_consume_prefix: false\n");
+        return false;
     }
-    return parsed;
-}
-
-static bool try_consume_neq(parse_ctx_t *ctx) {
-    parse_ctx_t new_ctx = *ctx;
-
-    bool parsed = false;
-
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_NEQ, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
-
-        if (!try_consume_expr_1(&new_ctx)) {
-            return false;
-        }
-        node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
+    node_ref_t expr_ref = ctx_get_result_ref(&new_ctx);
 
-        node_t neq_node = {
-            .type = NODE_NEQ,
-            .source_loc = source_loc,
-            .as.binop = {
-                .left_ref = left_ref,
-                .right_ref = right_ref
-            }
-        };
-        ctx_update(ctx, &new_ctx, &neq_node);
-        parsed = true;
+    node_t node = {
+        .type = node_type,
+        .source_loc = op_token.source_loc,
+    };
+    switch (node_type) {
+        case NODE_DEREF:
+            node.as.deref.expr_ref = expr_ref;
+            break;
+        case NODE_NEGATE:
+            node.as.negate.expr_ref = expr_ref;
+            break;
+        case NODE_ADDRESS_OF:
+            node.as.address_of.expr_ref = expr_ref;
+            break;
+        case NODE_PREINC:
+        case NODE_PREDEC:
+            node.as.incdec.expr_ref = expr_ref;
+            break;
+        default:
+            unreachable();
     }
+    ctx_update(ctx, &new_ctx, &node);
 
-    if (parsed) {
-        trace("try_consume_neq succeeded\n");
-    }
-    return parsed;
+    trace("- try_consume_prefix: true\n");
+    return true;
 }
 
-static bool try_consume_eqeq(parse_ctx_t *ctx) {
-    parse_ctx_t new_ctx = *ctx;
-
-    bool parsed = false;
-
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_EQEQ, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
-
-        if (!try_consume_expr_1(&new_ctx)) {
+static bool token_starts_type(token_type_t type) {
+    switch (type) {
+        case TOKEN_INT:
+        case TOKEN_FLOAT:
+        case TOKEN_VOID:
+        case TOKEN_CHAR:
+        case TOKEN_LONG:
+        case TOKEN_UNSIGNED:
+            return true;
+        default:
             return false;
-        }
-        node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
-
-        node_t eqeq_node = {
-            .type = NODE_EQEQ,
-            .source_loc = source_loc,
-            .as.binop = {
-                .left_ref = left_ref,
-                .right_ref = right_ref
-            }
-        };
-        ctx_update(ctx, &new_ctx, &eqeq_node);
-        parsed = true;
     }
-
-    if (parsed) {
-        trace("try_consume_eqeq succeeded\n");
-    }
-    return parsed;
 }
 
-static bool try_consume_andand(parse_ctx_t *ctx) {
-    parse_ctx_t new_ctx = *ctx;
-
-    bool parsed = false;
-
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_ANDAND, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
-
-        if (!try_consume_expr_1(&new_ctx)) {
-            return false;
-        }
-        node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
-
-        node_t andand_node = {
-            .type = NODE_ANDAND,
-            .source_loc = source_loc,
-            .as.binop = {
-                .left_ref = left_ref,
-                .right_ref = right_ref
-            }
-        };
-        ctx_update(ctx, &new_ctx, &andand_node);
-        parsed = true;
+static bool consume_unary(parse_ctx_t *ctx) {
+    token_type_t type;
+    if (!token_view_peek(&ctx->token_view, 0, &type)) {
+        return false;
     }
 
-    if (parsed) {
-        trace("try_consume_andand succeeded\n");
+    // Every level of nested prefix operators and parentheses passes through here, so deeply
+    // nested input is rejected before it can run the parser out of stack
+    if (ctx->expr_depth >= PARSE_MAX_EXPR_DEPTH) {
+        report_error(token_stream_get(ctx->token_view.stream, ctx->token_view.start).source_loc, "Expression is nested too deeply");
     }
-    return parsed;
-}
-
-static bool try_consume_gt(parse_ctx_t *ctx) {
-    parse_ctx_t new_ctx = *ctx;
-
-    bool parsed = false;
+    ctx->expr_depth++;
 
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_GT, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
-
-        if (!try_consume_expr_1(&new_ctx)) {
-            return false;
-        }
-        node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
-
-        node_t gt_node = {
-            .type = NODE_GT,
-            .source_loc = source_loc,
-            .as.binop = {
-                .left_ref = left_ref,
-                .right_ref = right_ref
+    bool parsed;
+    switch (type) {
+        case TOKEN_STAR:
+            parsed = try_consume_prefix(ctx, TOKEN_STAR, NODE_DEREF);
+            break;
+        case TOKEN_MINUS:
+            parsed = try_consume_prefix(ctx, TOKEN_MINUS, NODE_NEGATE);
+            break;
+        case TOKEN_AMPERSAND:
+            parsed = try_consume_prefix(ctx, TOKEN_AMPERSAND, NODE_ADDRESS_OF);
+            break;
+        case TOKEN_INC:
+            parsed = try_consume_prefix(ctx, TOKEN_INC, NODE_PREINC);
+            break;
+        case TOKEN_DEC:
+            parsed = try_consume_prefix(ctx, TOKEN_DEC, NODE_PREDEC);
+            break;
+        case TOKEN_LPAREN: {
+            // A type right after the parenthesis decides between a cast and a parenthesized expression
+            token_type_t next_type;
+            if (token_view_peek(&ctx->token_view, 1, &next_type) && token_starts_type(next_type)) {
+                parsed = try_consume_cast(ctx);
+            } else {
+                parsed = try_consume_postfix(ctx);
             }
-        };
-        ctx_update(ctx, &new_ctx, &gt_node);
-        parsed = true;
-    }
-
-    if (parsed) {
-        trace("try_consume_gt succeeded\n");
+        } break;
+        default:
+            parsed = try_consume_postfix(ctx);
+            break;
     }
+    ctx->expr_depth--;
     return parsed;
 }
 
-static bool try_consume_lt(parse_ctx_t *ctx) {
-    parse_ctx_t new_ctx = *ctx;
-
-    bool parsed = false;
-
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_LT, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
+typedef enum {
+    PREC_NONE,  // not a binary operator
+    PREC_LOGICAL_AND,
+    PREC_EQUALITY,
+    PREC_RELATIONAL,
+    PREC_ADDITIVE,
+    PREC_MULTIPLICATIVE,
+} precedence_t;
 
-        if (!try_consume_expr_1(&new_ctx)) {
-            return false;
-        }
-        node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
+typedef struct {
+    precedence_t precedence;
+    node_type_t node_type;
+} binop_t;
+
+// Binding power of every binary operator, indexed by token type. All of them are left associative.
+static const binop_t binops[] = {
+    [TOKEN_ANDAND] = { PREC_LOGICAL_AND, NODE_ANDAND },
+    [TOKEN_EQEQ] = { PREC_EQUALITY, NODE_EQEQ },
+    [TOKEN_NEQ] = { PREC_EQUALITY, NODE_NEQ },
+    [TOKEN_LT] = { PREC_RELATIONAL, NODE_LT },
+    [TOKEN_GT] = { PREC_RELATIONAL, NODE_GT },
+    [TOKEN_LTE] = { PREC_RELATIONAL, NODE_LTE },
+    [TOKEN_PLUS] = { PREC_ADDITIVE, NODE_ADD },
+    [TOKEN_MINUS] = { PREC_ADDITIVE, NODE_SUB },
+    [TOKEN_STAR] = { PREC_MULTIPLICATIVE, NODE_MULT },
+    [TOKEN_SLASH] = { PREC_MULTIPLICATIVE, NODE_DIV },
+};
+
+static precedence_t binop_precedence(token_type_t type) {
+    if ((size_t)type >= sizeof(binops) / sizeof(binops[0])) {
+        return PREC_NONE;
+    }
+    return binops[type].precedence;
+}
 
-        node_t lt_node = {
-            .type = NODE_LT,
-            .source_loc = source_loc,
-            .as.binop = {
-                .left_ref = left_ref,
-                .right_ref = right_ref
-            }
-        };
-        ctx_update(ctx, &new_ctx, &lt_node);
-        parsed = true;
-    }
+// Precedence climbing: parses an operand followed by every binary operator that binds at least
+// as tightly as min_precedence. Chains of operators at the same level are folded in the loop,
+// so recursion depth is bounded by the number of precedence levels, not the expression length.
+static bool consume_binary(parse_ctx_t *ctx, precedence_t min_precedence);
 
-    if (parsed) {
-        trace("try_consume_lt succeeded\n");
-    }
-    return parsed;
+static bool try_consume_binary(parse_ctx_t *ctx, precedence_t min_precedence) {
+    rule_frame_t frame = rule_begin(ctx);
+    return rule_end(PARSE_RULE_binary, frame, consume_binary(ctx, min_precedence));
 }
 
-static bool try_consume_lte(parse_ctx_t *ctx) {
+static bool consume_binary(parse_ctx_t *ctx, precedence_t min_precedence) {
     parse_ctx_t new_ctx = *ctx;
 
-    bool parsed = false;
+    if (!try_consume_unary(&new_ctx)) {
+        return false;
+    }
+
+    token_type_t type;
+    while (token_view_peek(&new_ctx.token_view, 0, &type)) {
+        precedence_t precedence = binop_precedence(type);
+        if (precedence == PREC_NONE || precedence < min_precedence) {
+            break;
+        }
 
-    node_ref_t left_ref;
-    source_loc_t source_loc = node_ref_get(ctx_get_result_ref(&new_ctx))->source_loc;
-    while (try_consume_token(&new_ctx, TOKEN_LTE, NULL)) {
-        left_ref = ctx_get_result_ref(&new_ctx);
+        node_ref_t left_ref = ctx_get_result_ref(&new_ctx);
+        try_consume_token(&new_ctx, type, NULL);
 
-        if (!try_consume_expr_1(&new_ctx)) {
+        // Left associative, so the right operand only takes operators that bind tighter
+        if (!try_consume_binary(&new_ctx, precedence + 1)) {
             return false;
         }
         node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
 
-        node_t lte_node = {
-            .type = NODE_LTE,
-            .source_loc = source_loc,
+        node_t binop_node = {
+            .type = binops[type].node_type,
+            .source_loc = node_ref_loc(left_ref),
             .as.binop = {
                 .left_ref = left_ref,
                 .right_ref = right_ref
             }
         };
-        ctx_update(ctx, &new_ctx, &lte_node);
-        parsed = true;
+        ctx_push(&new_ctx, &binop_node);
     }
 
-    if (parsed) {
-        trace("try_consume_lte succeeded\n");
-    }
-    return parsed;
+    *ctx = new_ctx;
+    return true;
 }
 
-static bool try_consume_expr_0(parse_ctx_t *ctx) {
-    if (!try_consume_expr_1(ctx)) {
-        return false;
-    }
+static bool consume_expr(parse_ctx_t *ctx) {
+    trace("| try_consume_expr\n");
+    return try_consume_binary(ctx, PREC_NONE + 1);
+}
 
-    while (ctx->token_view.length > 0) {
-        if (try_consume_add(ctx)) {
-            continue;
-        }
-        if (try_consume_sub(ctx)) {
-            continue;
-        }
-        if (try_consume_neq(ctx)) {  // TODO: Im pretty sure this operator precedence is wrong
-            continue;
-        }
-        if (try_consume_eqeq(ctx)) {
-            continue;
-        }
-        if (try_consume_andand(ctx)) {
-            continue;
-        }
-        if (try_consume_gt(ctx)) {
-            continue;
-        }
-        if (try_consume_lt(ctx)) {
-            continue;
-        }
-        if (try_consume_lte(ctx)) {
-            continue;
-        }
-        break;
-    }
+static bool consume_array_decl(parse_ctx_t *ctx, node_t *var_decl);
 
-    trace("try_consume_expr_0 succeeded\n");
-    return true;
+static bool try_consume_array_decl(parse_ctx_t *ctx, node_t *var_decl) {
+    rule_frame_t frame = rule_begin(ctx);
+    return rule_end(PARSE_RULE_array_decl, frame, consume_array_decl(ctx, var_decl));
 }
 
-static bool try_consume_array_decl(parse_ctx_t *ctx, node_t *var_decl) {
+static bool consume_array_decl(parse_ctx_t *ctx, node_t *var_decl) {
     parse_ctx_t new_ctx = *ctx;
 
     if (!try_consume_token(&new_ctx, TOKEN_LBRACK, NULL)) {
@@ -989,7 +869,7 @@ static bool try_consume_array_decl(parse_ctx_t *ctx, node_t *var_decl) {
     }
 
     node_ref_t expr_ref = {0};
-    if (try_consume_expr_0(&new_ctx)) {
+    if (try_rule(&new_ctx, try_consume_expr)) {
         expr_ref = ctx_get_result_ref(&new_ctx);
     }
 
@@ -997,7 +877,6 @@ static bool try_consume_array_decl(parse_ctx_t *ctx, node_t *var_decl) {
         return false;
     }
 
-    ctx_update(ctx, &new_ctx, node_ref_get(ctx_get_result_ref(&new_ctx)));
     *ctx = new_ctx;
 
     var_decl->as.var_decl.is_array = true;
@@ -1006,7 +885,7 @@ static bool try_consume_array_decl(parse_ctx_t *ctx, node_t *var_decl) {
     return true;
 }
 
-static bool try_consume_var_decl(parse_ctx_t *ctx) {
+static bool consume_var_decl(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
     if (!try_consume_type(&new_ctx)) {
@@ -1014,16 +893,17 @@ static bool try_consume_var_decl(parse_ctx_t *ctx) {
     }
     node_ref_t type_ref = ctx_get_result_ref(&new_ctx);
 
-    token_t *identifier_token;
+    token_t identifier_token;
     if (!try_consume_token(&new_ctx, TOKEN_IDENTIFIER, &identifier_token)) {
         return false;
     }
 
     node_t var_decl_node = {
         .type = NODE_VAR_DECL,
-        .source_loc = node_ref_get(type_ref)->source_loc,
+        .source_loc = node_ref_loc(type_ref),
         .as.var_decl.type_ref = type_ref,
-        .as.var_decl.name = identifier_token,
+        .as.var_decl.name = identifier_token.as.identifier,
+        .as.var_decl.name_loc = identifier_token.source_loc,
     };
 
     try_consume_array_decl(&new_ctx, &var_decl_node);
@@ -1032,7 +912,7 @@ static bool try_consume_var_decl(parse_ctx_t *ctx) {
         ctx_update(ctx, &new_ctx, &var_decl_node);
         return true;
     } else if (try_consume_token(&new_ctx, TOKEN_EQ, NULL)) {
-        if (!try_consume_expr_0(&new_ctx)) {
+        if (!try_consume_expr(&new_ctx)) {
             return false;
         }
         var_decl_node.as.var_decl.init_expr_ref = ctx_get_result_ref(&new_ctx);
@@ -1048,17 +928,17 @@ static bool try_consume_var_decl(parse_ctx_t *ctx) {
     return false;
 }
 
-static bool try_consume_return(parse_ctx_t *ctx) {
+static bool consume_return(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *return_token;
+    token_t return_token;
     if (!try_consume_token(&new_ctx, TOKEN_RETURN, &return_token)) {
         return false;
     }
 
     node_t ret_node = {
         .type = NODE_RETURN,
-        .source_loc = return_token->source_loc,
+        .source_loc = return_token.source_loc,
     };
 
     if (try_consume_token(&new_ctx, TOKEN_SEMICOLON, NULL)) {
@@ -1066,7 +946,7 @@ static bool try_consume_return(parse_ctx_t *ctx) {
         return true;
     }
 
-    if (!try_consume_expr_0(&new_ctx)) {
+    if (!try_consume_expr(&new_ctx)) {
         return false;
     }
     ret_node.as.ret.expr_ref = ctx_get_result_ref(&new_ctx);
@@ -1079,24 +959,24 @@ static bool try_consume_return(parse_ctx_t *ctx) {
     return true;
 }
 
-static bool try_consume_while(parse_ctx_t *ctx) {
+static bool consume_while(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *while_token;
+    token_t while_token;
     if (!try_consume_token(&new_ctx, TOKEN_WHILE, &while_token)) {
         return false;
     }
 
     node_t while_node = {
         .type = NODE_WHILE,
-        .source_loc = while_token->source_loc,
+        .source_loc = while_token.source_loc,
     };
 
     if (!try_consume_token(&new_ctx, TOKEN_LPAREN, NULL)) {
         return false;
     }
 
-    if (!try_consume_expr_0(&new_ctx)) {
+    if (!try_consume_expr(&new_ctx)) {
         return false;
     }
     while_node.as.while_.expr_ref = ctx_get_result_ref(&new_ctx);
@@ -1114,17 +994,17 @@ static bool try_consume_while(parse_ctx_t *ctx) {
     return true;
 }
 
-static bool try_consume_for(parse_ctx_t *ctx) {
+static bool consume_for(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *for_token;
+    token_t for_token;
     if (!try_consume_token(&new_ctx, TOKEN_FOR, &for_token)) {
         return false;
     }
 
     node_t for_node = {
         .type = NODE_FOR,
-        .source_loc = for_token->source_loc,
+        .source_loc = for_token.source_loc,
     };
 
     if (!try_consume_token(&new_ctx, TOKEN_LPAREN, NULL)) {
@@ -1136,7 +1016,7 @@ static bool try_consume_for(parse_ctx_t *ctx) {
     }
     for_node.as.for_.init_stmt_ref = ctx_get_result_ref(&new_ctx);
 
-    if (!try_consume_expr_0(&new_ctx)) {
+    if (!try_consume_expr(&new_ctx)) {
         return false;
     }
     for_node.as.for_.cond_expr_ref = ctx_get_result_ref(&new_ctx);
@@ -1145,7 +1025,7 @@ static bool try_consume_for(parse_ctx_t *ctx) {
         return false;
     }
 
-    if (try_consume_expr_0(&new_ctx)) {
+    if (try_rule(&new_ctx, try_consume_expr)) {
         for_node.as.for_.update_expr_ref = ctx_get_result_ref(&new_ctx);
     }
 
@@ -1162,24 +1042,24 @@ static bool try_consume_for(parse_ctx_t *ctx) {
     return true;
 }
 
-static bool try_consume_if(parse_ctx_t *ctx) {
+static bool consume_if(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *if_token;
+    token_t if_token;
     if (!try_consume_token(&new_ctx, TOKEN_IF, &if_token)) {
         return false;
     }
 
     node_t if_node = {
         .type = NODE_IF,
-        .source_loc = if_token->source_loc,
+        .source_loc = if_token.source_loc,
     };
 
     if (!try_consume_token(&new_ctx, TOKEN_LPAREN, NULL)) {
         return false;
     }
 
-    if (!try_consume_expr_0(&new_ctx)) {
+    if (!try_consume_expr(&new_ctx)) {
         return false;
     }
     if_node.as.if_.expr_ref = ctx_get_result_ref(&new_ctx);
@@ -1204,51 +1084,42 @@ static bool try_consume_if(parse_ctx_t *ctx) {
     return true;
 }
 
-static bool try_consume_pluseq(parse_ctx_t *ctx) {
+// Expression statements share their leading expression, the token after it picks the form
+static bool consume_expr_stmt(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
-    if (!try_consume_expr_0(&new_ctx)) {
+    if (!try_consume_expr(&new_ctx)) {
         return false;
     }
     node_ref_t left_ref = ctx_get_result_ref(&new_ctx);
 
-    if (!try_consume_token(&new_ctx, TOKEN_PLUSEQ, NULL)) {
-        return false;
-    }
-
-    if (!try_consume_expr_0(&new_ctx)) {
-        return false;
-    }
-    node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
-
-    if (!try_consume_token(&new_ctx, TOKEN_SEMICOLON, NULL)) {
-        return false;
-    }
-
-    node_t pluseq_node = {
-        .type = NODE_PLUSEQ,
-        .source_loc = node_ref_get(left_ref)->source_loc,
-        .as.binop.left_ref = left_ref,
-        .as.binop.right_ref = right_ref,
-    };
-    ctx_update(ctx, &new_ctx, &pluseq_node);
-
-    return true;
-}
-
-static bool try_consume_assignment(parse_ctx_t *ctx) {
-    parse_ctx_t new_ctx = *ctx;
-
-    if (!try_consume_expr_0(&new_ctx)) {
-        return false;
+    if (try_consume_token(&new_ctx, TOKEN_SEMICOLON, NULL)) {
+        node_t discard_node = {
+            .type = NODE_DISCARD,
+            .source_loc = node_ref_loc(left_ref),
+            .as.discard.expr_ref = left_ref,
+        };
+        ctx_update(ctx, &new_ctx, &discard_node);
+        return true;
     }
-    node_ref_t left_ref = ctx_get_result_ref(&new_ctx);
 
-    if (!try_consume_token(&new_ctx, TOKEN_EQ, NULL)) {
+    node_type_t stmt_type;
+    if (try_consume_token(&new_ctx, TOKEN_EQ, NULL)) {
+        stmt_type = NODE_ASSIGNMENT;
+    } else if (try_consume_token(&new_ctx, TOKEN_PLUSEQ, NULL)) {
+        // TODO: Compound assignments should be expressions, just like assignment, not statements
+        stmt_type = NODE_PLUSEQ;
+    } else if (try_consume_token(&new_ctx, TOKEN_MINUSEQ, NULL)) {
+        stmt_type = NODE_MINUSEQ;
+    } else if (try_consume_token(&new_ctx, TOKEN_STAREQ, NULL)) {
+        stmt_type = NODE_MULTEQ;
+    } else if (try_consume_token(&new_ctx, TOKEN_SLASHEQ, NULL)) {
+        stmt_type = NODE_DIVEQ;
+    } else {
         return false;
     }
 
-    if (!try_consume_expr_0(&new_ctx)) {
+    if (!try_consume_expr(&new_ctx)) {
         return false;
     }
     node_ref_t right_ref = ctx_get_result_ref(&new_ctx);
@@ -1257,39 +1128,17 @@ static bool try_consume_assignment(parse_ctx_t *ctx) {
         return false;
     }
 
-    node_t assignment_node = {
-        .type = NODE_ASSIGNMENT,
-        .source_loc = node_ref_get(left_ref)->source_loc,
+    node_t stmt_node = {
+        .type = stmt_type,
+        .source_loc = node_ref_loc(left_ref),
         .as.binop.left_ref = left_ref,
         .as.binop.right_ref = right_ref,
     };
-    ctx_update(ctx, &new_ctx, &assignment_node);
-
-    return true;
-}
-
-static bool try_consume_discard(parse_ctx_t *ctx) {
-    parse_ctx_t new_ctx = *ctx;
-
-    if (!try_consume_expr_0(&new_ctx)) {
-        return false;
-    }
-    node_ref_t expr_ref = ctx_get_result_ref(&new_ctx);
-
-    if (!try_consume_token(&new_ctx, TOKEN_SEMICOLON, NULL)) {
-        return false;
-    }
-
-    node_t discard_node = {
-        .type = NODE_DISCARD,
-        .source_loc = node_ref_get(expr_ref)->source_loc,
-        .as.discard.expr_ref = expr_ref,
-    };
-    ctx_update(ctx, &new_ctx, &discard_node);
+    ctx_update(ctx, &new_ctx, &stmt_node);
     return true;
 }
 
-static bool try_consume_empty_stmt(parse_ctx_t *ctx) {
+static bool consume_empty_stmt(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
     if (!try_consume_token(&new_ctx, TOKEN_SEMICOLON, NULL)) {
@@ -1304,10 +1153,10 @@ static bool try_consume_empty_stmt(parse_ctx_t *ctx) {
     return true;
 }
 
-static bool try_consume_break(parse_ctx_t *ctx) {
+static bool consume_break(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *break_token;
+    token_t break_token;
     if (!try_consume_token(&new_ctx, TOKEN_BREAK, &break_token)) {
         return false;
     }
@@ -1318,16 +1167,16 @@ static bool try_consume_break(parse_ctx_t *ctx) {
 
     node_t break_node = {
         .type = NODE_BREAK,
-        .source_loc = break_token->source_loc,
+        .source_loc = break_token.source_loc,
     };
     ctx_update(ctx, &new_ctx, &break_node);
     return true;
 }
 
-static bool try_consume_continue(parse_ctx_t *ctx) {
+static bool consume_continue(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *continue_token;
+    token_t continue_token;
     if (!try_consume_token(&new_ctx, TOKEN_CONTINUE, &continue_token)) {
         return false;
     }
@@ -1338,105 +1187,86 @@ static bool try_consume_continue(parse_ctx_t *ctx) {
 
     node_t continue_node = {
         .type = NODE_CONTINUE,
-        .source_loc = continue_token->source_loc,
+        .source_loc = continue_token.source_loc,
     };
     ctx_update(ctx, &new_ctx, &continue_node);
     return true;
 }
 
-static bool try_consume_stmt(parse_ctx_t *ctx) {
-    if (try_consume_empty_stmt(ctx)) {
-        return true;
-    }
-
-    if (try_consume_var_decl(ctx)) {
-        return true;
-    }
-
-    if (try_consume_break(ctx)) {
-        return true;
-    }
-
-    if (try_consume_continue(ctx)) {
-        return true;
-    }
-
-    // TODO: This should be an expression, just like assignment, not a statement
-    if (try_consume_pluseq(ctx)) {
-        return true;
-    }
-
-    if (try_consume_assignment(ctx)) {
-        return true;
-    }
-
-    if (try_consume_return(ctx)) {
-        return true;
-    }
-
-    if (try_consume_if(ctx)) {
-        return true;
-    }
-
-    if (try_consume_while(ctx)) {
-        return true;
-    }
-
-    if (try_consume_for(ctx)) {
-        return true;
-    }
-
-    if (try_consume_block(ctx)) {
-        return true;
-    }
-
-    if (try_consume_discard(ctx)) {
-        return true;
+// Statements are chosen by their leading token, anything that is not a keyword is an expression statement
+static bool consume_stmt(parse_ctx_t *ctx) {
+    token_type_t type;
+    if (!token_view_peek(&ctx->token_view, 0, &type)) {
+        return false;
+    }
+
+    switch (type) {
+        case TOKEN_SEMICOLON:
+            return try_consume_empty_stmt(ctx);
+        case TOKEN_INT:
+        case TOKEN_FLOAT:
+        case TOKEN_VOID:
+        case TOKEN_CHAR:
+        case TOKEN_LONG:
+        case TOKEN_UNSIGNED:
+            return try_consume_var_decl(ctx);
+        case TOKEN_BREAK:
+            return try_consume_break(ctx);
+        case TOKEN_CONTINUE:
+            return try_consume_continue(ctx);
+        case TOKEN_RETURN:
+            return try_consume_return(ctx);
+        case TOKEN_IF:
+            return try_consume_if(ctx);
+        case TOKEN_WHILE:
+            return try_consume_while(ctx);
+        case TOKEN_FOR:
+            return try_consume_for(ctx);
+        case TOKEN_LBRACE:
+            return try_consume_block(ctx);
+        default:
+            return try_consume_expr_stmt(ctx);
     }
-
-    return false;
 }
 
-static bool try_consume_block(parse_ctx_t *ctx) {
+static bool consume_block(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *start_token;
+    token_t start_token;
     if (!try_consume_token(&new_ctx, TOKEN_LBRACE, &start_token)) {
         return false;
     }
 
-    list_t stmts = { .element_size = sizeof(node_ref_t) };
+    size_t stmts_start = ast_scratch_start();
     while (true) {
-        if (!try_consume_stmt(&new_ctx)) {
+        if (!try_rule(&new_ctx, try_consume_stmt)) {
             break;
         }
-        node_ref_t stmt_ref = ctx_get_result_ref(&new_ctx);
-        list_push(&stmts, &stmt_ref);
+        ast_scratch_push(ctx_get_result_ref(&new_ctx));
     }
 
     if (!try_consume_token(&new_ctx, TOKEN_RBRACE, NULL)) {
-        list_clear(&stmts);
         return false;
     }
 
     node_t block_node = {
         .type = NODE_BLOCK,
-        .source_loc = start_token->source_loc,
-        .as.block = stmts,
+        .source_loc = start_token.source_loc,
+        .as.block = ast_scratch_finish(stmts_start),
     };
     ctx_update(ctx, &new_ctx, &block_node);
 
     return true;
 }
 
-static bool try_consume_param(parse_ctx_t *ctx) {
+static bool consume_param(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
-    token_t *dots_token;
+    token_t dots_token;
     if (try_consume_token(&new_ctx, TOKEN_DOTS, &dots_token)) {
         node_t vararg_node = {
             .type = NODE_VAR_DECL,
-            .source_loc = dots_token->source_loc,
+            .source_loc = dots_token.source_loc,
             .as.var_decl.is_varargs = true,
         };
         ctx_update(ctx, &new_ctx, &vararg_node);
@@ -1449,16 +1279,19 @@ static bool try_consume_param(parse_ctx_t *ctx) {
     }
     node_ref_t type_ref = ctx_get_result_ref(&new_ctx);
 
+    token_t identifier_token;
+    if (!try_consume_token(&new_ctx, TOKEN_IDENTIFIER, &identifier_token)) {
+        return false;
+    }
+
     node_t param_node = {
         .type = NODE_VAR_DECL,
-        .source_loc = node_ref_get(type_ref)->source_loc,
+        .source_loc = node_ref_loc(type_ref),
         .as.var_decl.type_ref = type_ref,
+        .as.var_decl.name = identifier_token.as.identifier,
+        .as.var_decl.name_loc = identifier_token.source_loc,
     };
 
-    if (!try_consume_token(&new_ctx, TOKEN_IDENTIFIER, &param_node.as.var_decl.name)) {
-        return false;
-    }
-
     try_consume_array_decl(&new_ctx, &param_node);
 
     ctx_update(ctx, &new_ctx, &param_node);
@@ -1467,7 +1300,7 @@ static bool try_consume_param(parse_ctx_t *ctx) {
     return true;
 }
 
-bool try_consume_function_signature(parse_ctx_t *ctx) {
+static bool consume_function_signature(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
     if (!try_consume_type(&new_ctx)) {
@@ -1475,40 +1308,41 @@ bool try_consume_function_signature(parse_ctx_t *ctx) {
     }
     node_ref_t return_type_ref = ctx_get_result_ref(&new_ctx);
 
-    token_t *identifier_token;
+    token_t identifier_token;
     if (!try_consume_token(&new_ctx, TOKEN_IDENTIFIER, &identifier_token)) {
         return false;
     }
 
     node_t func_sig_node = {
         .type = NODE_FUNCTION_SIGNATURE,
-        .source_loc = node_ref_get(return_type_ref)->source_loc,
+        .source_loc = node_ref_loc(return_type_ref),
         .as.function_signature.return_type_ref = return_type_ref,
-        .as.function_signature.name = identifier_token,
+        .as.function_signature.name = identifier_token.as.identifier,
+        .as.function_signature.name_loc = identifier_token.source_loc,
     };
 
     if (!try_consume_token(&new_ctx, TOKEN_LPAREN, NULL)) {
         return false;
     }
 
-    list_t parameters = { .element_size = sizeof(node_ref_t) };
+    size_t parameters_start = ast_scratch_start();
 
     // f(void) case
+    token_type_t first_type, second_type;
     if (
-        new_ctx.token_view.length > 0 && lv_at(&new_ctx.token_view, token_t, 0)->type == TOKEN_VOID
-        && new_ctx.token_view.length > 1 && lv_at(&new_ctx.token_view, token_t, 1)->type == TOKEN_RPAREN
+        token_view_peek(&new_ctx.token_view, 0, &first_type) && first_type == TOKEN_VOID
+        && token_view_peek(&new_ctx.token_view, 1, &second_type) && second_type == TOKEN_RPAREN
     ) {
         try_consume_token(&new_ctx, TOKEN_VOID, NULL);
     } else {
         bool trailing_comma = false;
         while (true) {
-            if (!try_consume_param(&new_ctx)) {
+            if (!try_rule(&new_ctx, try_consume_param)) {
                 break;
             }
             trailing_comma = false;
 
-            node_ref_t param_ref = ctx_get_result_ref(&new_ctx);
-            list_push(&parameters, &param_ref);
+            ast_scratch_push(ctx_get_result_ref(&new_ctx));
 
             if (!try_consume_token(&new_ctx, TOKEN_COMMA, NULL)) {
                 break;
@@ -1520,21 +1354,21 @@ bool try_consume_function_signature(parse_ctx_t *ctx) {
         }
     }
 
+    node_list_t parameters = ast_scratch_finish(parameters_start);
+
     // Ensure varargs is at end if it exists
     for (size_t i = 0; i < parameters.length; i++) {
-        node_ref_t *param_ref = list_at(&parameters, node_ref_t, i);
-        node_t *param = node_ref_get(*param_ref);
-        assert(param->type == NODE_VAR_DECL);
+        node_t param = node_ref_get(node_list_at(parameters, i));
+        assert(param.type == NODE_VAR_DECL);
 
-        if (param->as.var_decl.is_varargs && i != parameters.length - 1) {
-            report_error(param->source_loc, "Varargs can only come after the last parameter");
+        if (param.as.var_decl.is_varargs && i != parameters.length - 1) {
+            report_error(param.source_loc, "Varargs can only come after the last parameter");
         }
     }
 
     func_sig_node.as.function_signature.parameters = parameters;
 
     if (!try_consume_token(&new_ctx, TOKEN_RPAREN, NULL)) {
-        list_clear(&parameters);
         return false;
     }
 
@@ -1542,7 +1376,7 @@ bool try_consume_function_signature(parse_ctx_t *ctx) {
     return true;
 }
 
-bool try_consume_function(parse_ctx_t *ctx) {
+static bool consume_function(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
     if (!try_consume_function_signature(&new_ctx)) {
@@ -1552,7 +1386,7 @@ bool try_consume_function(parse_ctx_t *ctx) {
 
     node_t function_node = {
         .type = NODE_FUNCTION,
-        .source_loc = node_ref_get(func_sig_ref)->source_loc,
+        .source_loc = node_ref_loc(func_sig_ref),
         .as.function.signature_ref = func_sig_ref,
     };
 
@@ -1568,37 +1402,34 @@ bool try_consume_function(parse_ctx_t *ctx) {
     return false;
 }
 
-bool try_consume_top_level(parse_ctx_t *ctx) {
+static bool consume_top_level(parse_ctx_t *ctx) {
     return try_consume_function(ctx);
 }
 
-bool try_consume_file(parse_ctx_t *ctx) {
+static bool consume_file(parse_ctx_t *ctx) {
     parse_ctx_t new_ctx = *ctx;
 
-    list_t top_levels = { .element_size = sizeof(node_ref_t) };
+    size_t top_levels_start = ast_scratch_start();
     while (true) {
-        if (!try_consume_top_level(&new_ctx)) {
+        if (!try_rule(&new_ctx, try_consume_top_level)) {
             break;
         }
-        node_ref_t top_level_ref = ctx_get_result_ref(&new_ctx);
-        list_push(&top_levels, &top_level_ref);
+        ast_scratch_push(ctx_get_result_ref(&new_ctx));
     }
 
     node_t file_node = {
         .type = NODE_FILE,
-        .as.file.top_levels = top_levels,
+        .as.file.top_levels = ast_scratch_finish(top_levels_start),
     };
     ctx_update(ctx, &new_ctx, &file_node);
 
     return true;
 }
 
-bool parse(list_t *nodes, list_t *tokens, node_ref_t *root_ref) {
-    root_ref->nodes = nodes;
+bool parse(const token_stream_t *tokens, node_ref_t *root_ref) {
     parse_ctx_t ctx = {
-        .nodes = nodes,
-        .token_view = lv_from_list(tokens),
-        .result_index = &root_ref->index,
+        .token_view = { .stream = tokens, .start = 0, .length = token_stream_length(tokens) },
+        .result = root_ref,
     };
 
     if (!try_consume_file(&ctx)) {
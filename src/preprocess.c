@@ -0,0 +1,1438 @@
+#include "scc.h"
+
+typedef struct {
+    name_t name;
+    bool is_function;
+    bool is_variadic;
+    bool expanding;  // set while the macro's own replacement is rescanned, stops recursion
+    list_t params;   // name_t, __VA_ARGS__ comes last for variadic macros
+    list_t body;     // token_t
+    sv_t body_text;  // #if is evaluated on text, so the unlexed body is kept as well
+    const source_file_t *file;
+} macro_t;
+
+typedef struct {
+    name_t path;
+    source_file_t *source;
+    name_t guard;  // macro guarding the whole file, NAME_NONE if there is none
+    bool once;
+} pp_file_t;
+
+typedef struct {
+    bool parent_active;
+    bool active;
+    bool taken;  // whether any branch of this conditional was taken so far
+    bool seen_else;
+    source_loc_t source_loc;
+} pp_cond_t;
+
+#define RECORD_CHANGED (1 << 0)
+#define RECORD_USED (1 << 1)
+
+// Tracks what an outermost <...> include depends on and produces, so it can be cached as an image
+typedef struct {
+    size_t first_token;
+    size_t first_file;
+    uint32_t first_base;
+    bool cacheable;  // cleared when the result depends on state from before the include
+    list_t changed;  // name_t, macros defined or undefined while recording
+    list_t used;     // name_t, other macro names looked up while recording
+    list_t flags;    // uint8_t per name_t, RECORD_CHANGED | RECORD_USED
+} pp_recording_t;
+
+typedef struct {
+    token_stream_t *out;
+    list_t macros;  // macro_t *, indexed by name_t, NULL when not defined
+    list_t files;   // pp_file_t *
+    size_t include_depth;
+    const char *cache_dir;  // NULL when header images are disabled
+    pp_recording_t *recording;
+    // Scratch buffers, reused for every chunk
+    token_stream_t lexed;
+    list_t chunk;       // token_t, the lexed chunk once it turns out to contain a macro
+    list_t expanded;    // token_t
+    name_t defined_name;
+    name_t va_args_name;
+} pp_t;
+
+typedef struct {
+    pp_file_t *file;
+    const source_file_t *source;
+    list_t conds;  // pp_cond_t
+    // A file consisting of a single #ifndef X ... #endif group is recorded as guarded by X
+    bool seen_directive;
+    bool guard_possible;
+    bool guard_closed;
+    name_t guard;
+} pp_file_ctx_t;
+
+typedef struct {
+    size_t start;
+    size_t length;
+} token_range_t;
+
+static uint8_t *recording_flags(pp_recording_t *recording, name_t name) {
+    uint8_t none = 0;
+    while (recording->flags.length <= name) {
+        list_push(&recording->flags, &none);
+    }
+    return list_at(&recording->flags, uint8_t, name);
+}
+
+static void record_lookup(pp_recording_t *recording, name_t name, const macro_t *macro) {
+    uint8_t *flags = recording_flags(recording, name);
+    if (*flags & RECORD_CHANGED) {
+        return;
+    }
+    if (!(*flags & RECORD_USED)) {
+        *flags |= RECORD_USED;
+        list_push(&recording->used, &name);
+    }
+    if (macro != NULL) {
+        recording->cacheable = false;  // Uses a macro defined before the include
+    }
+}
+
+static macro_t *find_macro(pp_t *pp, name_t name) {
+    macro_t *macro = name < pp->macros.length ? *list_at(&pp->macros, macro_t *, name) : NULL;
+    if (pp->recording != NULL) {
+        record_lookup(pp->recording, name, macro);
+    }
+    return macro;
+}
+
+static void free_macro(macro_t *macro) {
+    list_clear(&macro->params);
+    list_clear(&macro->body);
+    free(macro);
+}
+
+static void set_macro(pp_t *pp, name_t name, macro_t *macro) {
+    if (pp->recording != NULL) {
+        uint8_t *flags = recording_flags(pp->recording, name);
+        if (!(*flags & RECORD_CHANGED)) {
+            *flags |= RECORD_CHANGED;
+            list_push(&pp->recording->changed, &name);
+        }
+    }
+
+    macro_t *none = NULL;
+    while (pp->macros.length <= name) {
+        list_push(&pp->macros, &none);
+    }
+
+    macro_t **slot = list_at(&pp->macros, macro_t *, name);
+    if (*slot != NULL) {
+        free_macro(*slot);
+    }
+    *slot = macro;
+}
+
+static bool sv_is(sv_t sv, const char *cstr) {
+    return sv_eq(sv, sv_from_cstr(cstr));
+}
+
+static void skip_space(sv_t *sv) {
+    sv_consume(sv, skip_trivia(sv->string, sv->length));
+}
+
+static sv_t take_identifier(sv_t *sv) {
+    if (sv->length == 0 || !char_is(sv->string[0], CHAR_IDENT_START)) {
+        return sv_take(*sv, 0);
+    }
+    return sv_consume(sv, 1 + scan_identifier(sv->string + 1, sv->length - 1));
+}
+
+static bool is_active(const pp_file_ctx_t *fctx) {
+    if (fctx->conds.length == 0) {
+        return true;
+    }
+    return list_at((list_t *)&fctx->conds, pp_cond_t, fctx->conds.length - 1)->active;
+}
+
+// Macro expansion
+
+// Tokens being rescanned. A replacement is rescanned together with the tokens after it, so they're
+// read from a stack of these and a macro only expands again once its replacement is used up.
+typedef struct {
+    const token_t *tokens;
+    size_t count;
+    size_t next;
+    macro_t *macro;       // NULL for the input being expanded
+    list_t substituted;   // token_t, replacement of a function-like macro, owned by the context
+} pp_context_t;
+
+static size_t expand(pp_t *pp, const token_t *tokens, size_t count, bool stop_early, list_t *out);
+
+static size_t find_param(const macro_t *macro, name_t name) {
+    for (size_t i = 0; i < macro->params.length; i++) {
+        if (*list_at((list_t *)&macro->params, name_t, i) == name) {
+            return i;
+        }
+    }
+    return macro->params.length;
+}
+
+static void push_context(list_t *contexts, macro_t *macro, const token_t *tokens, size_t count, list_t substituted) {
+    macro->expanding = true;
+    pp_context_t context = { .tokens = tokens, .count = count, .macro = macro, .substituted = substituted };
+    list_push(contexts, &context);
+}
+
+// Drops the replacements that are used up, their macros can expand again
+static void pop_finished_contexts(list_t *contexts) {
+    while (contexts->length > 1) {
+        pp_context_t *top = list_at(contexts, pp_context_t, contexts->length - 1);
+        if (top->next < top->count) {
+            return;
+        }
+        top->macro->expanding = false;
+        list_clear(&top->substituted);
+        list_pop(contexts);
+    }
+}
+
+// The returned token is only valid until the next token is read
+static const token_t *peek_token(list_t *contexts) {
+    pop_finished_contexts(contexts);
+    pp_context_t *top = list_at(contexts, pp_context_t, contexts->length - 1);
+    return top->next < top->count ? &top->tokens[top->next] : NULL;
+}
+
+static const token_t *next_token(list_t *contexts) {
+    const token_t *token = peek_token(contexts);
+    if (token != NULL) {
+        list_at(contexts, pp_context_t, contexts->length - 1)->next++;
+    }
+    return token;
+}
+
+// The name of a function-like macro was just read and '(' comes next. Reads the arguments up to the
+// matching ')', which may come from past the end of the replacement the name is in.
+static void expand_invocation(pp_t *pp, macro_t *macro, const token_t *name, list_t *contexts) {
+    size_t named_count = macro->params.length - (macro->is_variadic ? 1 : 0);
+
+    list_t arg_tokens = { .element_size = sizeof(token_t) };
+    list_t args = { .element_size = sizeof(token_range_t) };
+    token_range_t arg = { .start = 0 };
+    size_t depth = 0;
+    next_token(contexts);  // '('
+    while (true) {
+        const token_t *token = next_token(contexts);
+        if (token == NULL) {
+            report_error(name->source_loc, "Unterminated invocation of macro '%s'", name_cstr(macro->name));
+        }
+        token_type_t type = token->type;
+        if (type == TOKEN_LPAREN) {
+            depth++;
+        } else if (type == TOKEN_RPAREN) {
+            if (depth == 0) {
+                break;
+            }
+            depth--;
+        } else if (type == TOKEN_COMMA && depth == 0 && !(macro->is_variadic && args.length == named_count)) {
+            arg.length = arg_tokens.length - arg.start;
+            list_push(&args, &arg);
+            arg.start = arg_tokens.length;
+            continue;
+        }
+        list_push(&arg_tokens, (void *)token);
+    }
+    arg.length = arg_tokens.length - arg.start;
+    list_push(&args, &arg);
+
+    if (macro->params.length == 0 && args.length == 1 && arg.length == 0) {
+        args.length = 0;  // F() passes no arguments rather than a single empty one
+    }
+    if (macro->is_variadic && args.length == named_count) {
+        token_range_t empty = { .start = arg_tokens.length, .length = 0 };
+        list_push(&args, &empty);
+    }
+    if (args.length != macro->params.length) {
+        report_error(
+            name->source_loc, "Macro '%s' expects %zu arguments, got %zu",
+            name_cstr(macro->name), macro->params.length, args.length
+        );
+    }
+
+    // Parameters are replaced by their fully expanded arguments, then the result is rescanned
+    list_t substituted = { .element_size = sizeof(token_t) };
+    for (size_t k = 0; k < macro->body.length; k++) {
+        token_t *token = list_at(&macro->body, token_t, k);
+        size_t param = token->type == TOKEN_IDENTIFIER ? find_param(macro, token->as.identifier) : macro->params.length;
+        if (param == macro->params.length) {
+            list_push(&substituted, token);
+            continue;
+        }
+        token_range_t *param_arg = list_at(&args, token_range_t, param);
+        if (param_arg->length > 0) {
+            expand(pp, list_at(&arg_tokens, token_t, param_arg->start), param_arg->length, false, &substituted);
+        }
+    }
+    push_context(contexts, macro, substituted.element_bytes, substituted.length, substituted);
+
+    list_clear(&arg_tokens);
+    list_clear(&args);
+}
+
+// Expands tokens into out and returns how many of them were used. With stop_early it returns as
+// soon as no replacement is left to rescan, so the caller can copy plain tokens by itself.
+static size_t expand(pp_t *pp, const token_t *tokens, size_t count, bool stop_early, list_t *out) {
+    list_t contexts = { .element_size = sizeof(pp_context_t) };
+    pp_context_t input = { .tokens = tokens, .count = count };
+    list_push(&contexts, &input);
+
+    const token_t *next;
+    while ((next = next_token(&contexts)) != NULL) {
+        // Copied, since looking for '(' can free the replacement the name came from
+        token_t token = *next;
+        macro_t *macro = token.type == TOKEN_IDENTIFIER ? find_macro(pp, token.as.identifier) : NULL;
+        if (macro == NULL || macro->expanding) {
+            list_push(out, &token);
+        } else if (!macro->is_function) {
+            push_context(&contexts, macro, macro->body.element_bytes, macro->body.length, (list_t) { 0 });
+        } else {
+            // A function-like macro name that is not followed by '(' is left alone
+            const token_t *lparen = peek_token(&contexts);
+            if (lparen == NULL || lparen->type != TOKEN_LPAREN) {
+                list_push(out, &token);
+            } else {
+                expand_invocation(pp, macro, &token, &contexts);
+            }
+        }
+
+        if (stop_early) {
+            pop_finished_contexts(&contexts);
+            if (contexts.length == 1) {
+                break;
+            }
+        }
+    }
+
+    size_t used = list_at(&contexts, pp_context_t, 0)->next;
+    list_clear(&contexts);
+    return used;
+}
+
+static void emit_expanded(pp_t *pp) {
+    for (size_t i = 0; i < pp->expanded.length; i++) {
+        token_stream_push(pp->out, list_at(&pp->expanded, token_t, i));
+    }
+    pp->expanded.length = 0;
+}
+
+// Lexes [begin, end) and appends its tokens to the output, expanding macros on the way
+static void emit_chunk(pp_t *pp, pp_file_ctx_t *fctx, const char *begin, const char *end) {
+    if (begin == end) {
+        return;
+    }
+
+    token_stream_reset(&pp->lexed);
+    tokenize_range(&pp->lexed, fctx->source, begin, end);
+    size_t count = token_stream_length(&pp->lexed);
+    if (count == 0) {
+        return;
+    }
+    if (fctx->conds.length == 0) {
+        fctx->guard_possible = false;
+    }
+
+    pp->chunk.length = 0;
+    for (size_t i = 0; i < count; i++) {
+        token_t token = token_stream_get(&pp->lexed, i);
+        macro_t *macro = token.type == TOKEN_IDENTIFIER ? find_macro(pp, token.as.identifier) : NULL;
+        if (macro == NULL) {
+            token_stream_push(pp->out, &token);
+            continue;
+        }
+
+        // A replacement can take the tokens after it, like the arguments of a function-like macro
+        // it ends with, so expansion goes on until it's back to plain tokens of the chunk
+        if (pp->chunk.length == 0) {
+            for (size_t j = 0; j < count; j++) {
+                token_t chunk_token = token_stream_get(&pp->lexed, j);
+                list_push(&pp->chunk, &chunk_token);
+            }
+        }
+        i += expand(pp, list_at(&pp->chunk, token_t, i), count - i, true, &pp->expanded) - 1;
+        emit_expanded(pp);
+    }
+}
+
+// #if expressions
+
+typedef struct {
+    pp_t *pp;
+    sv_t text;
+    const source_file_t *file;
+    size_t unevaluated;  // nonzero inside the unevaluated operand of &&, || and ?:
+} pp_expr_t;
+
+static intmax_t eval_conditional(pp_expr_t *expr);
+
+static source_loc_t expr_loc(const pp_expr_t *expr) {
+    return source_loc_at(expr->file, expr->text.string);
+}
+
+static bool expr_consume(pp_expr_t *expr, const char *op) {
+    skip_space(&expr->text);
+    size_t length = strlen(op);
+    if (expr->text.length < length || memcmp(expr->text.string, op, length) != 0) {
+        return false;
+    }
+    sv_consume(&expr->text, length);
+    return true;
+}
+
+static void expr_expect(pp_expr_t *expr, const char *op) {
+    if (!expr_consume(expr, op)) {
+        report_error(expr_loc(expr), "Expected '%s' in preprocessor expression", op);
+    }
+}
+
+static intmax_t eval_number(pp_expr_t *expr) {
+    size_t length = scan_identifier(expr->text.string, expr->text.length);
+    char buffer[64];
+    if (length >= sizeof(buffer)) {
+        report_error(expr_loc(expr), "Integer literal too long");
+    }
+    sv_to_cstr(sv_take(expr->text, length), buffer, sizeof(buffer));
+
+    char *end;
+    intmax_t value = (intmax_t)strtoumax(buffer, &end, 0);
+    while (*end == 'u' || *end == 'U' || *end == 'l' || *end == 'L') {
+        end++;
+    }
+    if (*end != '\0') {
+        report_error(expr_loc(expr), "Invalid integer literal '%s'", buffer);
+    }
+
+    sv_consume(&expr->text, length);
+    return value;
+}
+
+static intmax_t eval_charlit(pp_expr_t *expr) {
+    sv_t text = expr->text;
+    sv_consume(&text, 1);
+
+    intmax_t value;
+    if (text.length >= 2 && text.string[0] == '\\') {
+        switch (text.string[1]) {
+            case 'n': value = '\n'; break;
+            case 't': value = '\t'; break;
+            case '0': value = '\0'; break;
+            case '\\': value = '\\'; break;
+            case '\'': value = '\''; break;
+            default:
+                report_error(expr_loc(expr), "Unknown escape sequence: \\%c", text.string[1]);
+        }
+        sv_consume(&text, 2);
+    } else if (text.length >= 1) {
+        value = (unsigned char)text.string[0];
+        sv_consume(&text, 1);
+    } else {
+        report_error(expr_loc(expr), "Unterminated char literal");
+    }
+
+    if (text.length == 0 || text.string[0] != '\'') {
+        report_error(expr_loc(expr), "Char literal must be a single character");
+    }
+    sv_consume(&text, 1);
+    expr->text = text;
+    return value;
+}
+
+static intmax_t eval_identifier(pp_expr_t *expr) {
+    source_loc_t loc = expr_loc(expr);
+    name_t name = intern(take_identifier(&expr->text));
+
+    if (name == expr->pp->defined_name) {
+        bool parenthesized = expr_consume(expr, "(");
+        skip_space(&expr->text);
+        sv_t operand = take_identifier(&expr->text);
+        if (operand.length == 0) {
+            report_error(expr_loc(expr), "Expected a macro name after 'defined'");
+        }
+        if (parenthesized) {
+            expr_expect(expr, ")");
+        }
+        return find_macro(expr->pp, intern(operand)) != NULL;
+    }
+
+    macro_t *macro = find_macro(expr->pp, name);
+    if (macro == NULL || macro->expanding) {
+        return 0;  // Identifiers that are not macros evaluate to 0
+    }
+    if (macro->is_function) {
+        report_error(loc, "Function-like macros are not supported in preprocessor expressions");
+    }
+
+    pp_expr_t body = {
+        .pp = expr->pp,
+        .text = macro->body_text,
+        .file = macro->file,
+        .unevaluated = expr->unevaluated,
+    };
+    macro->expanding = true;
+    intmax_t value = eval_conditional(&body);
+    macro->expanding = false;
+
+    skip_space(&body.text);
+    if (body.text.length != 0) {
+        report_error(expr_loc(&body), "Unexpected '%c' in preprocessor expression", body.text.string[0]);
+    }
+    return value;
+}
+
+static intmax_t eval_unary(pp_expr_t *expr) {
+    skip_space(&expr->text);
+    if (expr->text.length == 0) {
+        report_error(expr_loc(expr), "Expected a preprocessor expression");
+    }
+
+    if (expr_consume(expr, "(")) {
+        intmax_t value = eval_conditional(expr);
+        expr_expect(expr, ")");
+        return value;
+    } else if (expr_consume(expr, "!")) {
+        return !eval_unary(expr);
+    } else if (expr_consume(expr, "~")) {
+        return ~eval_unary(expr);
+    } else if (expr_consume(expr, "-")) {
+        return -eval_unary(expr);
+    } else if (expr_consume(expr, "+")) {
+        return eval_unary(expr);
+    }
+
+    char c = expr->text.string[0];
+    if (char_is(c, CHAR_DIGIT)) {
+        return eval_number(expr);
+    } else if (c == '\'') {
+        return eval_charlit(expr);
+    } else if (char_is(c, CHAR_IDENT_START)) {
+        return eval_identifier(expr);
+    }
+    report_error(expr_loc(expr), "Unexpected '%c' in preprocessor expression", c);
+}
+
+typedef struct {
+    const char *op;
+    int precedence;
+} pp_binop_t;
+
+// Longer operators come first so "<<" is not read as "<"
+static const pp_binop_t binops[] = {
+    { "||", 1 }, { "&&", 2 },
+    { "==", 6 }, { "!=", 6 }, { "<=", 7 }, { ">=", 7 }, { "<<", 8 }, { ">>", 8 },
+    { "|", 3 }, { "^", 4 }, { "&", 5 }, { "<", 7 }, { ">", 7 },
+    { "+", 9 }, { "-", 9 }, { "*", 10 }, { "/", 10 }, { "%", 10 },
+};
+
+static const pp_binop_t *peek_binop(pp_expr_t *expr) {
+    skip_space(&expr->text);
+    for (size_t i = 0; i < sizeof(binops) / sizeof(binops[0]); i++) {
+        size_t length = strlen(binops[i].op);
+        if (expr->text.length >= length && memcmp(expr->text.string, binops[i].op, length) == 0) {
+            return &binops[i];
+        }
+    }
+    return NULL;
+}
+
+static intmax_t eval_binary(pp_expr_t *expr, int min_precedence) {
+    intmax_t left = eval_unary(expr);
+
+    const pp_binop_t *binop;
+    while ((binop = peek_binop(expr)) != NULL && binop->precedence >= min_precedence) {
+        source_loc_t loc = expr_loc(expr);
+        sv_consume(&expr->text, strlen(binop->op));
+
+        // The right operand of && and || is parsed but not evaluated once the result is known
+        bool short_circuit = (binop->precedence == 1 && left) || (binop->precedence == 2 && !left);
+        expr->unevaluated += short_circuit;
+        intmax_t right = eval_binary(expr, binop->precedence + 1);
+        expr->unevaluated -= short_circuit;
+
+        const char *op = binop->op;
+        if (strcmp(op, "||") == 0) left = left || right;
+        else if (strcmp(op, "&&") == 0) left = left && right;
+        else if (strcmp(op, "==") == 0) left = left == right;
+        else if (strcmp(op, "!=") == 0) left = left != right;
+        else if (strcmp(op, "<=") == 0) left = left <= right;
+        else if (strcmp(op, ">=") == 0) left = left >= right;
+        else if (strcmp(op, "<<") == 0) left = left << right;
+        else if (strcmp(op, ">>") == 0) left = left >> right;
+        else if (strcmp(op, "|") == 0) left = left | right;
+        else if (strcmp(op, "^") == 0) left = left ^ right;
+        else if (strcmp(op, "&") == 0) left = left & right;
+        else if (strcmp(op, "<") == 0) left = left < right;
+        else if (strcmp(op, ">") == 0) left = left > right;
+        else if (strcmp(op, "+") == 0) left = left + right;
+        else if (strcmp(op, "-") == 0) left = left - right;
+        else if (strcmp(op, "*") == 0) left = left * right;
+        else if (right == 0) {
+            if (expr->unevaluated == 0) {
+                report_error(loc, "Division by zero in preprocessor expression");
+            }
+            left = 0;
+        }
+        else if (strcmp(op, "/") == 0) left = left / right;
+        else if (strcmp(op, "%") == 0) left = left % right;
+        else unreachable();
+    }
+
+    return left;
+}
+
+static intmax_t eval_conditional(pp_expr_t *expr) {
+    intmax_t condition = eval_binary(expr, 1);
+    if (!expr_consume(expr, "?")) {
+        return condition;
+    }
+
+    expr->unevaluated += !condition;
+    intmax_t then_value = eval_conditional(expr);
+    expr->unevaluated -= !condition;
+    expr_expect(expr, ":");
+    expr->unevaluated += !!condition;
+    intmax_t else_value = eval_conditional(expr);
+    expr->unevaluated -= !!condition;
+
+    return condition ? then_value : else_value;
+}
+
+static bool eval_if(pp_t *pp, pp_file_ctx_t *fctx, sv_t text) {
+    pp_expr_t expr = { .pp = pp, .text = text, .file = fctx->source };
+    intmax_t value = eval_conditional(&expr);
+
+    skip_space(&expr.text);
+    if (expr.text.length != 0) {
+        report_error(expr_loc(&expr), "Unexpected '%c' in preprocessor expression", expr.text.string[0]);
+    }
+    return value != 0;
+}
+
+// Directives
+
+static void process_file(pp_t *pp, pp_file_t *file);
+
+static name_t expect_macro_name(pp_file_ctx_t *fctx, sv_t *line, const char *directive) {
+    skip_space(line);
+    sv_t name = take_identifier(line);
+    if (name.length == 0) {
+        report_error(source_loc_at(fctx->source, line->string), "Expected a macro name after #%s", directive);
+    }
+    return intern(name);
+}
+
+static void push_cond(pp_file_ctx_t *fctx, source_loc_t loc, bool condition) {
+    bool parent_active = is_active(fctx);
+    pp_cond_t cond = {
+        .parent_active = parent_active,
+        .active = parent_active && condition,
+        .taken = condition,
+        .source_loc = loc,
+    };
+    list_push(&fctx->conds, &cond);
+}
+
+static void handle_define(pp_t *pp, pp_file_ctx_t *fctx, sv_t line) {
+    name_t name = expect_macro_name(fctx, &line, "define");
+
+    macro_t macro = {
+        .name = name,
+        .params = { .element_size = sizeof(name_t) },
+        .body = { .element_size = sizeof(token_t) },
+        .file = fctx->source,
+    };
+
+    // Only a '(' directly after the name makes a function-like macro
+    if (line.length > 0 && line.string[0] == '(') {
+        macro.is_function = true;
+        sv_consume(&line, 1);
+        skip_space(&line);
+        if (line.length > 0 && line.string[0] == ')') {
+            sv_consume(&line, 1);
+        } else {
+            while (true) {
+                skip_space(&line);
+                if (line.length >= 3 && memcmp(line.string, "...", 3) == 0) {
+                    sv_consume(&line, 3);
+                    macro.is_variadic = true;
+                    list_push(&macro.params, &pp->va_args_name);
+                } else {
+                    sv_t param = take_identifier(&line);
+                    if (param.length == 0) {
+                        report_error(source_loc_at(fctx->source, line.string), "Expected a parameter name");
+                    }
+                    name_t param_name = intern(param);
+                    list_push(&macro.params, &param_name);
+                }
+
+                skip_space(&line);
+                if (line.length > 0 && line.string[0] == ')' ) {
+                    sv_consume(&line, 1);
+                    break;
+                }
+                if (macro.is_variadic || line.length == 0 || line.string[0] != ',') {
+                    report_error(source_loc_at(fctx->source, line.string), "Expected ',' or ')' in macro parameter list");
+                }
+                sv_consume(&line, 1);
+            }
+        }
+    }
+
+    macro.body_text = line;
+    token_stream_reset(&pp->lexed);
+    tokenize_range(&pp->lexed, fctx->source, line.string, line.string + line.length);
+    for (size_t i = 0; i < token_stream_length(&pp->lexed); i++) {
+        token_t token = token_stream_get(&pp->lexed, i);
+        list_push(&macro.body, &token);
+    }
+
+    set_macro(pp, name, heapify(macro_t, &macro));
+}
+
+static bool file_exists(pp_t *pp, const char *path) {
+    name_t name = intern_cstr(path);
+    for (size_t i = 0; i < pp->files.length; i++) {
+        if ((*list_at(&pp->files, pp_file_t *, i))->path == name) {
+            return true;
+        }
+    }
+    return access(path, R_OK) == 0;
+}
+
+static name_t resolve_include(pp_t *pp, const pp_file_ctx_t *fctx, sv_t name, bool is_system) {
+    char path[4096];
+
+    if (name.string[0] == '/') {
+        snprintf(path, sizeof(path), "%.*s", (int)name.length, name.string);
+        return file_exists(pp, path) ? intern_cstr(path) : NAME_NONE;
+    }
+
+    if (!is_system) {
+        // Relative to the directory of the including file
+        const char *includer = fctx->source->file_name;
+        const char *slash = strrchr(includer, '/');
+        int dir_length = slash != NULL ? (int)(slash - includer + 1) : 0;
+        snprintf(path, sizeof(path), "%.*s%.*s", dir_length, includer, (int)name.length, name.string);
+        if (file_exists(pp, path)) {
+            return intern_cstr(path);
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/%.*s", PP_SYSTEM_INCLUDE_DIR, (int)name.length, name.string);
+    if (file_exists(pp, path)) {
+        return intern_cstr(path);
+    }
+    return NAME_NONE;
+}
+
+static pp_file_t *find_loaded_file(pp_t *pp, name_t path) {
+    for (size_t i = 0; i < pp->files.length; i++) {
+        pp_file_t *file = *list_at(&pp->files, pp_file_t *, i);
+        if (file->path == path) {
+            return file;
+        }
+    }
+    return NULL;
+}
+
+static pp_file_t *add_file(pp_t *pp, name_t path, const char *code, size_t length) {
+    pp_file_t new_file = {
+        .path = path,
+        .source = source_add_file(name_cstr(path), code, length),
+    };
+    pp_file_t *file = heapify(pp_file_t, &new_file);
+    list_push(&pp->files, &file);
+    return file;
+}
+
+// Files are read once and kept, including a file again only rescans the text in memory
+static pp_file_t *load_file(pp_t *pp, name_t path) {
+    pp_file_t *file = find_loaded_file(pp, path);
+    if (file != NULL) {
+        return file;
+    }
+
+    char *code = read_file(name_cstr(path));
+    if (code == NULL) {
+        return NULL;
+    }
+    return add_file(pp, path, code, strlen(code));
+}
+
+// Header images
+//
+// An outermost <...> include is recorded and saved as an image holding the tokens it produced,
+// the macros it left defined or undefined and the files it read. Later compiles replay the image
+// instead of preprocessing the header, provided the files are unchanged and none of the macro
+// names the header looked at are defined at the point of inclusion. Headers whose output depends
+// on macros defined before them are never saved.
+
+#define PP_IMAGE_MAGIC 0x49434353  // "SCCI"
+
+typedef struct {
+    image_writer_t body;
+    list_t names;       // name_t, by image index
+    list_t name_slots;  // uint32_t per name_t, image index + 1, 0 if not in the image yet
+    list_t strings;     // sv_t
+    uint32_t first_base;
+} image_encoder_t;
+
+static uint32_t encode_name(image_encoder_t *encoder, name_t name) {
+    uint32_t none = 0;
+    while (encoder->name_slots.length <= name) {
+        list_push(&encoder->name_slots, &none);
+    }
+    uint32_t *slot = list_at(&encoder->name_slots, uint32_t, name);
+    if (*slot == 0) {
+        list_push(&encoder->names, &name);
+        *slot = encoder->names.length;
+    }
+    return *slot - 1;
+}
+
+// Offsets are stored relative to the first file of the image, its files are registered back to back
+static uint32_t encode_offset(image_encoder_t *encoder, source_loc_t loc) {
+    assert(loc.offset >= encoder->first_base);
+    return loc.offset - encoder->first_base;
+}
+
+static void encode_token(image_encoder_t *encoder, image_writer_t *writer, const token_t *token) {
+    uint32_t payload = 0;
+    switch (token->type) {
+        case TOKEN_INTLIT:
+            payload = (uint32_t)token->as.intlit;
+            break;
+        case TOKEN_CHARLIT:
+            payload = (unsigned char)token->as.charlit;
+            break;
+        case TOKEN_IDENTIFIER:
+            payload = encode_name(encoder, token->as.identifier);
+            break;
+        case TOKEN_STRINGLIT:
+            payload = encoder->strings.length;
+            list_push(&encoder->strings, (void *)&token->as.stringlit);
+            break;
+        default:
+            break;
+    }
+
+    image_write_u8(writer, token->type);
+    image_write_u32(writer, encode_offset(encoder, token->source_loc));
+    image_write_u32(writer, payload);
+}
+
+static void save_image(pp_t *pp, pp_recording_t *recording, const char *image_path, uint64_t key) {
+    image_encoder_t encoder = {
+        .names = { .element_size = sizeof(name_t) },
+        .name_slots = { .element_size = sizeof(uint32_t) },
+        .strings = { .element_size = sizeof(sv_t) },
+        .first_base = recording->first_base,
+    };
+
+    image_writer_t *body = &encoder.body;
+    size_t token_count = token_stream_length(pp->out) - recording->first_token;
+    image_write_u32(body, token_count);
+    for (size_t i = 0; i < token_count; i++) {
+        token_t token = token_stream_get(pp->out, recording->first_token + i);
+        encode_token(&encoder, body, &token);
+    }
+
+    image_write_u32(body, recording->changed.length);
+    for (size_t i = 0; i < recording->changed.length; i++) {
+        name_t name = *list_at(&recording->changed, name_t, i);
+        macro_t *macro = find_macro(pp, name);
+        image_write_u32(body, encode_name(&encoder, name));
+        image_write_u8(body, macro != NULL);
+        if (macro == NULL) {
+            continue;
+        }
+
+        image_write_u8(body, macro->is_function | macro->is_variadic << 1);
+        image_write_u32(body, macro->params.length);
+        for (size_t j = 0; j < macro->params.length; j++) {
+            image_write_u32(body, encode_name(&encoder, *list_at(&macro->params, name_t, j)));
+        }
+        image_write_u32(body, macro->body.length);
+        for (size_t j = 0; j < macro->body.length; j++) {
+            encode_token(&encoder, body, list_at(&macro->body, token_t, j));
+        }
+        image_write_u32(body, encode_offset(&encoder, source_loc_at(macro->file, macro->body_text.string)));
+        image_write_u32(body, macro->body_text.length);
+    }
+
+    image_writer_t meta = { 0 };
+    image_write_u32(&meta, recording->used.length);
+    for (size_t i = 0; i < recording->used.length; i++) {
+        image_write_u32(&meta, encode_name(&encoder, *list_at(&recording->used, name_t, i)));
+    }
+    image_write_u32(&meta, pp->files.length - recording->first_file);
+    for (size_t i = recording->first_file; i < pp->files.length; i++) {
+        pp_file_t *file = *list_at(&pp->files, pp_file_t *, i);
+        image_write_sv(&meta, name_sv(file->path));
+        image_write_u32(&meta, file->source->length);
+        image_write_u64(&meta, image_hash(IMAGE_HASH_SEED, file->source->code, file->source->length));
+        image_write_u8(&meta, file->once);
+        image_write_u32(&meta, file->guard == NAME_NONE ? 0 : encode_name(&encoder, file->guard) + 1);
+    }
+
+    // Names and strings go first so the reader can resolve payloads in a single pass
+    image_writer_t tail = { 0 };
+    image_write_u32(&tail, encoder.names.length);
+    for (size_t i = 0; i < encoder.names.length; i++) {
+        image_write_sv(&tail, name_sv(*list_at(&encoder.names, name_t, i)));
+    }
+    image_write_u32(&tail, encoder.strings.length);
+    for (size_t i = 0; i < encoder.strings.length; i++) {
+        image_write_sv(&tail, *list_at(&encoder.strings, sv_t, i));
+    }
+    image_write_bytes(&tail, meta.bytes, meta.length);
+    image_write_bytes(&tail, body->bytes, body->length);
+
+    image_writer_t image = { 0 };
+    image_write_u32(&image, PP_IMAGE_MAGIC);
+    image_write_u64(&image, key);
+    image_write_sv(&image, sv_from_cstr(image_compiler_version()));
+    image_write_u64(&image, image_hash(IMAGE_HASH_SEED, tail.bytes, tail.length));
+    image_write_bytes(&image, tail.bytes, tail.length);
+
+    // A cache that cannot be written is not an error
+    image_save(&image, image_path);
+
+    image_writer_free(&image);
+    image_writer_free(&tail);
+    image_writer_free(&meta);
+    image_writer_free(body);
+    list_clear(&encoder.names);
+    list_clear(&encoder.name_slots);
+    list_clear(&encoder.strings);
+}
+
+typedef struct {
+    name_t path;
+    char *code;
+    size_t length;
+    bool once;
+    uint32_t guard;  // image name index + 1, 0 for none
+} image_file_t;
+
+static token_t decode_token(image_reader_t *reader, const list_t *names, const list_t *strings, uint32_t first_base) {
+    token_t token = { .type = image_read_u8(reader) };
+    token.source_loc.offset = first_base + image_read_u32(reader);
+    uint32_t payload = image_read_u32(reader);
+    switch (token.type) {
+        case TOKEN_INTLIT:
+            token.as.intlit = (int)payload;
+            break;
+        case TOKEN_CHARLIT:
+            token.as.charlit = (char)payload;
+            break;
+        case TOKEN_IDENTIFIER:
+            assert(payload < names->length);
+            token.as.identifier = *list_at((list_t *)names, name_t, payload);
+            break;
+        case TOKEN_STRINGLIT:
+            assert(payload < strings->length);
+            token.as.stringlit = *list_at((list_t *)strings, sv_t, payload);
+            break;
+        default:
+            break;
+    }
+    return token;
+}
+
+static bool check_image(pp_t *pp, image_reader_t *reader, uint64_t key, list_t *names, list_t *strings, list_t *files) {
+    if (
+        image_read_u32(reader) != PP_IMAGE_MAGIC
+        || image_read_u64(reader) != key
+        || !sv_eq(image_read_sv(reader), sv_from_cstr(image_compiler_version()))
+    ) {
+        return false;
+    }
+    uint64_t checksum = image_read_u64(reader);
+    if (reader->failed || image_hash(IMAGE_HASH_SEED, reader->bytes + reader->offset, reader->length - reader->offset) != checksum) {
+        return false;
+    }
+
+    // The checksum matched, so the rest of the image is read without further checks
+    uint32_t name_count = image_read_u32(reader);
+    for (uint32_t i = 0; i < name_count; i++) {
+        name_t name = intern(image_read_sv(reader));
+        list_push(names, &name);
+    }
+    uint32_t string_count = image_read_u32(reader);
+    for (uint32_t i = 0; i < string_count; i++) {
+        sv_t string = image_read_sv(reader);
+        char *copy = malloc(string.length + 1);
+        assert(copy != NULL);
+        memcpy(copy, string.string, string.length);
+        copy[string.length] = '\0';
+        string.string = copy;
+        list_push(strings, &string);
+    }
+
+    uint32_t used_count = image_read_u32(reader);
+    for (uint32_t i = 0; i < used_count; i++) {
+        if (find_macro(pp, *list_at(names, name_t, image_read_u32(reader))) != NULL) {
+            return false;
+        }
+    }
+
+    // The first file is the header itself, which the key already covers
+    uint32_t file_count = image_read_u32(reader);
+    for (uint32_t i = 0; i < file_count; i++) {
+        image_file_t file = { .path = intern(image_read_sv(reader)) };
+        uint32_t length = image_read_u32(reader);
+        uint64_t hash = image_read_u64(reader);
+        file.once = image_read_u8(reader);
+        file.guard = image_read_u32(reader);
+
+        if (i > 0) {
+            if (find_loaded_file(pp, file.path) != NULL) {
+                return false;
+            }
+            file.code = read_file(name_cstr(file.path));
+            if (file.code == NULL) {
+                return false;
+            }
+            file.length = strlen(file.code);
+            list_push(files, &file);
+            if (file.length != length || image_hash(IMAGE_HASH_SEED, file.code, file.length) != hash) {
+                return false;
+            }
+        } else {
+            list_push(files, &file);
+        }
+    }
+    return true;
+}
+
+static bool replay_image(pp_t *pp, const char *image_path, uint64_t key, char *code, size_t length) {
+    image_reader_t reader;
+    if (!image_open(&reader, image_path)) {
+        return false;
+    }
+
+    list_t names = { .element_size = sizeof(name_t) };
+    list_t strings = { .element_size = sizeof(sv_t) };
+    list_t files = { .element_size = sizeof(image_file_t) };
+    if (!check_image(pp, &reader, key, &names, &strings, &files)) {
+        for (size_t i = 1; i < files.length; i++) {
+            free(list_at(&files, image_file_t, i)->code);
+        }
+        for (size_t i = 0; i < strings.length; i++) {
+            free((char *)list_at(&strings, sv_t, i)->string);
+        }
+        list_clear(&names);
+        list_clear(&strings);
+        list_clear(&files);
+        image_close(&reader);
+        return false;
+    }
+
+    list_at(&files, image_file_t, 0)->code = code;
+    list_at(&files, image_file_t, 0)->length = length;
+
+    uint32_t first_base = 0;
+    for (size_t i = 0; i < files.length; i++) {
+        image_file_t *image_file = list_at(&files, image_file_t, i);
+        pp_file_t *file = add_file(pp, image_file->path, image_file->code, image_file->length);
+        file->once = image_file->once;
+        file->guard = image_file->guard == 0 ? NAME_NONE : *list_at(&names, name_t, image_file->guard - 1);
+        if (i == 0) {
+            first_base = file->source->base;
+        }
+    }
+    size_t first_file = pp->files.length - files.length;
+
+    uint32_t token_count = image_read_u32(&reader);
+    for (uint32_t i = 0; i < token_count; i++) {
+        token_t token = decode_token(&reader, &names, &strings, first_base);
+        token_stream_push(pp->out, &token);
+    }
+
+    uint32_t macro_count = image_read_u32(&reader);
+    for (uint32_t i = 0; i < macro_count; i++) {
+        name_t name = *list_at(&names, name_t, image_read_u32(&reader));
+        if (!image_read_u8(&reader)) {
+            set_macro(pp, name, NULL);
+            continue;
+        }
+
+        uint8_t flags = image_read_u8(&reader);
+        macro_t macro = {
+            .name = name,
+            .is_function = flags & 1,
+            .is_variadic = (flags >> 1) & 1,
+            .params = { .element_size = sizeof(name_t) },
+            .body = { .element_size = sizeof(token_t) },
+        };
+        uint32_t param_count = image_read_u32(&reader);
+        for (uint32_t j = 0; j < param_count; j++) {
+            list_push(&macro.params, list_at(&names, name_t, image_read_u32(&reader)));
+        }
+        uint32_t body_count = image_read_u32(&reader);
+        for (uint32_t j = 0; j < body_count; j++) {
+            token_t token = decode_token(&reader, &names, &strings, first_base);
+            list_push(&macro.body, &token);
+        }
+
+        uint32_t text_offset = first_base + image_read_u32(&reader);
+        uint32_t text_length = image_read_u32(&reader);
+        for (size_t j = first_file; j < pp->files.length; j++) {
+            const source_file_t *source = (*list_at(&pp->files, pp_file_t *, j))->source;
+            if (text_offset >= source->base && text_offset <= source->base + source->length) {
+                macro.file = source;
+                macro.body_text = (sv_t){ .string = source->code + (text_offset - source->base), .length = text_length };
+                break;
+            }
+        }
+        assert(macro.file != NULL);
+
+        set_macro(pp, name, heapify(macro_t, &macro));
+    }
+    assert(!reader.failed);
+
+    list_clear(&names);
+    list_clear(&strings);
+    list_clear(&files);
+    image_close(&reader);
+    return true;
+}
+
+static void include_cached(pp_t *pp, source_loc_t loc, name_t path) {
+    char *code = read_file(name_cstr(path));
+    if (code == NULL) {
+        report_error(loc, "Could not read include file '%s'", name_cstr(path));
+    }
+    size_t length = strlen(code);
+
+    // Keyed by compiler version, path and content of the header
+    const char *version = image_compiler_version();
+    uint64_t key = image_hash(IMAGE_HASH_SEED, version, strlen(version));
+    key = image_hash(key, name_cstr(path), name_sv(path).length + 1);
+    key = image_hash(key, code, length);
+
+    char image_path[4096];
+    snprintf(image_path, sizeof(image_path), "%s/%016" PRIx64 ".img", pp->cache_dir, key);
+    if (replay_image(pp, image_path, key, code, length)) {
+        return;
+    }
+
+    pp_file_t *file = add_file(pp, path, code, length);
+    pp_recording_t recording = {
+        .first_token = token_stream_length(pp->out),
+        .first_file = pp->files.length - 1,
+        .first_base = file->source->base,
+        .cacheable = true,
+        .changed = { .element_size = sizeof(name_t) },
+        .used = { .element_size = sizeof(name_t) },
+        .flags = { .element_size = sizeof(uint8_t) },
+    };
+    pp->recording = &recording;
+    process_file(pp, file);
+    pp->recording = NULL;
+
+    if (recording.cacheable) {
+        save_image(pp, &recording, image_path, key);
+    }
+    list_clear(&recording.changed);
+    list_clear(&recording.used);
+    list_clear(&recording.flags);
+}
+
+static void handle_include(pp_t *pp, pp_file_ctx_t *fctx, source_loc_t loc, sv_t line) {
+    skip_space(&line);
+
+    char close;
+    if (line.length > 0 && line.string[0] == '"') {
+        close = '"';
+    } else if (line.length > 0 && line.string[0] == '<') {
+        close = '>';
+    } else {
+        report_error(source_loc_at(fctx->source, line.string), "Expected \"FILENAME\" or <FILENAME> after #include");
+    }
+
+    sv_consume(&line, 1);
+    const char *name_end = memchr(line.string, close, line.length);
+    if (name_end == NULL || name_end == line.string) {
+        report_error(loc, "Invalid #include file name");
+    }
+    sv_t name = sv_consume(&line, name_end - line.string);
+
+    name_t path = resolve_include(pp, fctx, name, close == '>');
+    if (path == NAME_NONE) {
+        report_error(loc, "Cannot find include file '%.*s'", (int)name.length, name.string);
+    }
+    if (pp->include_depth >= PP_MAX_INCLUDE_DEPTH) {
+        report_error(loc, "#include nested too deeply");
+    }
+    pp->include_depth++;
+
+    pp_file_t *file = find_loaded_file(pp, path);
+    if (file == NULL && close == '>' && pp->cache_dir != NULL && pp->recording == NULL) {
+        include_cached(pp, loc, path);
+    } else {
+        if (file == NULL) {
+            file = load_file(pp, path);
+        }
+        if (file == NULL) {
+            report_error(loc, "Could not read include file '%s'", name_cstr(path));
+        }
+
+        // Reincluding a file seen before the recording started depends on its guard state
+        if (pp->recording != NULL) {
+            for (size_t i = 0; i < pp->recording->first_file; i++) {
+                if (*list_at(&pp->files, pp_file_t *, i) == file) {
+                    pp->recording->cacheable = false;
+                }
+            }
+        }
+        process_file(pp, file);
+    }
+
+    pp->include_depth--;
+}
+
+// line is the directive text after the '#'
+static void handle_directive(pp_t *pp, pp_file_ctx_t *fctx, sv_t line) {
+    skip_space(&line);
+    source_loc_t loc = source_loc_at(fctx->source, line.string);
+    sv_t directive = take_identifier(&line);
+
+    bool first_directive = !fctx->seen_directive;
+    fctx->seen_directive = true;
+    if (fctx->conds.length == 0 && !(first_directive && sv_is(directive, "ifndef"))) {
+        fctx->guard_possible = false;
+    }
+
+    if (sv_is(directive, "ifdef") || sv_is(directive, "ifndef")) {
+        bool defined = false;
+        if (is_active(fctx)) {
+            name_t name = expect_macro_name(fctx, &line, sv_is(directive, "ifdef") ? "ifdef" : "ifndef");
+            defined = find_macro(pp, name) != NULL;
+            if (fctx->conds.length == 0 && first_directive && !defined) {
+                fctx->guard = name;
+            }
+        }
+        push_cond(fctx, loc, sv_is(directive, "ifdef") ? defined : !defined);
+    } else if (sv_is(directive, "if")) {
+        push_cond(fctx, loc, is_active(fctx) && eval_if(pp, fctx, line));
+    } else if (sv_is(directive, "elif") || sv_is(directive, "else")) {
+        if (fctx->conds.length == 0) {
+            report_error(loc, "#%.*s without #if", (int)directive.length, directive.string);
+        }
+        if (fctx->conds.length == 1) {
+            fctx->guard_possible = false;
+        }
+
+        pp_cond_t *cond = list_at(&fctx->conds, pp_cond_t, fctx->conds.length - 1);
+        if (cond->seen_else) {
+            report_error(loc, "#%.*s after #else", (int)directive.length, directive.string);
+        }
+
+        bool condition = true;
+        if (sv_is(directive, "elif")) {
+            condition = cond->parent_active && !cond->taken && eval_if(pp, fctx, line);
+        } else {
+            cond->seen_else = true;
+        }
+        cond->active = cond->parent_active && !cond->taken && condition;
+        cond->taken |= cond->active;
+    } else if (sv_is(directive, "endif")) {
+        if (fctx->conds.length == 0) {
+            report_error(loc, "#endif without #if");
+        }
+        list_pop(&fctx->conds);
+        if (fctx->conds.length == 0 && fctx->guard != NAME_NONE) {
+            fctx->guard_closed = true;
+        }
+    } else if (!is_active(fctx)) {
+        // Other directives in skipped groups are ignored
+    } else if (sv_is(directive, "define")) {
+        handle_define(pp, fctx, line);
+    } else if (sv_is(directive, "undef")) {
+        set_macro(pp, expect_macro_name(fctx, &line, "undef"), NULL);
+    } else if (sv_is(directive, "include")) {
+        handle_include(pp, fctx, loc, line);
+    } else if (sv_is(directive, "pragma")) {
+        skip_space(&line);
+        if (sv_is(take_identifier(&line), "once")) {
+            fctx->file->once = true;
+        }
+        // Unknown pragmas are ignored
+    } else if (sv_is(directive, "error")) {
+        line = sv_trim_left(line);
+        report_error(loc, "#error %.*s", (int)line.length, line.string);
+    } else if (directive.length != 0) {
+        report_error(loc, "Unknown preprocessor directive '#%.*s'", (int)directive.length, directive.string);
+    } else {
+        skip_space(&line);
+        if (line.length != 0) {
+            report_error(loc, "Invalid preprocessor directive");
+        }
+        // A lone '#' is a null directive
+    }
+}
+
+// Returns the end of the directive starting at p, the newline not preceded by a line splice or inside a comment
+static const char *find_directive_end(const char *p, const char *end) {
+    while (p < end) {
+        if (*p == '\n') {
+            if (p[-1] != '\\') {
+                return p;
+            }
+            p++;
+        } else if (p[0] == '/' && p + 1 < end && p[1] == '/') {
+            // A line comment runs to the end of the directive, whatever it contains
+            p += 2;
+            while (p < end && !(*p == '\n' && p[-1] != '\\')) {
+                p++;
+            }
+            return p;
+        } else if (p[0] == '/' && p + 1 < end && p[1] == '*') {
+            p += 2;
+            while (p < end && !(p[0] == '*' && p + 1 < end && p[1] == '/')) {
+                p++;
+            }
+            p = p < end ? p + 2 : end;
+        } else if (*p == '"' || *p == '\'') {
+            char quote = *p++;
+            while (p < end && *p != quote && *p != '\n') {
+                p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+            }
+            if (p < end && *p == quote) {
+                p++;
+            }
+        } else {
+            p++;
+        }
+    }
+    return end;
+}
+
+// Tracks whether a block comment is still open at the end of [p, end)
+static bool scan_comments(const char *p, const char *end, bool in_comment) {
+    while (p < end) {
+        if (in_comment) {
+            if (p[0] == '*' && p + 1 < end && p[1] == '/') {
+                in_comment = false;
+                p += 2;
+            } else {
+                p++;
+            }
+        } else if (*p == '"' || *p == '\'') {
+            char quote = *p++;
+            while (p < end && *p != quote) {
+                p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+            }
+            if (p < end && *p == quote) {
+                p++;
+            }
+        } else if (p[0] == '/' && p + 1 < end && p[1] == '/') {
+            return false;
+        } else if (p[0] == '/' && p + 1 < end && p[1] == '*') {
+            in_comment = true;
+            p += 2;
+        } else {
+            p++;
+        }
+    }
+    return in_comment;
+}
+
+static const char *skip_line(const char *p, const char *end, bool *in_comment) {
+    const char *newline = memchr(p, '\n', end - p);
+    const char *line_end = newline != NULL ? newline : end;
+    // Lines without a '/' can neither open nor close a comment
+    if (*in_comment || memchr(p, '/', line_end - p) != NULL) {
+        *in_comment = scan_comments(p, line_end, *in_comment);
+    }
+    return newline != NULL ? newline + 1 : end;
+}
+
+static void process_file(pp_t *pp, pp_file_t *file) {
+    if (file->once || (file->guard != NAME_NONE && find_macro(pp, file->guard) != NULL)) {
+        return;
+    }
+
+    pp_file_ctx_t fctx = {
+        .file = file,
+        .source = file->source,
+        .conds = { .element_size = sizeof(pp_cond_t) },
+        .guard_possible = true,
+    };
+
+    // Text between directives is lexed in chunks, directives are handled on the raw text
+    const char *p = file->source->code;
+    const char *end = p + file->source->length;
+    const char *chunk_start = p;
+    bool in_comment = false;
+    while (p < end) {
+        if (!in_comment) {
+            const char *q = p;
+            while (q < end && (*q == ' ' || *q == '\t')) {
+                q++;
+            }
+            if (q < end && *q == '#') {
+                if (is_active(&fctx)) {
+                    emit_chunk(pp, &fctx, chunk_start, p);
+                }
+                const char *directive_end = find_directive_end(q + 1, end);
+                handle_directive(pp, &fctx, (sv_t){ .string = q + 1, .length = directive_end - (q + 1) });
+                p = directive_end < end ? directive_end + 1 : end;
+                chunk_start = p;
+                continue;
+            }
+        }
+        p = skip_line(p, end, &in_comment);
+    }
+    if (is_active(&fctx)) {
+        emit_chunk(pp, &fctx, chunk_start, end);
+    }
+
+    if (fctx.conds.length > 0) {
+        report_error(list_at(&fctx.conds, pp_cond_t, fctx.conds.length - 1)->source_loc, "Unterminated conditional directive");
+    }
+    if (fctx.guard_possible && fctx.guard_closed) {
+        file->guard = fctx.guard;
+    }
+    list_clear(&fctx.conds);
+}
+
+bool preprocess(token_stream_t *tokens, const char *path) {
+    pp_t pp = {
+        .out = tokens,
+        .macros = { .element_size = sizeof(macro_t *) },
+        .files = { .element_size = sizeof(pp_file_t *) },
+        .lexed = token_stream_new(),
+        .chunk = { .element_size = sizeof(token_t) },
+        .expanded = { .element_size = sizeof(token_t) },
+        .cache_dir = image_cache_dir(),
+        .defined_name = intern_cstr("defined"),
+        .va_args_name = intern_cstr("__VA_ARGS__"),
+    };
+
+    pp_file_t *file = load_file(&pp, intern_cstr(path));
+    if (file == NULL) {
+        return false;
+    }
+    process_file(&pp, file);
+
+    for (size_t i = 0; i < pp.macros.length; i++) {
+        macro_t *macro = *list_at(&pp.macros, macro_t *, i);
+        if (macro != NULL) {
+            free_macro(macro);
+        }
+    }
+    list_clear(&pp.macros);
+    // Files stay loaded, source locations keep pointing into their text
+    list_clear(&pp.files);
+    token_stream_clear(&pp.lexed);
+    list_clear(&pp.chunk);
+    list_clear(&pp.expanded);
+    return true;
+}
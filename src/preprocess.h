@@ -0,0 +1,11 @@
+#pragma once
+
+#include "scc.h"
+
+// Directory searched for <...> includes, and for "..." includes not found next to the including file
+#define PP_SYSTEM_INCLUDE_DIR "./std"
+#define PP_MAX_INCLUDE_DEPTH 200
+
+// Preprocesses the file at path and appends the resulting tokens to tokens.
+// Returns false if the file could not be read, other errors are reported directly.
+bool preprocess(token_stream_t *tokens, const char *path);
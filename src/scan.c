@@ -0,0 +1,259 @@
+#include "scc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define SCAN_X86
+#endif
+
+const uint8_t char_class[256] = {
+    ['\t'] = CHAR_SPACE,
+    ['\n'] = CHAR_SPACE,
+    ['\v'] = CHAR_SPACE,
+    ['\f'] = CHAR_SPACE,
+    ['\r'] = CHAR_SPACE,
+    [' '] = CHAR_SPACE,
+    ['0' ... '9'] = CHAR_DIGIT | CHAR_IDENT,
+    ['a' ... 'z'] = CHAR_IDENT_START | CHAR_IDENT,
+    ['A' ... 'Z'] = CHAR_IDENT_START | CHAR_IDENT,
+    ['_'] = CHAR_IDENT_START | CHAR_IDENT,
+};
+
+typedef struct {
+    size_t (*whitespace)(const char *s, size_t n);
+    size_t (*identifier)(const char *s, size_t n);
+    size_t (*digits)(const char *s, size_t n);
+    size_t (*string_body)(const char *s, size_t n, char quote);
+} scanner_t;
+
+static scanner_t scanner;
+
+static size_t scan_class_scalar(const char *s, size_t n, uint8_t class) {
+    size_t i = 0;
+    while (i < n && char_is(s[i], class)) {
+        i++;
+    }
+    return i;
+}
+
+static size_t scan_whitespace_scalar(const char *s, size_t n) {
+    return scan_class_scalar(s, n, CHAR_SPACE);
+}
+
+static size_t scan_identifier_scalar(const char *s, size_t n) {
+    return scan_class_scalar(s, n, CHAR_IDENT);
+}
+
+static size_t scan_digits_scalar(const char *s, size_t n) {
+    return scan_class_scalar(s, n, CHAR_DIGIT);
+}
+
+static size_t scan_string_body_scalar(const char *s, size_t n, char quote) {
+    size_t i = 0;
+    while (i < n && s[i] != quote && s[i] != '\\') {
+        i++;
+    }
+    return i;
+}
+
+static const scanner_t scalar_scanner = {
+    .whitespace = scan_whitespace_scalar,
+    .identifier = scan_identifier_scalar,
+    .digits = scan_digits_scalar,
+    .string_body = scan_string_body_scalar,
+};
+
+#ifdef SCAN_X86
+
+// Byte-wise class tests. All classes are ASCII, so bytes >= 0x80 compare as negative and never match.
+
+#define sse2 __attribute__((target("sse2")))
+#define avx2 __attribute__((target("avx2")))
+
+sse2 static inline __m128i in_range_128(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+sse2 static inline __m128i space_128(__m128i v) {
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), in_range_128(v, '\t', '\r'));
+}
+
+sse2 static inline __m128i digit_128(__m128i v) {
+    return in_range_128(v, '0', '9');
+}
+
+sse2 static inline __m128i ident_128(__m128i v) {
+    // Setting bit 5 folds upper case letters onto lower case without creating new matches
+    __m128i alpha = in_range_128(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, underscore), digit_128(v));
+}
+
+avx2 static inline __m256i in_range_256(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+avx2 static inline __m256i space_256(__m256i v) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), in_range_256(v, '\t', '\r'));
+}
+
+avx2 static inline __m256i digit_256(__m256i v) {
+    return in_range_256(v, '0', '9');
+}
+
+avx2 static inline __m256i ident_256(__m256i v) {
+    __m256i alpha = in_range_256(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, underscore), digit_256(v));
+}
+
+// Skips whole blocks while every byte matches, the scalar loop handles the first mismatch and the tail
+#define define_scan_128(name, match, class) \
+    sse2 static size_t name(const char *s, size_t n) { \
+        size_t i = 0; \
+        while (n - i >= 16) { \
+            __m128i v = _mm_loadu_si128((const __m128i *)(s + i)); \
+            unsigned mask = ~(unsigned)_mm_movemask_epi8(match(v)) & 0xffff; \
+            if (mask != 0) { \
+                return i + __builtin_ctz(mask); \
+            } \
+            i += 16; \
+        } \
+        return i + scan_class_scalar(s + i, n - i, class); \
+    }
+
+#define define_scan_256(name, match, class) \
+    avx2 static size_t name(const char *s, size_t n) { \
+        size_t i = 0; \
+        while (n - i >= 32) { \
+            __m256i v = _mm256_loadu_si256((const __m256i *)(s + i)); \
+            unsigned mask = ~(unsigned)_mm256_movemask_epi8(match(v)); \
+            if (mask != 0) { \
+                return i + __builtin_ctz(mask); \
+            } \
+            i += 32; \
+        } \
+        return i + scan_class_scalar(s + i, n - i, class); \
+    }
+
+define_scan_128(scan_whitespace_sse2, space_128, CHAR_SPACE)
+define_scan_128(scan_identifier_sse2, ident_128, CHAR_IDENT)
+define_scan_128(scan_digits_sse2, digit_128, CHAR_DIGIT)
+define_scan_256(scan_whitespace_avx2, space_256, CHAR_SPACE)
+define_scan_256(scan_identifier_avx2, ident_256, CHAR_IDENT)
+define_scan_256(scan_digits_avx2, digit_256, CHAR_DIGIT)
+
+sse2 static size_t scan_string_body_sse2(const char *s, size_t n, char quote) {
+    __m128i quotes = _mm_set1_epi8(quote);
+    __m128i backslashes = _mm_set1_epi8('\\');
+    size_t i = 0;
+    while (n - i >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quotes), _mm_cmpeq_epi8(v, backslashes)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+    return i + scan_string_body_scalar(s + i, n - i, quote);
+}
+
+avx2 static size_t scan_string_body_avx2(const char *s, size_t n, char quote) {
+    __m256i quotes = _mm256_set1_epi8(quote);
+    __m256i backslashes = _mm256_set1_epi8('\\');
+    size_t i = 0;
+    while (n - i >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, quotes), _mm256_cmpeq_epi8(v, backslashes)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 32;
+    }
+    return i + scan_string_body_scalar(s + i, n - i, quote);
+}
+
+static const scanner_t sse2_scanner = {
+    .whitespace = scan_whitespace_sse2,
+    .identifier = scan_identifier_sse2,
+    .digits = scan_digits_sse2,
+    .string_body = scan_string_body_sse2,
+};
+
+static const scanner_t avx2_scanner = {
+    .whitespace = scan_whitespace_avx2,
+    .identifier = scan_identifier_avx2,
+    .digits = scan_digits_avx2,
+    .string_body = scan_string_body_avx2,
+};
+
+#endif
+
+scan_isa_t scan_detect_isa(void) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SCAN_ISA_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SCAN_ISA_SSE2;
+    }
+#endif
+    return SCAN_ISA_SCALAR;
+}
+
+void scan_select_isa(scan_isa_t isa) {
+    switch (isa) {
+        case SCAN_ISA_SCALAR:
+            scanner = scalar_scanner;
+            break;
+#ifdef SCAN_X86
+        case SCAN_ISA_SSE2:
+            scanner = sse2_scanner;
+            break;
+        case SCAN_ISA_AVX2:
+            scanner = avx2_scanner;
+            break;
+#endif
+        default:
+            unreachable();
+    }
+}
+
+const char *scan_isa_name(scan_isa_t isa) {
+    switch (isa) {
+        case SCAN_ISA_SCALAR:
+            return "scalar";
+        case SCAN_ISA_SSE2:
+            return "sse2";
+        case SCAN_ISA_AVX2:
+            return "avx2";
+        default:
+            unreachable();
+    }
+}
+
+static inline void ensure_selected(void) {
+    if (scanner.whitespace == NULL) {
+        scan_select_isa(scan_detect_isa());
+    }
+}
+
+size_t scan_whitespace(const char *s, size_t n) {
+    ensure_selected();
+    return scanner.whitespace(s, n);
+}
+
+size_t scan_identifier(const char *s, size_t n) {
+    ensure_selected();
+    return scanner.identifier(s, n);
+}
+
+size_t scan_digits(const char *s, size_t n) {
+    ensure_selected();
+    return scanner.digits(s, n);
+}
+
+size_t scan_string_body(const char *s, size_t n, char quote) {
+    ensure_selected();
+    return scanner.string_body(s, n, quote);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "scc.h"
+
+typedef enum {
+    CHAR_SPACE = 1 << 0,
+    CHAR_DIGIT = 1 << 1,
+    CHAR_IDENT_START = 1 << 2,
+    CHAR_IDENT = 1 << 3,
+} char_class_t;
+
+typedef enum {
+    SCAN_ISA_SCALAR,
+    SCAN_ISA_SSE2,
+    SCAN_ISA_AVX2,
+} scan_isa_t;
+
+extern const uint8_t char_class[256];
+
+#define char_is(c, class) ((char_class[(unsigned char)(c)] & (class)) != 0)
+
+// Each scanner returns the length of the run of matching bytes at the start of s, at most n
+size_t scan_whitespace(const char *s, size_t n);
+size_t scan_identifier(const char *s, size_t n);
+size_t scan_digits(const char *s, size_t n);
+// Stops at the closing quote or at a backslash starting an escape sequence
+size_t scan_string_body(const char *s, size_t n, char quote);
+
+scan_isa_t scan_detect_isa(void);
+void scan_select_isa(scan_isa_t isa);
+const char *scan_isa_name(scan_isa_t isa);
@@ -3,15 +3,37 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "helpers.h"
 #include "list.h"
 #include "sv.h"
+#include "intern.h"
+#include "source.h"
+#include "scan.h"
 #include "lex.h"
+#include "image.h"
+#include "outbuf.h"
+#include "preprocess.h"
+#include "ast.h"
+#include "type.h"
 #include "parse.h"
 #include "analyze.h"
+#include "ir.h"
+#include "strpool.h"
+#include "ssa.h"
+#include "codegen.h"
@@ -0,0 +1,84 @@
+#include "scc.h"
+
+// All registered files, ordered by base offset
+static list_t source_files = { .element_size = sizeof(source_file_t *) };
+static uint32_t next_base = 0;
+
+source_file_t *source_add_file(const char *file_name, const char *code, size_t length) {
+    // +1 so a location right after the last character still maps to this file
+    assert((uint64_t)next_base + length + 1 <= UINT32_MAX && "Source too large for 32-bit offsets");
+
+    source_file_t file = {
+        .file_name = file_name,
+        .code = code,
+        .length = length,
+        .base = next_base,
+        .line_starts = { .element_size = sizeof(uint32_t) },
+    };
+    next_base += length + 1;
+
+    source_file_t *file_ptr = heapify(source_file_t, &file);
+    list_push(&source_files, &file_ptr);
+    return file_ptr;
+}
+
+source_loc_t source_loc_at(const source_file_t *file, const char *p) {
+    assert(p >= file->code && p <= file->code + file->length);
+    return (source_loc_t){ .offset = file->base + (uint32_t)(p - file->code) };
+}
+
+static source_file_t *find_file(uint32_t offset) {
+    assert(source_files.length > 0);
+
+    size_t lo = 0;
+    size_t hi = source_files.length;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if ((*list_at(&source_files, source_file_t *, mid))->base <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return *list_at(&source_files, source_file_t *, lo);
+}
+
+static void build_line_starts(source_file_t *file) {
+    uint32_t start = 0;
+    list_push(&file->line_starts, &start);
+
+    const char *p = file->code;
+    const char *end = file->code + file->length;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        p++;
+        start = (uint32_t)(p - file->code);
+        list_push(&file->line_starts, &start);
+    }
+}
+
+resolved_loc_t source_loc_resolve(source_loc_t loc) {
+    source_file_t *file = find_file(loc.offset);
+    if (file->line_starts.length == 0) {
+        build_line_starts(file);
+    }
+
+    uint32_t offset = loc.offset - file->base;
+
+    // Last line starting at or before offset
+    size_t lo = 0;
+    size_t hi = file->line_starts.length;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (*list_at(&file->line_starts, uint32_t, mid) <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return (resolved_loc_t){
+        .file_name = file->file_name,
+        .line = lo + 1,
+        .column = offset - *list_at(&file->line_starts, uint32_t, lo) + 1,
+    };
+}
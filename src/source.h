@@ -0,0 +1,27 @@
+#pragma once
+
+#include "scc.h"
+
+// Compact source location, an offset into the global source space spanned by all registered files.
+// Resolved into a file name, line and column only when a diagnostic is printed.
+typedef struct {
+    uint32_t offset;
+} source_loc_t;
+
+typedef struct {
+    const char *file_name;
+    const char *code;
+    size_t length;
+    uint32_t base;
+    list_t line_starts;  // uint32_t offsets relative to code, built on first resolve
+} source_file_t;
+
+typedef struct {
+    const char *file_name;
+    size_t line;
+    size_t column;
+} resolved_loc_t;
+
+source_file_t *source_add_file(const char *file_name, const char *code, size_t length);
+source_loc_t source_loc_at(const source_file_t *file, const char *p);
+resolved_loc_t source_loc_resolve(source_loc_t loc);
@@ -0,0 +1,512 @@
+#include "scc.h"
+
+// Construction follows Cytron et al. Phis for a variable go on the iterated dominance frontier of
+// the blocks storing it, then a walk over the dominator tree replaces each load with the value on
+// top of the variable's stack. Dominators come from the iterative algorithm of Cooper, Harvey and
+// Kennedy. Only variables that are live into some block get phis (semi-pruned SSA), which leaves
+// out the many locals that never outlive a single block.
+
+#define SSA_NONE SIZE_MAX
+
+typedef struct {
+	ir_func_t *func;
+	size_t block_count;
+	ir_block_id_t *rpo;        // reachable blocks in reverse postorder
+	size_t rpo_count;
+	size_t *rpo_index;         // position of each block in rpo, SSA_NONE if unreachable
+	list_t *preds;             // ir_block_id_t, reachable predecessors of each block
+	ir_block_id_t *idom;       // immediate dominator of each reachable block
+	list_t *frontier;          // ir_block_id_t, dominance frontier of each block
+	size_t var_count;
+	size_t *var_index;         // index among the variables of each temp, SSA_NONE for other temps
+	ir_temp_id_t *vars;        // temp of each variable
+	list_t *stacks;            // ir_value_t, values reaching the current block for each variable
+	list_t pushed;             // size_t, variables in the order values were pushed, for popping
+	ir_value_t *replacements;  // value each removed load is replaced with, indexed by temp
+	size_t replacement_count;
+} ssa_ctx_t;
+
+static size_t block_successors(ir_block_t *block, ir_block_id_t successors[2]) {
+	switch (block->jump.kind) {
+		case IR_JUMP_JMP:
+			successors[0] = block->jump.targets[0];
+			return 1;
+		case IR_JUMP_JNZ:
+			successors[0] = block->jump.targets[0];
+			successors[1] = block->jump.targets[1];
+			return successors[0] == successors[1] ? 1 : 2;
+		case IR_JUMP_RET:
+			return 0;
+		case IR_JUMP_NONE:
+			break;
+	}
+	assert(false && "Every block must end with a jump");
+	return 0;
+}
+
+// Reverse postorder of the blocks reachable from the entry, and their predecessors
+static void compute_order(ssa_ctx_t *ctx) {
+	typedef struct {
+		ir_block_id_t block;
+		size_t next_successor;
+	} frame_t;
+
+	frame_t *stack = malloc(ctx->block_count * sizeof(frame_t));
+	bool *visited = calloc(ctx->block_count, sizeof(bool));
+	assert(stack != NULL && visited != NULL);
+
+	size_t depth = 1;
+	stack[0] = (frame_t) { .block = 0 };
+	visited[0] = true;
+	while (depth > 0) {
+		frame_t *frame = &stack[depth - 1];
+		ir_block_id_t successors[2];
+		size_t successor_count = block_successors(ir_block(ctx->func, frame->block), successors);
+		if (frame->next_successor < successor_count) {
+			ir_block_id_t successor = successors[frame->next_successor++];
+			if (!visited[successor]) {
+				visited[successor] = true;
+				stack[depth++] = (frame_t) { .block = successor };
+			}
+		} else {
+			ctx->rpo[ctx->rpo_count++] = frame->block;
+			depth--;
+		}
+	}
+	free(stack);
+	free(visited);
+
+	for (size_t i = 0; i < ctx->rpo_count / 2; i++) {
+		ir_block_id_t block = ctx->rpo[i];
+		ctx->rpo[i] = ctx->rpo[ctx->rpo_count - 1 - i];
+		ctx->rpo[ctx->rpo_count - 1 - i] = block;
+	}
+	for (size_t i = 0; i < ctx->rpo_count; i++) {
+		ctx->rpo_index[ctx->rpo[i]] = i;
+	}
+
+	for (size_t i = 0; i < ctx->rpo_count; i++) {
+		ir_block_id_t block = ctx->rpo[i];
+		ir_block_id_t successors[2];
+		size_t successor_count = block_successors(ir_block(ctx->func, block), successors);
+		for (size_t j = 0; j < successor_count; j++) {
+			list_push(&ctx->preds[successors[j]], &block);
+		}
+	}
+}
+
+static ir_block_id_t intersect(ssa_ctx_t *ctx, ir_block_id_t a, ir_block_id_t b) {
+	while (a != b) {
+		while (ctx->rpo_index[a] > ctx->rpo_index[b]) {
+			a = ctx->idom[a];
+		}
+		while (ctx->rpo_index[b] > ctx->rpo_index[a]) {
+			b = ctx->idom[b];
+		}
+	}
+	return a;
+}
+
+static void compute_dominators(ssa_ctx_t *ctx) {
+	for (size_t i = 0; i < ctx->block_count; i++) {
+		ctx->idom[i] = IR_BLOCK_NONE;
+	}
+	ctx->idom[0] = 0;
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t i = 1; i < ctx->rpo_count; i++) {
+			ir_block_id_t block = ctx->rpo[i];
+			ir_block_id_t new_idom = IR_BLOCK_NONE;
+			for (size_t j = 0; j < ctx->preds[block].length; j++) {
+				ir_block_id_t pred = *list_at(&ctx->preds[block], ir_block_id_t, j);
+				if (ctx->idom[pred] == IR_BLOCK_NONE) {
+					continue;
+				}
+				new_idom = new_idom == IR_BLOCK_NONE ? pred : intersect(ctx, new_idom, pred);
+			}
+			if (ctx->idom[block] != new_idom) {
+				ctx->idom[block] = new_idom;
+				changed = true;
+			}
+		}
+	}
+
+	// A join is in the frontier of every block between each predecessor and its dominator
+	for (size_t i = 0; i < ctx->rpo_count; i++) {
+		ir_block_id_t block = ctx->rpo[i];
+		if (ctx->preds[block].length < 2) {
+			continue;
+		}
+		for (size_t j = 0; j < ctx->preds[block].length; j++) {
+			ir_block_id_t runner = *list_at(&ctx->preds[block], ir_block_id_t, j);
+			while (runner != ctx->idom[block]) {
+				list_t *frontier = &ctx->frontier[runner];
+				if (frontier->length == 0 || *list_at(frontier, ir_block_id_t, frontier->length - 1) != block) {
+					list_push(frontier, &block);
+				}
+				runner = ctx->idom[runner];
+			}
+		}
+	}
+}
+
+// Variable addr refers to, SSA_NONE if it's any other address
+static size_t value_var(ssa_ctx_t *ctx, ir_value_t addr) {
+	if (addr.kind != IR_VALUE_TEMP || addr.as.temp >= ctx->func->temps.length) {
+		return SSA_NONE;
+	}
+	return ctx->var_index[addr.as.temp];
+}
+
+static qbe_value_type_t var_class(ssa_ctx_t *ctx, size_t var) {
+	switch (ir_temp(ctx->func, ctx->vars[var])->type) {
+		case QBE_VALUE_LONG:
+		case QBE_VALUE_UNSIGNED_LONG:
+			return QBE_VALUE_LONG;
+		default:
+			return QBE_VALUE_WORD;
+	}
+}
+
+static void insert_phis(ssa_ctx_t *ctx) {
+	// Variables loaded in a block before being stored there are live into it and need phis
+	bool *is_live_in = calloc(ctx->var_count, sizeof(bool));
+	size_t *stored_in = malloc(ctx->var_count * sizeof(size_t));
+	list_t *def_blocks = calloc(ctx->var_count, sizeof(list_t));
+	assert(is_live_in != NULL && stored_in != NULL && def_blocks != NULL);
+	for (size_t i = 0; i < ctx->var_count; i++) {
+		stored_in[i] = SSA_NONE;
+		def_blocks[i].element_size = sizeof(ir_block_id_t);
+	}
+
+	for (size_t i = 0; i < ctx->rpo_count; i++) {
+		ir_block_id_t block_id = ctx->rpo[i];
+		ir_block_t *block = ir_block(ctx->func, block_id);
+		for (size_t j = 0; j < block->instrs.length; j++) {
+			ir_instr_t *instr = list_at(&block->instrs, ir_instr_t, j);
+			if (instr->op == IR_LOAD) {
+				size_t var = value_var(ctx, instr->args[0]);
+				if (var != SSA_NONE && stored_in[var] != block_id) {
+					is_live_in[var] = true;
+				}
+			} else if (instr->op == IR_STORE) {
+				size_t var = value_var(ctx, instr->args[1]);
+				if (var != SSA_NONE && stored_in[var] != block_id) {
+					stored_in[var] = block_id;
+					list_push(&def_blocks[var], &block_id);
+				}
+			}
+		}
+	}
+
+	// Blocks are marked with the variable they last got a phi or a worklist entry for
+	size_t *has_phi = malloc(ctx->block_count * sizeof(size_t));
+	size_t *queued = malloc(ctx->block_count * sizeof(size_t));
+	assert(has_phi != NULL && queued != NULL);
+	for (size_t i = 0; i < ctx->block_count; i++) {
+		has_phi[i] = SSA_NONE;
+		queued[i] = SSA_NONE;
+	}
+
+	for (size_t var = 0; var < ctx->var_count; var++) {
+		list_t *worklist = &def_blocks[var];
+		if (!is_live_in[var]) {
+			list_clear(worklist);
+			continue;
+		}
+		for (size_t i = 0; i < worklist->length; i++) {
+			queued[*list_at(worklist, ir_block_id_t, i)] = var;
+		}
+
+		while (worklist->length > 0) {
+			ir_block_id_t block_id = *list_at(worklist, ir_block_id_t, worklist->length - 1);
+			list_pop(worklist);
+
+			list_t *frontier = &ctx->frontier[block_id];
+			for (size_t i = 0; i < frontier->length; i++) {
+				ir_block_id_t join_id = *list_at(frontier, ir_block_id_t, i);
+				if (has_phi[join_id] == var) {
+					continue;
+				}
+				has_phi[join_id] = var;
+
+				// Arguments are filled in while renaming the predecessors
+				list_t *preds = &ctx->preds[join_id];
+				ir_phi_t phi = {
+					.result = ir_new_temp(ctx->func, var_class(ctx, var)),
+					.var = ctx->vars[var],
+					.args = calloc(preds->length, sizeof(ir_phi_arg_t)),
+					.arg_count = preds->length,
+				};
+				assert(phi.args != NULL);
+				for (size_t j = 0; j < preds->length; j++) {
+					phi.args[j].block = *list_at(preds, ir_block_id_t, j);
+				}
+				list_push(&ir_block(ctx->func, join_id)->phis, &phi);
+
+				if (queued[join_id] != var) {
+					queued[join_id] = var;
+					list_push(worklist, &join_id);
+				}
+			}
+		}
+		list_clear(worklist);
+	}
+
+	free(is_live_in);
+	free(stored_in);
+	free(def_blocks);
+	free(has_phi);
+	free(queued);
+}
+
+// Value of the variable where it's used, a variable read before any store is undefined so zero
+// is as good as anything
+static ir_value_t reaching_value(ssa_ctx_t *ctx, size_t var) {
+	list_t *stack = &ctx->stacks[var];
+	if (stack->length == 0) {
+		return ir_const(var_class(ctx, var), 0);
+	}
+	return *list_at(stack, ir_value_t, stack->length - 1);
+}
+
+static void push_value(ssa_ctx_t *ctx, size_t var, ir_value_t value) {
+	list_push(&ctx->stacks[var], &value);
+	list_push(&ctx->pushed, &var);
+}
+
+static ir_value_t resolve(ssa_ctx_t *ctx, ir_value_t value) {
+	if (value.kind != IR_VALUE_TEMP) {
+		return value;
+	}
+	assert(value_var(ctx, value) == SSA_NONE && "Variables can only be loaded and stored");
+	if (value.as.temp < ctx->replacement_count && ctx->replacements[value.as.temp].kind != IR_VALUE_NONE) {
+		return ctx->replacements[value.as.temp];
+	}
+	return value;
+}
+
+// Values are kept the way a load would return them: narrow variables are extended and words
+// stored from longs are truncated. Returns true if instr became an instruction doing that.
+static bool convert_stored_value(ssa_ctx_t *ctx, size_t var, ir_instr_t *instr, ir_value_t *value) {
+	qbe_value_type_t type = ir_temp(ctx->func, ctx->vars[var])->type;
+	bool is_byte = type == QBE_VALUE_SIGNED_BYTE || type == QBE_VALUE_UNSIGNED_BYTE;
+
+	if (is_byte && value->kind == IR_VALUE_CONST) {
+		value->as.constant = type == QBE_VALUE_SIGNED_BYTE ? (int8_t)value->as.constant : (uint8_t)value->as.constant;
+		value->type = QBE_VALUE_WORD;
+		return false;
+	}
+
+	bool is_long_value = value->type == QBE_VALUE_LONG || value->type == QBE_VALUE_UNSIGNED_LONG;
+	bool needs_truncation = var_class(ctx, var) == QBE_VALUE_WORD && value->kind == IR_VALUE_TEMP && is_long_value;
+	if (!is_byte && !needs_truncation) {
+		return false;
+	}
+
+	ir_value_t result = ir_new_temp(ctx->func, QBE_VALUE_WORD);
+	*instr = (ir_instr_t) {
+		.op = is_byte ? IR_EXT : IR_COPY,
+		.type = QBE_VALUE_WORD,
+		.arg_type = type,
+		.result = result,
+		.args = { *value },
+	};
+	*value = result;
+	return true;
+}
+
+static void rename_block(ssa_ctx_t *ctx, ir_block_id_t block_id) {
+	ir_block_t *block = ir_block(ctx->func, block_id);
+
+	for (size_t i = 0; i < block->phis.length; i++) {
+		ir_phi_t *phi = list_at(&block->phis, ir_phi_t, i);
+		push_value(ctx, ctx->var_index[phi->var], phi->result);
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < block->instrs.length; i++) {
+		ir_instr_t instr = *list_at(&block->instrs, ir_instr_t, i);
+
+		if (instr.op == IR_LOAD) {
+			size_t var = value_var(ctx, instr.args[0]);
+			if (var != SSA_NONE) {
+				assert(instr.result.kind == IR_VALUE_TEMP && instr.result.as.temp < ctx->replacement_count);
+				ctx->replacements[instr.result.as.temp] = reaching_value(ctx, var);
+				continue;
+			}
+		}
+
+		if (instr.op == IR_STORE) {
+			size_t var = value_var(ctx, instr.args[1]);
+			if (var != SSA_NONE) {
+				ir_value_t value = resolve(ctx, instr.args[0]);
+				bool is_converted = convert_stored_value(ctx, var, &instr, &value);
+				push_value(ctx, var, value);
+				if (!is_converted) {
+					continue;
+				}
+				*list_at(&block->instrs, ir_instr_t, kept++) = instr;
+				continue;
+			}
+		}
+
+		for (size_t j = 0; j < 2; j++) {
+			instr.args[j] = resolve(ctx, instr.args[j]);
+		}
+		for (size_t j = 0; j < instr.call_arg_count; j++) {
+			instr.call_args[j] = resolve(ctx, instr.call_args[j]);
+		}
+		*list_at(&block->instrs, ir_instr_t, kept++) = instr;
+	}
+	block->instrs.length = kept;
+
+	block->jump.arg = resolve(ctx, block->jump.arg);
+
+	ir_block_id_t successors[2];
+	size_t successor_count = block_successors(block, successors);
+	for (size_t i = 0; i < successor_count; i++) {
+		ir_block_t *successor = ir_block(ctx->func, successors[i]);
+		for (size_t j = 0; j < successor->phis.length; j++) {
+			ir_phi_t *phi = list_at(&successor->phis, ir_phi_t, j);
+			for (size_t k = 0; k < phi->arg_count; k++) {
+				if (phi->args[k].block == block_id) {
+					phi->args[k].value = reaching_value(ctx, ctx->var_index[phi->var]);
+				}
+			}
+		}
+	}
+}
+
+// Preorder walk over the dominator tree, so every block sees the values stored in the blocks
+// dominating it
+static void rename_vars(ssa_ctx_t *ctx) {
+	// Children of each block in the dominator tree, children[child_start[b]..child_start[b + 1]]
+	size_t *child_start = calloc(ctx->block_count + 1, sizeof(size_t));
+	ir_block_id_t *children = malloc(ctx->rpo_count * sizeof(ir_block_id_t));
+	assert(child_start != NULL && children != NULL);
+	for (size_t i = 1; i < ctx->rpo_count; i++) {
+		child_start[ctx->idom[ctx->rpo[i]] + 1]++;
+	}
+	for (size_t i = 0; i < ctx->block_count; i++) {
+		child_start[i + 1] += child_start[i];
+	}
+	size_t *child_fill = malloc(ctx->block_count * sizeof(size_t));
+	assert(child_fill != NULL);
+	memcpy(child_fill, child_start, ctx->block_count * sizeof(size_t));
+	for (size_t i = 1; i < ctx->rpo_count; i++) {
+		ir_block_id_t block = ctx->rpo[i];
+		children[child_fill[ctx->idom[block]]++] = block;
+	}
+	free(child_fill);
+
+	typedef struct {
+		ir_block_id_t block;
+		size_t next_child;
+		size_t pushed_length;  // values pushed before entering the block
+	} frame_t;
+
+	frame_t *stack = malloc(ctx->rpo_count * sizeof(frame_t));
+	assert(stack != NULL);
+	size_t depth = 1;
+	stack[0] = (frame_t) { .block = 0, .next_child = child_start[0] };
+	rename_block(ctx, 0);
+	while (depth > 0) {
+		frame_t *frame = &stack[depth - 1];
+		if (frame->next_child < child_start[frame->block + 1]) {
+			ir_block_id_t child = children[frame->next_child++];
+			stack[depth++] = (frame_t) {
+				.block = child,
+				.next_child = child_start[child],
+				.pushed_length = ctx->pushed.length,
+			};
+			rename_block(ctx, child);
+			continue;
+		}
+
+		while (ctx->pushed.length > frame->pushed_length) {
+			size_t var = *list_at(&ctx->pushed, size_t, ctx->pushed.length - 1);
+			list_pop(&ctx->stacks[var]);
+			list_pop(&ctx->pushed);
+		}
+		depth--;
+	}
+
+	free(stack);
+	free(child_start);
+	free(children);
+}
+
+void ssa_construct(ir_func_t *func) {
+	size_t block_count = func->blocks.length;
+	ssa_ctx_t ctx = {
+		.func = func,
+		.block_count = block_count,
+		.rpo = malloc(block_count * sizeof(ir_block_id_t)),
+		.rpo_index = malloc(block_count * sizeof(size_t)),
+		.preds = calloc(block_count, sizeof(list_t)),
+		.idom = malloc(block_count * sizeof(ir_block_id_t)),
+		.frontier = calloc(block_count, sizeof(list_t)),
+		.var_index = malloc(func->temps.length * sizeof(size_t)),
+		.pushed = { .element_size = sizeof(size_t) },
+	};
+	assert(ctx.rpo != NULL && ctx.rpo_index != NULL && ctx.preds != NULL && ctx.idom != NULL && ctx.frontier != NULL && ctx.var_index != NULL);
+	for (size_t i = 0; i < block_count; i++) {
+		ctx.rpo_index[i] = SSA_NONE;
+		ctx.preds[i].element_size = sizeof(ir_block_id_t);
+		ctx.frontier[i].element_size = sizeof(ir_block_id_t);
+	}
+
+	for (size_t i = 0; i < func->temps.length; i++) {
+		ctx.var_index[i] = ir_temp(func, i)->kind == IR_TEMP_VAR ? ctx.var_count++ : SSA_NONE;
+	}
+	ctx.vars = malloc((ctx.var_count + 1) * sizeof(ir_temp_id_t));
+	ctx.stacks = calloc(ctx.var_count + 1, sizeof(list_t));
+	assert(ctx.vars != NULL && ctx.stacks != NULL);
+	for (size_t i = 0; i < func->temps.length; i++) {
+		if (ctx.var_index[i] != SSA_NONE) {
+			ctx.vars[ctx.var_index[i]] = (ir_temp_id_t)i;
+			ctx.stacks[ctx.var_index[i]].element_size = sizeof(ir_value_t);
+		}
+	}
+
+	compute_order(&ctx);
+	compute_dominators(&ctx);
+	insert_phis(&ctx);
+
+	// Loads replaced while renaming are older than any temp created from here on
+	ctx.replacement_count = func->temps.length;
+	ctx.replacements = calloc(ctx.replacement_count, sizeof(ir_value_t));
+	assert(ctx.replacements != NULL);
+	rename_vars(&ctx);
+
+	// Unreachable blocks were never renamed, and nothing reachable jumps to them
+	size_t kept = 0;
+	for (size_t i = 0; i < func->layout.length; i++) {
+		ir_block_id_t block = *list_at(&func->layout, ir_block_id_t, i);
+		if (ctx.rpo_index[block] != SSA_NONE) {
+			*list_at(&func->layout, ir_block_id_t, kept++) = block;
+		}
+	}
+	func->layout.length = kept;
+
+	for (size_t i = 0; i < block_count; i++) {
+		list_clear(&ctx.preds[i]);
+		list_clear(&ctx.frontier[i]);
+	}
+	for (size_t i = 0; i < ctx.var_count; i++) {
+		list_clear(&ctx.stacks[i]);
+	}
+	list_clear(&ctx.pushed);
+	free(ctx.rpo);
+	free(ctx.rpo_index);
+	free(ctx.preds);
+	free(ctx.idom);
+	free(ctx.frontier);
+	free(ctx.var_index);
+	free(ctx.vars);
+	free(ctx.stacks);
+	free(ctx.replacements);
+}
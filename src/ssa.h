@@ -0,0 +1,8 @@
+#pragma once
+
+#include "scc.h"
+
+// Keeps the IR_TEMP_VAR locals of a function in temps. Every load of one is replaced by the value
+// reaching it, with phis where control flow joins, and every store by at most a conversion.
+// Blocks that can't be reached from the entry are dropped from the layout.
+void ssa_construct(ir_func_t *func);
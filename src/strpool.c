@@ -0,0 +1,193 @@
+#include "scc.h"
+
+void strpool_init(strpool_t *pool) {
+	*pool = (strpool_t) {
+		.entries = { .element_size = sizeof(strpool_entry_t) },
+		.data = { .element_size = sizeof(sv_t) },
+	};
+}
+
+void strpool_free(strpool_t *pool) {
+	list_clear(&pool->entries);
+	list_clear(&pool->data);
+	free(pool->slots);
+	*pool = (strpool_t) { 0 };
+}
+
+static uint32_t strpool_hash(sv_t string) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < string.length; i++) {
+		hash = (hash ^ (unsigned char)string.string[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static strpool_entry_t *strpool_entry(const strpool_t *pool, uint32_t index) {
+	return &((strpool_entry_t *)pool->entries.element_bytes)[index];
+}
+
+// Slot holding string, or the empty slot it would go in
+static size_t strpool_find_slot(const strpool_t *pool, sv_t string) {
+	size_t slot = strpool_hash(string) & (pool->slot_count - 1);
+	while (pool->slots[slot] != 0 && !sv_eq(strpool_entry(pool, pool->slots[slot] - 1)->string, string)) {
+		slot = (slot + 1) & (pool->slot_count - 1);
+	}
+	return slot;
+}
+
+static void strpool_grow(strpool_t *pool) {
+	size_t slot_count = pool->slot_count == 0 ? 64 : pool->slot_count * 2;
+	free(pool->slots);
+	pool->slots = calloc(slot_count, sizeof(uint32_t));
+	assert(pool->slots != NULL);
+	pool->slot_count = slot_count;
+
+	for (size_t i = 0; i < pool->entries.length; i++) {
+		size_t slot = strpool_find_slot(pool, strpool_entry(pool, i)->string);
+		pool->slots[slot] = (uint32_t)i + 1;
+	}
+}
+
+void strpool_add(strpool_t *pool, sv_t string) {
+	// Keep the load factor below 1/2
+	if ((pool->entries.length + 1) * 2 > pool->slot_count) {
+		strpool_grow(pool);
+	}
+
+	size_t slot = strpool_find_slot(pool, string);
+	if (pool->slots[slot] != 0) {
+		return;
+	}
+	strpool_entry_t entry = { .string = string };
+	list_push(&pool->entries, &entry);
+	pool->slots[slot] = (uint32_t)pool->entries.length;
+}
+
+// Orders strings by their reversed bytes, so every string directly precedes the strings it's a tail of
+static int compare_reversed(const void *a, const void *b) {
+	sv_t left = (*(strpool_entry_t *const *)a)->string;
+	sv_t right = (*(strpool_entry_t *const *)b)->string;
+	size_t length = left.length < right.length ? left.length : right.length;
+	for (size_t i = 1; i <= length; i++) {
+		unsigned char l = left.string[left.length - i];
+		unsigned char r = right.string[right.length - i];
+		if (l != r) {
+			return l < r ? -1 : 1;
+		}
+	}
+	return left.length < right.length ? -1 : left.length > right.length;
+}
+
+static bool is_tail_of(sv_t tail, sv_t string) {
+	return tail.length <= string.length && memcmp(string.string + string.length - tail.length, tail.string, tail.length) == 0;
+}
+
+void strpool_finish(strpool_t *pool) {
+	size_t count = pool->entries.length;
+	if (count == 0) {
+		return;
+	}
+	strpool_entry_t **sorted = malloc(count * sizeof(strpool_entry_t *));
+	assert(sorted != NULL);
+	for (size_t i = 0; i < count; i++) {
+		sorted[i] = strpool_entry(pool, i);
+	}
+	qsort(sorted, count, sizeof(sorted[0]), compare_reversed);
+
+	// Going from the longest string of each tail chain down, every string that's a tail of the one
+	// after it shares that one's data. Owners are marked with SIZE_MAX and numbered below.
+	strpool_entry_t *owner = NULL;
+	for (size_t i = count; i-- > 0;) {
+		strpool_entry_t *entry = sorted[i];
+		if (owner != NULL && is_tail_of(entry->string, sorted[i + 1]->string)) {
+			entry->ref.data = (size_t)(owner - strpool_entry(pool, 0));
+			entry->ref.offset = owner->string.length - entry->string.length;
+		} else {
+			owner = entry;
+			entry->ref.data = SIZE_MAX;
+		}
+	}
+	free(sorted);
+
+	// Data is numbered in first use order so the output reads in source order
+	size_t *data_of_owner = malloc(count * sizeof(size_t));
+	assert(data_of_owner != NULL);
+	for (size_t i = 0; i < count; i++) {
+		strpool_entry_t *entry = strpool_entry(pool, i);
+		if (entry->ref.data == SIZE_MAX) {
+			data_of_owner[i] = pool->data.length;
+			list_push(&pool->data, &entry->string);
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		strpool_entry_t *entry = strpool_entry(pool, i);
+		if (entry->ref.data == SIZE_MAX) {
+			entry->ref = (strpool_ref_t) { .data = data_of_owner[i], .offset = 0 };
+		} else {
+			entry->ref.data = data_of_owner[entry->ref.data];
+		}
+	}
+	free(data_of_owner);
+}
+
+strpool_ref_t strpool_get(const strpool_t *pool, sv_t string) {
+	assert(pool->slot_count > 0);
+	size_t slot = strpool_find_slot(pool, string);
+	assert(pool->slots[slot] != 0 && "String literal was not added to the pool");
+	return strpool_entry(pool, pool->slots[slot] - 1)->ref;
+}
+
+// Writes a string and its terminator as QBE data items, printable runs as strings and zero runs as z
+static void strpool_print_string(outbuf_t *out, sv_t string) {
+	const unsigned char *bytes = (const unsigned char *)string.string;
+	size_t size = string.length + 1;
+	size_t i = 0;
+	while (i < size) {
+		if (i > 0) {
+			outbuf_lit(out, ", ");
+		}
+
+		if (i == string.length || bytes[i] == 0) {
+			size_t start = i;
+			while (i < size && (i == string.length || bytes[i] == 0)) {
+				i++;
+			}
+			outbuf_lit(out, "z ");
+			outbuf_u64(out, i - start);
+			continue;
+		}
+
+		outbuf_lit(out, "b \"");
+		for (; i < string.length && bytes[i] != 0; i++) {
+			unsigned char c = bytes[i];
+			if (c == '"' || c == '\\') {
+				outbuf_char(out, '\\');
+				outbuf_char(out, (char)c);
+			} else if (c == '\n') {
+				outbuf_lit(out, "\\n");
+			} else if (c == '\t') {
+				outbuf_lit(out, "\\t");
+			} else if (c >= ' ' && c <= '~') {
+				outbuf_char(out, (char)c);
+			} else {
+				// Always three octal digits, so a following digit can't extend the escape
+				outbuf_char(out, '\\');
+				outbuf_char(out, (char)('0' + (c >> 6)));
+				outbuf_char(out, (char)('0' + ((c >> 3) & 7)));
+				outbuf_char(out, (char)('0' + (c & 7)));
+			}
+		}
+		outbuf_char(out, '"');
+	}
+}
+
+void strpool_print(const strpool_t *pool, outbuf_t *out) {
+	const sv_t *data = pool->data.element_bytes;
+	for (size_t i = 0; i < pool->data.length; i++) {
+		outbuf_lit(out, "data ");
+		ir_print_data_name(out, i);
+		outbuf_lit(out, " = { ");
+		strpool_print_string(out, data[i]);
+		outbuf_lit(out, " }\n");
+	}
+}
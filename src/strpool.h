@@ -0,0 +1,31 @@
+#pragma once
+
+#include "scc.h"
+
+// String literals of the whole output. Identical literals share one data definition, and a literal
+// that's the tail of a longer one points into the longer one's data.
+typedef struct {
+	size_t data;    // index of the data definition holding the string
+	size_t offset;  // where the string starts in that data
+} strpool_ref_t;
+
+typedef struct {
+	sv_t string;  // without the terminator
+	strpool_ref_t ref;
+} strpool_entry_t;
+
+typedef struct {
+	list_t entries;   // strpool_entry_t, one per distinct string
+	uint32_t *slots;  // entry index + 1, open addressing with 0 marking an empty slot
+	size_t slot_count;
+	list_t data;      // sv_t, strings that got a data definition of their own
+} strpool_t;
+
+void strpool_init(strpool_t *pool);
+void strpool_free(strpool_t *pool);
+void strpool_add(strpool_t *pool, sv_t string);
+// Decides which strings share data, called once after the last add
+void strpool_finish(strpool_t *pool);
+// Only valid after strpool_finish, and safe to call from multiple threads
+strpool_ref_t strpool_get(const strpool_t *pool, sv_t string);
+void strpool_print(const strpool_t *pool, outbuf_t *out);
@@ -0,0 +1,244 @@
+#include "scc.h"
+
+static const type_t primitive_types[] = {
+    [TYPE_VARARGS] = { .kind = TYPE_VARARGS },
+    [TYPE_INT] = { .kind = TYPE_INT, .size = 4 },
+    [TYPE_UNSIGNED_INT] = { .kind = TYPE_UNSIGNED_INT, .size = 4 },
+    [TYPE_LONG] = { .kind = TYPE_LONG, .size = 8 },
+    [TYPE_UNSIGNED_LONG] = { .kind = TYPE_UNSIGNED_LONG, .size = 8 },
+    [TYPE_VOID] = { .kind = TYPE_VOID, .size = 1 },
+    [TYPE_CHAR] = { .kind = TYPE_CHAR, .size = 1 },
+    [TYPE_UNSIGNED_CHAR] = { .kind = TYPE_UNSIGNED_CHAR, .size = 1 },
+};
+
+const type_t *const varargs_type = &primitive_types[TYPE_VARARGS];
+const type_t *const int_type = &primitive_types[TYPE_INT];
+const type_t *const unsigned_int_type = &primitive_types[TYPE_UNSIGNED_INT];
+const type_t *const long_type = &primitive_types[TYPE_LONG];
+const type_t *const unsigned_long_type = &primitive_types[TYPE_UNSIGNED_LONG];
+const type_t *const void_type = &primitive_types[TYPE_VOID];
+const type_t *const char_type = &primitive_types[TYPE_CHAR];
+const type_t *const unsigned_char_type = &primitive_types[TYPE_UNSIGNED_CHAR];
+
+// Only derived types are stored in the table, primitives are the static objects above
+typedef struct {
+    type_t **slots;    // open addressing, NULL marks an empty slot
+    size_t slot_count; // always a power of two
+    size_t count;
+} type_table_t;
+
+static type_table_t type_table = { 0 };
+
+static uint32_t hash_pointer(uint32_t hash, const void *pointer) {
+    uint64_t value = (uintptr_t)pointer;
+    hash ^= (uint32_t)(value ^ (value >> 32));
+    return hash * 2654435761u;
+}
+
+// Inner types are interned already, so hashing and comparing their pointers is enough
+static uint32_t type_hash(const type_t *type) {
+    uint32_t hash = (2166136261u ^ type->kind) * 16777619u;
+    switch (type->kind) {
+    case TYPE_FUNC:
+        hash = hash_pointer(hash, type->as.func.return_type);
+        for (size_t i = 0; i < type->as.func.parameter_count; i++) {
+            hash = hash_pointer(hash, type->as.func.parameter_types[i]);
+        }
+        return hash;
+    case TYPE_PTR:
+        return hash_pointer(hash, type->as.pointer.inner);
+    case TYPE_ARRAY:
+        return hash_pointer(hash, type->as.array.inner);
+    default:
+        unreachable();
+    }
+}
+
+static bool type_shallow_eq(const type_t *a, const type_t *b) {
+    if (a->kind != b->kind) {
+        return false;
+    }
+    switch (a->kind) {
+    case TYPE_FUNC:
+        return a->as.func.return_type == b->as.func.return_type
+            && a->as.func.parameter_count == b->as.func.parameter_count
+            && (a->as.func.parameter_count == 0
+                || memcmp(a->as.func.parameter_types, b->as.func.parameter_types, a->as.func.parameter_count * sizeof(type_t *)) == 0);
+    case TYPE_PTR:
+        return a->as.pointer.inner == b->as.pointer.inner;
+    case TYPE_ARRAY:
+        return a->as.array.inner == b->as.array.inner;
+    default:
+        unreachable();
+    }
+}
+
+static void grow_slots(void) {
+    size_t slot_count = type_table.slot_count == 0 ? 64 : type_table.slot_count * 2;
+    type_t **slots = calloc(slot_count, sizeof(type_t *));
+    assert(slots != NULL);
+
+    for (size_t i = 0; i < type_table.slot_count; i++) {
+        type_t *type = type_table.slots[i];
+        if (type == NULL) {
+            continue;
+        }
+        size_t slot = type_hash(type) & (slot_count - 1);
+        while (slots[slot] != NULL) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = type;
+    }
+
+    free(type_table.slots);
+    type_table.slots = slots;
+    type_table.slot_count = slot_count;
+}
+
+// Returns the interned copy of key, storing key if it's new. Parameter arrays are copied on insert.
+static const type_t *type_intern(const type_t *key) {
+    // Keep the load factor below 1/2
+    if ((type_table.count + 1) * 2 > type_table.slot_count) {
+        grow_slots();
+    }
+
+    size_t slot = type_hash(key) & (type_table.slot_count - 1);
+    while (type_table.slots[slot] != NULL) {
+        if (type_shallow_eq(type_table.slots[slot], key)) {
+            return type_table.slots[slot];
+        }
+        slot = (slot + 1) & (type_table.slot_count - 1);
+    }
+
+    type_t *type = heapify(type_t, key);
+    if (type->kind == TYPE_FUNC && type->as.func.parameter_count > 0) {
+        size_t size = type->as.func.parameter_count * sizeof(type_t *);
+        const type_t **parameter_types = malloc(size);
+        assert(parameter_types != NULL);
+        memcpy(parameter_types, key->as.func.parameter_types, size);
+        type->as.func.parameter_types = parameter_types;
+    }
+    type_table.slots[slot] = type;
+    type_table.count++;
+    return type;
+}
+
+const type_t *type_ptr_to(const type_t *inner) {
+    type_t key = {
+        .kind = TYPE_PTR,
+        .size = 8,
+        .as.pointer.inner = inner,
+    };
+    return type_intern(&key);
+}
+
+const type_t *type_array_of(const type_t *inner) {
+    type_t key = {
+        .kind = TYPE_ARRAY,
+        .as.array.inner = inner,
+    };
+    return type_intern(&key);
+}
+
+const type_t *type_func(const type_t *return_type, const type_t **parameter_types, size_t parameter_count) {
+    size_t required_count = parameter_count;
+    for (size_t i = 0; i < parameter_count; i++) {
+        if (parameter_types[i] == varargs_type) {
+            required_count = i;
+            break;
+        }
+    }
+
+    type_t key = {
+        .kind = TYPE_FUNC,
+        .size = 8,
+        .as.func = {
+            .return_type = return_type,
+            .parameter_types = parameter_types,
+            .parameter_count = parameter_count,
+            .required_count = required_count,
+        },
+    };
+    return type_intern(&key);
+}
+
+size_t type_size(const type_t *type) {
+    assert(type->kind != TYPE_ARRAY && "Size of array types should be explicitly handled since they might decay to pointers");
+    assert(type->kind != TYPE_VARARGS);
+    return type->size;
+}
+
+bool type_is_primitive(const type_t *type) {
+    switch (type->kind) {
+    case TYPE_INT:
+    case TYPE_UNSIGNED_INT:
+    case TYPE_LONG:
+    case TYPE_UNSIGNED_LONG:
+    case TYPE_CHAR:
+    case TYPE_UNSIGNED_CHAR:
+    case TYPE_VOID:
+    case TYPE_ARRAY:
+    case TYPE_FUNC:
+    case TYPE_PTR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool type_is_intlike(const type_t *type) {
+    switch (type->kind) {
+    case TYPE_INT:
+    case TYPE_UNSIGNED_INT:
+    case TYPE_LONG:
+    case TYPE_UNSIGNED_LONG:
+    case TYPE_CHAR:
+    case TYPE_UNSIGNED_CHAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+size_t type_align(const type_t *type) {
+    if (type->kind == TYPE_ARRAY) {
+        return type_align(type->as.array.inner);
+    }
+    return type_size(type);
+}
+
+bool type_is_signed(const type_t *type) {
+    switch (type->kind) {
+    case TYPE_INT:
+    case TYPE_LONG:
+    case TYPE_CHAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+int64_t type_wrap(const type_t *type, int64_t value) {
+    size_t bits = type_size(type) * 8;
+    if (bits >= 64) {
+        return value;
+    }
+
+    uint64_t mask = ((uint64_t)1 << bits) - 1;
+    uint64_t wrapped = (uint64_t)value & mask;
+    if (type_is_signed(type) && (wrapped >> (bits - 1)) != 0) {
+        wrapped |= ~mask;
+    }
+    return (int64_t)wrapped;
+}
+
+const type_t *type_deref(const type_t *type) {
+    switch (type->kind) {
+    case TYPE_PTR:
+        return type->as.pointer.inner;
+    case TYPE_ARRAY:
+        return type->as.array.inner;
+    default:
+        assert(false && "Can only deref pointer or array types");
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "scc.h"
+
+typedef enum {
+    TYPE_VARARGS,
+    TYPE_INT,
+    TYPE_UNSIGNED_INT,
+    TYPE_LONG,
+    TYPE_UNSIGNED_LONG,
+    TYPE_VOID,
+    TYPE_CHAR,
+    TYPE_UNSIGNED_CHAR,
+    TYPE_FUNC,
+    TYPE_PTR,
+    TYPE_ARRAY,
+} type_kind_t;
+
+// Types are interned, structurally equal types are always the same pointer so they can be
+// compared with ==. Interned types are immutable and live until the process exits.
+typedef struct type_t type_t;
+struct type_t {
+    type_kind_t kind;
+    size_t size; // 0 for arrays and varargs, which have no size of their own
+    union {
+        struct {
+            const type_t *return_type;
+            const type_t **parameter_types;
+            size_t parameter_count;
+            size_t required_count; // parameters before the varargs marker, if any
+        } func;
+        struct {
+            const type_t *inner;
+        } pointer;
+        struct {
+            // Arrays are sized at runtime, so the size expression is not part of the type
+            const type_t *inner;
+        } array;
+    } as;
+};
+
+extern const type_t *const varargs_type;
+extern const type_t *const int_type;
+extern const type_t *const unsigned_int_type;
+extern const type_t *const long_type;
+extern const type_t *const unsigned_long_type;
+extern const type_t *const void_type;
+extern const type_t *const char_type;
+extern const type_t *const unsigned_char_type;
+
+const type_t *type_ptr_to(const type_t *inner);
+const type_t *type_array_of(const type_t *inner);
+// Copies parameter_types, the caller keeps ownership of the array
+const type_t *type_func(const type_t *return_type, const type_t **parameter_types, size_t parameter_count);
+size_t type_size(const type_t *type);
+// Primitives are aligned to their size and arrays to their element
+size_t type_align(const type_t *type);
+bool type_is_primitive(const type_t *type);
+bool type_is_intlike(const type_t *type);
+bool type_is_signed(const type_t *type);
+// Reduces value modulo 2^bits of an integer or pointer type, sign extending it back to 64 bits
+// for signed types. Constants are kept in this form so they compare like values of their type.
+int64_t type_wrap(const type_t *type, int64_t value);
+// Element type of a pointer or array type
+const type_t *type_deref(const type_t *type);
@@ -0,0 +1,6 @@
+int f(void);
+
+int main(void) {
+    f = 0;
+    return 0;
+}
@@ -0,0 +1,47 @@
+int printf(char *__format, ...);
+
+int next(int *calls) {
+    (*calls)++;
+    return *calls;
+}
+
+int main(void) {
+    int a[4];
+    a[0] = 0;
+    a[1] = 10;
+    a[2] = 20;
+    a[3] = 30;
+    int calls = 0;
+
+    // The subscript is evaluated once, so next(&calls) is only called once per statement
+    a[next(&calls)] += 5;
+    a[next(&calls)] -= 4;
+    a[next(&calls)] *= 2;
+    a[next(&calls) - 4] /= 3;
+    printf("%d %d %d %d %d\n", a[0], a[1], a[2], a[3], calls);
+
+    int i = 5;
+    int j = i++;
+    int k = ++i;
+    printf("%d %d %d\n", i, j, k);
+    j = i--;
+    k = --i;
+    printf("%d %d %d\n", i, j, k);
+
+    // Narrow types compute in int and wrap when stored
+    char c = 127;
+    c += 1;
+    printf("%d\n", c);
+    c = 127;
+    int d = ++c;
+    printf("%d %d\n", d, c);
+
+    // Pointers step by the size of the element
+    int *p = a;
+    p++;
+    p += 2;
+    printf("%d\n", *p);
+    --p;
+    printf("%d\n", *p);
+    return 0;
+}
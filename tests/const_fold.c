@@ -0,0 +1,19 @@
+int printf(char *__format, ...);
+
+int main(void) {
+    int a[2 * 4 + 1];
+    a[2 * 4] = 'Z' - 'A';
+    printf("%d\n", a[8]);
+
+    // Arithmetic wraps to the width of its type
+    printf("%d %d\n", (char)300, (unsigned char)-1);
+    printf("%u\n", (unsigned int)-1 / 2);
+    printf("%d\n", -2147483647 - 1);
+    printf("%ld\n", (long)2147483647 + 1);
+
+    // Comparisons and division follow the signedness of the operands
+    printf("%d %u\n", -7 / 2, (unsigned int)-8 / 2);
+    printf("%d %d\n", (unsigned int)1 < (unsigned int)-1, 1 < -1);
+    printf("%d %d\n", 3 == 1 + 2 && 4 != 4, 2 <= 2);
+    return 0;
+}
@@ -0,0 +1,13 @@
+int printf(char *__format, ...);
+
+int main(void) {
+    int a[2];
+    a[0] = 1;
+    a[1] = 2;
+
+    // Storing through a pointer only writes the pointee, not a whole pointer's worth of bytes
+    int *p = &a[0];
+    *p = 7;
+    printf("%d %d\n", a[0], a[1]);
+    return 0;
+}
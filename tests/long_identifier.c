@@ -0,0 +1,12 @@
+int putchar(int c);
+
+int a_rather_long_function_name_that_used_to_be_rejected(int an_equally_long_parameter_name_for_good_measure) {
+    return an_equally_long_parameter_name_for_good_measure + 1;
+}
+
+int main() {
+    int a_local_variable_whose_name_is_longer_than_thirty_one = 64;
+    putchar(a_rather_long_function_name_that_used_to_be_rejected(a_local_variable_whose_name_is_longer_than_thirty_one));
+    putchar('\n');
+    return 0;
+}
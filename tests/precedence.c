@@ -0,0 +1,18 @@
+int putchar(int c);
+
+int main() {
+    int x = 2;
+    int *p = &x;
+
+    // 'A' + 2 * 3 - 4 / 2 = 'E'
+    putchar('A' + 2 * 3 - 4 / 2);
+    // Subtraction is left associative
+    putchar('Z' - 10 - 5 - 2);
+    // Prefix operators bind tighter than any binary operator
+    putchar(-x + 'B' + *p * 2);
+    if (1 + 1 == 2 && 3 < 2 + 2 && x * 3 != 5) {
+        putchar('Y');
+    }
+    putchar('\n');
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include "preprocessor.h"
+#include "preprocessor.h"
+
+#define DIGIT(n) ('0' + (n))
+#define PRINT_DIGIT(n) putchar(DIGIT(n))
+#define NEWLINE putchar('\n')
+#define FIRST(x, ...) x
+#define TEN 10 /* block comments are allowed here */
+#define TWENTY (TEN \
+                + TEN)
+#define ONE 1 // a line comment may contain /* without opening a block comment
+#define INC(x) ((x) + 1)
+#define ALIAS INC
+#define ID(x) x
+
+#if defined(TEN) && TWENTY / 2 == TEN && !defined UNDEFINED
+#define BRANCH 1
+#elif 1 / 0
+#define BRANCH 2
+#else
+#define BRANCH 3
+#endif
+
+#ifdef BRANCH
+#undef BRANCH
+#define BRANCH 4
+#endif
+
+#if 0
+#error This group is skipped
+#endif
+
+int main(void) {
+    PRINT_DIGIT(BRANCH);
+    NEWLINE;
+    PRINT_DIGIT(SQUARE(3));
+    PRINT_DIGIT(FIRST(7, 8, 9));
+    PRINT_DIGIT(TWENTY - 15);
+    NEWLINE;
+    // Replacements are rescanned together with the tokens that follow them
+    PRINT_DIGIT(ALIAS(ONE));
+    PRINT_DIGIT(ID(INC)(2));
+    NEWLINE;
+    return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef PREPROCESSOR_H
+#define PREPROCESSOR_H
+
+// Included twice by preprocessor.c, the guard keeps these from being redefined
+int putchar(int c);
+
+#define SQUARE(x) ((x) * (x))
+
+#endif
@@ -0,0 +1,38 @@
+int printf(char *__format, ...);
+
+// Taking the addresses keeps these locals in memory. y gets a 4 byte slot, which x takes over
+// once the first loop is done and aligns to 8.
+long scalar_slots(void) {
+    long total = 0;
+    for (int j = 0; j < 2; j++) {
+        int y = 100;
+        int *py = &y;
+        total += *py;
+    }
+    for (int i = 0; i < 3; i++) {
+        long x = i;
+        long *px = &x;
+        total += *px * 10;
+    }
+    return total;
+}
+
+int main(void) {
+    long total = 0;
+    {
+        char small[2];
+        small[1] = 'a';
+        total += small[1];
+    }
+    {
+        // Takes over the slot of small and grows it, total must stay untouched
+        char large[32];
+        for (int i = 0; i < 32; i++) {
+            large[i] = 1;
+        }
+        total += large[31];
+    }
+    total += scalar_slots();
+    printf("%ld\n", total);
+    return 0;
+}
@@ -0,0 +1,41 @@
+int printf(char *__format, ...);
+
+int collatz_steps(int n) {
+    int steps = 0;
+    while (n > 1) {
+        if (n - n / 2 * 2 == 0) {
+            n = n / 2;
+        } else {
+            n = 3 * n + 1;
+        }
+        steps++;
+    }
+    return steps;
+}
+
+int main(void) {
+    // Narrow locals wrap when stored, even though they never touch memory
+    char c = 120;
+    unsigned char u = 250;
+    for (int i = 0; i < 10; i++) {
+        c++;
+        u += 3;
+    }
+
+    // Values merged from both branches and across loop iterations
+    int a = 1;
+    int b = 1;
+    for (int i = 0; i < 20; i++) {
+        int next = a + b;
+        a = b;
+        b = next;
+    }
+
+    // Taking the address keeps a local in memory, writes through the pointer stay visible
+    int x = 5;
+    int *p = &x;
+    *p = 7;
+
+    printf("%d %d %d %d %d\n", c, u, b, x, collatz_steps(27));
+    return 0;
+}
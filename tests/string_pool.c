@@ -0,0 +1,16 @@
+int printf(char *__format, ...);
+
+char *greeting(void) {
+    return "Hello, world\n";
+}
+
+int main(void) {
+    char *a = "world\n";
+    char *b = "Hello, world\n";
+    printf("%s", a);
+    printf("%s", b);
+    printf("%s", greeting());
+    printf("%d %d\n", a == b + 7, b == greeting());
+    printf("%s|%s\n", "", "\"quoted\"\t\\");
+    return 0;
+}